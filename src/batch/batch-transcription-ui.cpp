@@ -0,0 +1,224 @@
+#include "batch-transcription-ui.h"
+#include "batch-transcription.h"
+#include "plugin-support.h"
+#include "model-utils/model-downloader.h"
+#include "model-utils/model-registry.h"
+
+#include <obs-module.h>
+#include <obs-frontend-api.h>
+
+#include <chrono>
+
+BatchTranscriptionWorker::BatchTranscriptionWorker(const std::string &input_path_,
+						   const std::string &output_path_,
+						   const std::string &model_path_,
+						   const std::string &language_)
+	: input_path(input_path_),
+	  output_path(output_path_),
+	  model_path(model_path_),
+	  language(language_)
+{
+}
+
+void BatchTranscriptionWorker::run()
+{
+	std::string error_message;
+	std::vector<float> pcm16k;
+	if (!load_audio_file_16k_mono(this->input_path, pcm16k, error_message)) {
+		obs_log(LOG_ERROR, "Batch transcription: %s", error_message.c_str());
+		emit error(QString::fromStdString(error_message));
+		return;
+	}
+
+	char *model_file_path = obs_module_file(this->model_path.c_str());
+	if (model_file_path == nullptr) {
+		emit error("Model file not found");
+		return;
+	}
+	struct whisper_context *ctx = model_registry_acquire(model_file_path);
+	bfree(model_file_path);
+	if (ctx == nullptr) {
+		emit error("Failed to load whisper model");
+		return;
+	}
+
+	batch_transcription_params params;
+	params.language = this->language;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	std::vector<subtitle_cue> cues;
+	const bool ok = batch_transcribe(ctx, pcm16k, params, cues, error_message,
+					 [this](size_t done, size_t total) {
+						 emit progress((int)(done * 100 / total));
+					 });
+	model_registry_release(ctx);
+	if (!ok) {
+		obs_log(LOG_ERROR, "Batch transcription failed: %s", error_message.c_str());
+		emit error(QString::fromStdString(error_message));
+		return;
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+	const double elapsed_sec = std::chrono::duration<double>(end - start).count();
+	const double audio_sec = (double)pcm16k.size() / WHISPER_SAMPLE_RATE;
+	obs_log(LOG_INFO, "Batch transcription of %.1f sec audio took %.1f sec (%.1fx real-time)",
+		audio_sec, elapsed_sec, audio_sec / std::max(elapsed_sec, 0.001));
+
+	if (!write_subtitle_file(this->output_path, cues,
+				 subtitle_format_from_path(this->output_path))) {
+		emit error("Failed to write " + QString::fromStdString(this->output_path));
+		return;
+	}
+	emit finished(QString("Wrote %1 cues to %2")
+			      .arg(cues.size())
+			      .arg(QString::fromStdString(this->output_path)));
+}
+
+BatchTranscriptionDialog::BatchTranscriptionDialog(const std::string &input_path,
+						   const std::string &output_path,
+						   const std::string &model_path,
+						   const std::string &language, QWidget *parent)
+	: QDialog(parent)
+{
+	this->setWindowTitle("Transcribing media file...");
+	this->setWindowFlags(Qt::Dialog | Qt::WindowTitleHint | Qt::CustomizeWindowHint);
+	this->setMinimumWidth(400);
+
+	this->layout = new QVBoxLayout(this);
+
+	QLabel *input_label = new QLabel(this);
+	input_label->setText(QString::fromStdString(input_path));
+	input_label->setAlignment(Qt::AlignCenter);
+	this->layout->addWidget(input_label);
+
+	this->progress_bar = new QProgressBar(this);
+	this->progress_bar->setRange(0, 100);
+	this->progress_bar->setValue(0);
+	this->progress_bar->setAlignment(Qt::AlignCenter);
+	this->progress_bar->setFormat("%p%");
+	this->layout->addWidget(this->progress_bar);
+
+	this->worker_thread = new QThread();
+	this->worker =
+		new BatchTranscriptionWorker(input_path, output_path, model_path, language);
+	this->worker->moveToThread(this->worker_thread);
+
+	connect(this->worker_thread, &QThread::started, this->worker,
+		&BatchTranscriptionWorker::run);
+	connect(this->worker, &BatchTranscriptionWorker::progress, this,
+		&BatchTranscriptionDialog::update_progress);
+	connect(this->worker, &BatchTranscriptionWorker::finished, this,
+		&BatchTranscriptionDialog::transcription_finished);
+	connect(this->worker, &BatchTranscriptionWorker::error, this,
+		&BatchTranscriptionDialog::show_error);
+
+	this->worker_thread->start();
+}
+
+void BatchTranscriptionDialog::update_progress(int percent)
+{
+	this->progress_bar->setValue(percent);
+}
+
+void BatchTranscriptionDialog::transcription_finished(const QString &message)
+{
+	this->setWindowTitle("Transcription finished!");
+	this->progress_bar->setValue(100);
+	this->progress_bar->setFormat("Transcription finished!");
+	QLabel *message_label = new QLabel(this);
+	message_label->setText(message);
+	message_label->setAlignment(Qt::AlignCenter);
+	this->layout->addWidget(message_label);
+	QPushButton *close_button = new QPushButton("Close", this);
+	this->layout->addWidget(close_button);
+	connect(close_button, &QPushButton::clicked, this, &BatchTranscriptionDialog::close);
+}
+
+void BatchTranscriptionDialog::show_error(const QString &reason)
+{
+	this->setWindowTitle("Transcription failed!");
+	this->progress_bar->setFormat("Transcription failed!");
+	this->progress_bar->setStyleSheet("QProgressBar::chunk { background-color: #FF0000; }");
+	QLabel *error_label = new QLabel(this);
+	error_label->setText(reason);
+	error_label->setAlignment(Qt::AlignCenter);
+	error_label->setStyleSheet("QLabel { color : red; }");
+	this->layout->addWidget(error_label);
+	QPushButton *close_button = new QPushButton("Close", this);
+	this->layout->addWidget(close_button);
+	connect(close_button, &QPushButton::clicked, this, &BatchTranscriptionDialog::close);
+}
+
+BatchTranscriptionDialog::~BatchTranscriptionDialog()
+{
+	this->worker_thread->quit();
+	this->worker_thread->wait();
+	delete this->worker_thread;
+	delete this->worker;
+}
+
+static void start_batch_transcription(const std::string &input_path,
+				      const std::string &output_path,
+				      const std::string &model_path, const std::string &language)
+{
+	BatchTranscriptionDialog *dialog =
+		new BatchTranscriptionDialog(input_path, output_path, model_path, language,
+					     (QWidget *)obs_frontend_get_main_window());
+	dialog->setAttribute(Qt::WA_DeleteOnClose);
+	dialog->show();
+}
+
+static void batch_transcription_menu_clicked(void *)
+{
+	QWidget *main_window = (QWidget *)obs_frontend_get_main_window();
+	const QString input_path = QFileDialog::getOpenFileName(
+		main_window, "Select a recording to transcribe", QString(),
+		"Media files (*.mkv *.mp4 *.mov *.flv *.ts *.wav *.mp3 *.m4a *.ogg);;"
+		"All files (*)");
+	if (input_path.isEmpty()) {
+		return;
+	}
+
+	const QStringList models = {"models/ggml-tiny.en.bin",  "models/ggml-tiny.bin",
+				    "models/ggml-base.en.bin",  "models/ggml-base.bin",
+				    "models/ggml-small.en.bin", "models/ggml-small.bin"};
+	bool ok = false;
+	const QString model_path = QInputDialog::getItem(main_window, "Whisper Model",
+							 "Model", models, 2, false, &ok);
+	if (!ok) {
+		return;
+	}
+
+	const QFileInfo input_info(input_path);
+	const QString default_output =
+		input_info.dir().filePath(input_info.completeBaseName() + ".srt");
+	const QString output_path =
+		QFileDialog::getSaveFileName(main_window, "Save subtitles", default_output,
+					     "SubRip (*.srt);;WebVTT (*.vtt)");
+	if (output_path.isEmpty()) {
+		return;
+	}
+
+	const std::string model = model_path.toStdString();
+	// English-only models cannot auto-detect the language
+	const std::string language = model.find(".en.") != std::string::npos ? "en" : "auto";
+	const std::string input = input_path.toStdString();
+	const std::string output = output_path.toStdString();
+
+	if (!check_if_model_exists(model)) {
+		download_model_with_ui_dialog(model, [=](int download_status) {
+			if (download_status == 0) {
+				start_batch_transcription(input, output, model, language);
+			} else {
+				obs_log(LOG_ERROR, "Model download failed");
+			}
+		});
+		return;
+	}
+	start_batch_transcription(input, output, model, language);
+}
+
+extern "C" void register_batch_transcription_tool(void)
+{
+	obs_frontend_add_tools_menu_item(obs_module_text("BatchTranscriptionMenuItem"),
+					 batch_transcription_menu_clicked, nullptr);
+}
@@ -0,0 +1,50 @@
+#ifndef BATCH_TRANSCRIPTION_UI_H
+#define BATCH_TRANSCRIPTION_UI_H
+
+#include <QtWidgets>
+#include <QThread>
+
+#include <string>
+
+class BatchTranscriptionWorker : public QObject {
+	Q_OBJECT
+public:
+	BatchTranscriptionWorker(const std::string &input_path, const std::string &output_path,
+				 const std::string &model_path, const std::string &language);
+
+public slots:
+	void run();
+
+signals:
+	void progress(int percent);
+	void finished(const QString &message);
+	void error(const QString &reason);
+
+private:
+	std::string input_path;
+	std::string output_path;
+	std::string model_path;
+	std::string language;
+};
+
+class BatchTranscriptionDialog : public QDialog {
+	Q_OBJECT
+public:
+	BatchTranscriptionDialog(const std::string &input_path, const std::string &output_path,
+				 const std::string &model_path, const std::string &language,
+				 QWidget *parent = nullptr);
+	~BatchTranscriptionDialog();
+
+public slots:
+	void update_progress(int percent);
+	void transcription_finished(const QString &message);
+	void show_error(const QString &reason);
+
+private:
+	QVBoxLayout *layout;
+	QProgressBar *progress_bar;
+	QThread *worker_thread;
+	BatchTranscriptionWorker *worker;
+};
+
+#endif // BATCH_TRANSCRIPTION_UI_H
@@ -0,0 +1,503 @@
+#include "batch-transcription.h"
+#include "ngram-lm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char **environ;
+#endif
+
+// VAD analysis frame for splitting, 20 ms at 16 kHz
+#define SPLIT_FRAME_SIZE 320
+// padding kept around each chunk so word onsets/endings are not clipped
+#define SPLIT_PADDING_MS 100
+// absolute energy floor below which a frame is always silence
+#define SPLIT_MIN_ENERGY 0.0005f
+
+static uint32_t read_u32_le(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+	       ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_u16_le(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Downsample by averaging the input around each output position, then interpolating.
+// Good enough for speech going to the whisper log-mel frontend.
+static void resample_to_16k(const std::vector<float> &in, uint32_t in_rate, std::vector<float> &out)
+{
+	if (in_rate == WHISPER_SAMPLE_RATE) {
+		out = in;
+		return;
+	}
+	const double ratio = (double)in_rate / (double)WHISPER_SAMPLE_RATE;
+	const size_t out_size = (size_t)((double)in.size() / ratio);
+	const int half_window = std::max(0, (int)(ratio / 2.0));
+	out.resize(out_size);
+	for (size_t i = 0; i < out_size; i++) {
+		const double pos = (double)i * ratio;
+		const size_t idx = (size_t)pos;
+		const double frac = pos - (double)idx;
+		float acc = 0.0f;
+		int n = 0;
+		for (int k = -half_window; k <= half_window; k++) {
+			const int64_t j = (int64_t)idx + k;
+			if (j >= 0 && j + 1 < (int64_t)in.size()) {
+				acc += (float)((1.0 - frac) * in[(size_t)j] +
+					       frac * in[(size_t)j + 1]);
+				n++;
+			}
+		}
+		out[i] = n > 0 ? acc / (float)n : 0.0f;
+	}
+}
+
+static bool load_wav_file(const std::string &path, std::vector<float> &pcm16k, std::string &error)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		error = "cannot open " + path;
+		return false;
+	}
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)),
+				   std::istreambuf_iterator<char>());
+	if (bytes.size() < 12 || memcmp(bytes.data(), "RIFF", 4) != 0 ||
+	    memcmp(bytes.data() + 8, "WAVE", 4) != 0) {
+		error = "not a RIFF/WAVE file";
+		return false;
+	}
+
+	uint16_t format = 0, channels = 0, bits = 0;
+	uint32_t sample_rate = 0;
+	const uint8_t *data = nullptr;
+	size_t data_size = 0;
+	size_t pos = 12;
+	while (pos + 8 <= bytes.size()) {
+		const uint8_t *chunk = bytes.data() + pos;
+		const size_t chunk_size =
+			std::min((size_t)read_u32_le(chunk + 4), bytes.size() - pos - 8);
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+			format = read_u16_le(chunk + 8);
+			channels = read_u16_le(chunk + 10);
+			sample_rate = read_u32_le(chunk + 12);
+			bits = read_u16_le(chunk + 22);
+			if (format == 0xFFFE && chunk_size >= 26) {
+				// WAVE_FORMAT_EXTENSIBLE, the sub format GUID starts with the tag
+				format = read_u16_le(chunk + 32);
+			}
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			data = chunk + 8;
+			data_size = chunk_size;
+		}
+		pos += 8 + chunk_size + (chunk_size & 1);
+	}
+
+	if (data == nullptr || channels == 0 || sample_rate == 0) {
+		error = "WAV file is missing the fmt or data chunk";
+		return false;
+	}
+	const bool is_float = format == 3 && bits == 32;
+	const bool is_pcm = format == 1 && (bits == 16 || bits == 24 || bits == 32);
+	if (!is_float && !is_pcm) {
+		error = "unsupported WAV sample format";
+		return false;
+	}
+
+	const size_t bytes_per_sample = bits / 8;
+	const size_t n_frames = data_size / (bytes_per_sample * channels);
+	std::vector<float> mono(n_frames, 0.0f);
+	for (size_t i = 0; i < n_frames; i++) {
+		float acc = 0.0f;
+		for (size_t c = 0; c < channels; c++) {
+			const uint8_t *s = data + (i * channels + c) * bytes_per_sample;
+			float v = 0.0f;
+			if (is_float) {
+				uint32_t u = read_u32_le(s);
+				memcpy(&v, &u, sizeof(v));
+			} else if (bits == 16) {
+				v = (float)(int16_t)read_u16_le(s) / 32768.0f;
+			} else if (bits == 24) {
+				int32_t x = (int32_t)((uint32_t)s[0] << 8 | (uint32_t)s[1] << 16 |
+						      (uint32_t)s[2] << 24);
+				v = (float)(x >> 8) / 8388608.0f;
+			} else {
+				v = (float)(int32_t)read_u32_le(s) / 2147483648.0f;
+			}
+			acc += v;
+		}
+		mono[i] = acc / (float)channels;
+	}
+
+	resample_to_16k(mono, sample_rate, pcm16k);
+	return true;
+}
+
+// Run ffmpeg on path and collect its standard output. The path is passed as an argument of
+// its own, never through a shell, so no file name can run commands.
+static bool run_ffmpeg(const std::string &path, std::vector<char> &output)
+{
+	output.clear();
+	char buffer[16384];
+#ifdef _WIN32
+	// file names cannot contain quotes on Windows, quoting keeps spaces in one argument
+	std::string command_line = "ffmpeg -nostdin -loglevel error -i \"" + path +
+				   "\" -f f32le -ac 1 -ar 16000 -";
+	SECURITY_ATTRIBUTES attributes = {sizeof(attributes), NULL, TRUE};
+	HANDLE read_pipe = NULL;
+	HANDLE write_pipe = NULL;
+	if (!CreatePipe(&read_pipe, &write_pipe, &attributes, 0)) {
+		return false;
+	}
+	SetHandleInformation(read_pipe, HANDLE_FLAG_INHERIT, 0);
+	STARTUPINFOA startup_info;
+	PROCESS_INFORMATION process_info;
+	ZeroMemory(&startup_info, sizeof(startup_info));
+	startup_info.cb = sizeof(startup_info);
+	startup_info.dwFlags = STARTF_USESTDHANDLES;
+	startup_info.hStdOutput = write_pipe;
+	startup_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	ZeroMemory(&process_info, sizeof(process_info));
+	const bool started = CreateProcessA(NULL, &command_line[0], NULL, NULL, TRUE,
+					    CREATE_NO_WINDOW, NULL, NULL, &startup_info,
+					    &process_info);
+	CloseHandle(write_pipe);
+	if (!started) {
+		CloseHandle(read_pipe);
+		return false;
+	}
+	DWORD n_read = 0;
+	while (ReadFile(read_pipe, buffer, sizeof(buffer), &n_read, NULL) && n_read > 0) {
+		output.insert(output.end(), buffer, buffer + n_read);
+	}
+	CloseHandle(read_pipe);
+	WaitForSingleObject(process_info.hProcess, INFINITE);
+	DWORD exit_code = 1;
+	GetExitCodeProcess(process_info.hProcess, &exit_code);
+	CloseHandle(process_info.hProcess);
+	CloseHandle(process_info.hThread);
+	return exit_code == 0;
+#else
+	int fds[2];
+	if (pipe(fds) != 0) {
+		return false;
+	}
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, fds[0]);
+	posix_spawn_file_actions_addclose(&actions, fds[1]);
+	std::vector<char *> argv = {(char *)"ffmpeg", (char *)"-nostdin", (char *)"-loglevel",
+				    (char *)"error",  (char *)"-i",       (char *)path.c_str(),
+				    (char *)"-f",     (char *)"f32le",    (char *)"-ac",
+				    (char *)"1",      (char *)"-ar",      (char *)"16000",
+				    (char *)"-",      nullptr};
+	pid_t pid = 0;
+	const int spawn_error =
+		posix_spawnp(&pid, "ffmpeg", &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fds[1]);
+	if (spawn_error != 0) {
+		close(fds[0]);
+		return false;
+	}
+	ssize_t n_read = 0;
+	while ((n_read = read(fds[0], buffer, sizeof(buffer))) != 0) {
+		if (n_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		output.insert(output.end(), buffer, buffer + n_read);
+	}
+	close(fds[0]);
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+static bool load_with_ffmpeg(const std::string &path, std::vector<float> &pcm16k,
+			     std::string &error)
+{
+	std::vector<char> output;
+	const bool ok = run_ffmpeg(path, output);
+	pcm16k.resize(output.size() / sizeof(float));
+	if (!pcm16k.empty()) {
+		memcpy(pcm16k.data(), output.data(), pcm16k.size() * sizeof(float));
+	}
+	if (!ok || pcm16k.empty()) {
+		error = "ffmpeg could not decode " + path;
+		return false;
+	}
+	return true;
+}
+
+bool load_audio_file_16k_mono(const std::string &path, std::vector<float> &pcm16k,
+			      std::string &error)
+{
+	std::string ext = path.substr(std::min(path.size(), path.find_last_of('.') + 1));
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext == "wav") {
+		return load_wav_file(path, pcm16k, error);
+	}
+	return load_with_ffmpeg(path, pcm16k, error);
+}
+
+std::vector<batch_audio_chunk> split_audio_at_vad_boundaries(const std::vector<float> &pcm16k,
+							     int max_chunk_ms, int min_silence_ms)
+{
+	std::vector<batch_audio_chunk> chunks;
+	const size_t n_frames = pcm16k.size() / SPLIT_FRAME_SIZE;
+	if (n_frames == 0) {
+		return chunks;
+	}
+
+	// mean absolute amplitude per frame
+	std::vector<float> energy(n_frames, 0.0f);
+	for (size_t f = 0; f < n_frames; f++) {
+		const float *frame = pcm16k.data() + f * SPLIT_FRAME_SIZE;
+		float acc = 0.0f;
+		for (size_t i = 0; i < SPLIT_FRAME_SIZE; i++) {
+			acc += fabsf(frame[i]);
+		}
+		energy[f] = acc / (float)SPLIT_FRAME_SIZE;
+	}
+
+	// speech threshold relative to the noise floor (10th percentile of frame energy)
+	std::vector<float> sorted_energy(energy);
+	std::nth_element(sorted_energy.begin(), sorted_energy.begin() + n_frames / 10,
+			 sorted_energy.end());
+	const float thold = std::max(SPLIT_MIN_ENERGY, sorted_energy[n_frames / 10] * 3.0f);
+
+	// collect speech regions in frames, merging across pauses shorter than min_silence_ms
+	const size_t frame_ms = SPLIT_FRAME_SIZE * 1000 / WHISPER_SAMPLE_RATE;
+	const size_t min_gap = std::max<size_t>(1, (size_t)min_silence_ms / frame_ms);
+	std::vector<std::pair<size_t, size_t>> regions;
+	for (size_t f = 0; f < n_frames; f++) {
+		if (energy[f] < thold) {
+			continue;
+		}
+		if (!regions.empty() && f - regions.back().second <= min_gap) {
+			regions.back().second = f + 1;
+		} else {
+			regions.push_back({f, f + 1});
+		}
+	}
+
+	// pack regions into chunks no longer than max_chunk_ms, cutting in the pauses
+	const size_t pad_frames = SPLIT_PADDING_MS / frame_ms;
+	const size_t max_frames = std::max(pad_frames * 2 + 2, (size_t)max_chunk_ms / frame_ms);
+	size_t chunk_start = 0, chunk_end = 0;
+	bool open = false;
+	auto close_chunk = [&](size_t next_start) {
+		size_t start = chunk_start > pad_frames ? chunk_start - pad_frames : 0;
+		if (!chunks.empty()) {
+			// never overlap the previous chunk, that would duplicate words
+			start = std::max(start, chunks.back().end / SPLIT_FRAME_SIZE);
+		}
+		size_t end = std::min(n_frames, chunk_end + pad_frames);
+		end = std::min(end, std::max(chunk_end, next_start));
+		chunks.push_back({start * SPLIT_FRAME_SIZE, end * SPLIT_FRAME_SIZE,
+				  (int64_t)(start * frame_ms)});
+	};
+	for (const auto &region : regions) {
+		size_t start = region.first;
+		const size_t end = region.second;
+		if (open && end - chunk_start + pad_frames * 2 > max_frames) {
+			close_chunk(start);
+			open = false;
+		}
+		// a single region longer than a chunk: cut at the quietest frame near the limit
+		while (end - start + pad_frames * 2 > max_frames) {
+			const size_t limit = start + max_frames - pad_frames * 2;
+			const size_t search_from = start + (limit - start) * 4 / 5;
+			size_t cut = limit;
+			for (size_t f = search_from; f < limit; f++) {
+				if (energy[f] < energy[cut - 1]) {
+					cut = f + 1;
+				}
+			}
+			chunk_start = start;
+			chunk_end = cut;
+			close_chunk(cut);
+			start = cut;
+		}
+		if (!open) {
+			chunk_start = start;
+			open = true;
+		}
+		chunk_end = end;
+	}
+	if (open) {
+		close_chunk(n_frames);
+	}
+	return chunks;
+}
+
+bool batch_transcribe_chunks(struct whisper_context *ctx, const std::vector<float> &pcm16k,
+			     const std::vector<batch_audio_chunk> &chunks,
+			     const whisper_full_params &wparams, int n_processors,
+			     std::vector<subtitle_cue> &cues, std::string &error,
+			     batch_progress_callback progress, batch_chunk_gate gate)
+{
+	if (ctx == nullptr) {
+		error = "whisper context is null";
+		return false;
+	}
+	cues.clear();
+	if (chunks.empty()) {
+		return true;
+	}
+	n_processors = std::max(1, std::min(n_processors, (int)chunks.size()));
+
+	std::vector<std::vector<subtitle_cue>> chunk_cues(chunks.size());
+	std::atomic<size_t> next_chunk(0);
+	std::atomic<size_t> done_chunks(0);
+	std::atomic<bool> failed(false);
+	std::mutex error_mutex;
+	std::mutex progress_mutex;
+
+	auto worker = [&]() {
+		struct whisper_state *state = whisper_init_state(ctx);
+		if (state == nullptr) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			error = "failed to allocate whisper state";
+			failed = true;
+			return;
+		}
+		size_t i;
+		while (!failed && (i = next_chunk.fetch_add(1)) < chunks.size()) {
+			if (gate && !gate(i)) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				error = "transcription stopped before chunk " + std::to_string(i);
+				failed = true;
+				break;
+			}
+			const batch_audio_chunk &chunk = chunks[i];
+			const size_t end = std::min(chunk.end, pcm16k.size());
+			if (chunk.start >= end) {
+				++done_chunks;
+				continue;
+			}
+			if (whisper_full_with_state(ctx, state, wparams,
+						    pcm16k.data() + chunk.start,
+						    (int)(end - chunk.start)) != 0) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				error = "whisper failed on chunk " + std::to_string(i);
+				failed = true;
+				break;
+			}
+			const int n_segments = whisper_full_n_segments_from_state(state);
+			for (int s = 0; s < n_segments; s++) {
+				std::string text =
+					whisper_full_get_segment_text_from_state(state, s);
+				text.erase(0, text.find_first_not_of(' '));
+				if (text.empty()) {
+					continue;
+				}
+				// whisper timestamps are in 10 ms units
+				const int64_t t0 = whisper_full_get_segment_t0_from_state(state, s);
+				const int64_t t1 = whisper_full_get_segment_t1_from_state(state, s);
+				chunk_cues[i].push_back(
+					{chunk.start_ms + t0 * 10, chunk.start_ms + t1 * 10, text});
+			}
+			const size_t done = ++done_chunks;
+			if (progress) {
+				std::lock_guard<std::mutex> lock(progress_mutex);
+				progress(done, chunks.size());
+			}
+		}
+		whisper_free_state(state);
+	};
+
+	std::vector<std::thread> workers;
+	for (int p = 0; p < n_processors; p++) {
+		workers.emplace_back(worker);
+	}
+	for (auto &t : workers) {
+		t.join();
+	}
+	if (failed) {
+		return false;
+	}
+
+	// stitch in chunk order, chunks do not overlap so the cues stay sorted
+	for (auto &c : chunk_cues) {
+		cues.insert(cues.end(), c.begin(), c.end());
+	}
+	return true;
+}
+
+bool batch_transcribe(struct whisper_context *ctx, const std::vector<float> &pcm16k,
+		      const batch_transcription_params &params, std::vector<subtitle_cue> &cues,
+		      std::string &error, batch_progress_callback progress)
+{
+	if (ctx == nullptr) {
+		error = "whisper context is null";
+		return false;
+	}
+
+	const std::vector<batch_audio_chunk> chunks =
+		split_audio_at_vad_boundaries(pcm16k, params.max_chunk_ms, params.min_silence_ms);
+
+	const int n_threads_per_processor = std::max(1, params.n_threads_per_processor);
+	int n_processors = params.n_processors;
+	if (n_processors <= 0) {
+		n_processors = std::max(1, (int)std::thread::hardware_concurrency() /
+						   n_threads_per_processor);
+	}
+
+	whisper_full_params wparams = whisper_full_default_params(
+		params.beam_size > 0 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+	if (params.beam_size > 0) {
+		wparams.beam_search.beam_size = params.beam_size;
+	}
+	wparams.language = params.language.c_str();
+	wparams.translate = params.translate;
+	wparams.n_threads = n_threads_per_processor;
+	wparams.no_context = true;
+	wparams.single_segment = false;
+	wparams.print_special = false;
+	wparams.print_progress = false;
+	wparams.print_realtime = false;
+	wparams.print_timestamps = false;
+	wparams.suppress_non_speech_tokens = true;
+
+	// the filters only read the fusion, the workers share it
+	struct lm_fusion fusion;
+	struct logits_filter_chain chain;
+	if (!params.lm_path.empty()) {
+		fusion.path = params.lm_path;
+		fusion.lm = ngram_lm_open(params.lm_path, error);
+		if (fusion.lm == nullptr) {
+			return false;
+		}
+		lm_fusion_prepare(&fusion, ctx);
+		fusion.weight = params.lm_weight;
+		logits_filter_chain_add_lm_fusion(&chain, &fusion, ctx);
+	}
+	logits_filter_chain_install(&chain, wparams);
+
+	const bool ok = batch_transcribe_chunks(ctx, pcm16k, chunks, wparams, n_processors, cues,
+						error, progress);
+	lm_fusion_free(&fusion);
+	return ok;
+}
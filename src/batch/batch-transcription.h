@@ -0,0 +1,68 @@
+#ifndef BATCH_TRANSCRIPTION_H
+#define BATCH_TRANSCRIPTION_H
+
+#include <whisper.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "subtitle-format.h"
+
+// A span of 16 kHz samples [start, end) that is transcribed as one unit
+struct batch_audio_chunk {
+	size_t start;
+	size_t end;
+	// time of the first sample, the cues of the chunk are offset by it
+	int64_t start_ms;
+};
+
+struct batch_transcription_params {
+	std::string language = "en";
+	bool translate = false;
+	// Number of whisper states working in parallel, 0 = derive from the core count
+	int n_processors = 0;
+	// Threads used by each whisper state
+	int n_threads_per_processor = 2;
+	// Chunks never exceed the whisper window
+	int max_chunk_ms = 30000;
+	// Pauses shorter than this are not considered as split points
+	int min_silence_ms = 300;
+	// 0 decodes greedily, otherwise the beam width
+	int beam_size = 0;
+	// n-gram model fused with the decoder, see lm_fusion
+	std::string lm_path;
+	float lm_weight = 0.3f;
+};
+
+// done / total are counted in chunks
+typedef std::function<void(size_t done, size_t total)> batch_progress_callback;
+// Called by a worker before it starts on chunk i, returning false stops the transcription
+typedef std::function<bool(size_t i)> batch_chunk_gate;
+
+// Load an audio or media file as 16 kHz mono float samples.
+// WAV files are read directly, anything else is decoded through an `ffmpeg` executable.
+bool load_audio_file_16k_mono(const std::string &path, std::vector<float> &pcm16k,
+			      std::string &error);
+
+// Split 16 kHz mono audio at pauses found by an energy VAD. Silent stretches are dropped.
+std::vector<batch_audio_chunk> split_audio_at_vad_boundaries(const std::vector<float> &pcm16k,
+							     int max_chunk_ms, int min_silence_ms);
+
+// Transcribe the chunks on n_processors whisper states over the shared context `ctx`, each
+// state taking the next chunk when it is done with one, and stitch the results into cues in
+// chunk order. wparams.n_threads is the thread count of each state.
+bool batch_transcribe_chunks(struct whisper_context *ctx, const std::vector<float> &pcm16k,
+			     const std::vector<batch_audio_chunk> &chunks,
+			     const whisper_full_params &wparams, int n_processors,
+			     std::vector<subtitle_cue> &cues, std::string &error,
+			     batch_progress_callback progress = nullptr,
+			     batch_chunk_gate gate = nullptr);
+
+// Split the audio at pauses and transcribe it with batch_transcribe_chunks
+bool batch_transcribe(struct whisper_context *ctx, const std::vector<float> &pcm16k,
+		      const batch_transcription_params &params, std::vector<subtitle_cue> &cues,
+		      std::string &error, batch_progress_callback progress = nullptr);
+
+#endif // BATCH_TRANSCRIPTION_H
@@ -0,0 +1,182 @@
+#include "channel-mixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHANNEL_MIXER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CHANNEL_MIXER_NEON
+#endif
+
+// energy is measured in 10 ms blocks
+#define CHANNEL_MIXER_BLOCK_MS 10
+// channels more than this far below the best one are left out of the auto mix
+#define CHANNEL_MIXER_MAX_SNR_GAP_DB 6.0f
+// how fast the weights follow a change of the best channel, per window
+#define CHANNEL_MIXER_WEIGHT_SMOOTHING 0.3f
+
+// dst = src * w
+static void scale(float *dst, const float *src, float w, size_t n)
+{
+	size_t i = 0;
+#if defined(CHANNEL_MIXER_SSE2)
+	const __m128 vw = _mm_set1_ps(w);
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), vw));
+	}
+#elif defined(CHANNEL_MIXER_NEON)
+	const float32x4_t vw = vdupq_n_f32(w);
+	for (; i + 4 <= n; i += 4) {
+		vst1q_f32(dst + i, vmulq_f32(vld1q_f32(src + i), vw));
+	}
+#endif
+	for (; i < n; i++) {
+		dst[i] = src[i] * w;
+	}
+}
+
+// dst += src * w
+static void scale_add(float *dst, const float *src, float w, size_t n)
+{
+	size_t i = 0;
+#if defined(CHANNEL_MIXER_SSE2)
+	const __m128 vw = _mm_set1_ps(w);
+	for (; i + 4 <= n; i += 4) {
+		const __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), vw);
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), v));
+	}
+#elif defined(CHANNEL_MIXER_NEON)
+	const float32x4_t vw = vdupq_n_f32(w);
+	for (; i + 4 <= n; i += 4) {
+		vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), vw));
+	}
+#endif
+	for (; i < n; i++) {
+		dst[i] += src[i] * w;
+	}
+}
+
+static float sum_squares(const float *src, size_t n)
+{
+	size_t i = 0;
+	float sum = 0.0f;
+#if defined(CHANNEL_MIXER_SSE2)
+	__m128 acc = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4) {
+		const __m128 v = _mm_loadu_ps(src + i);
+		acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(CHANNEL_MIXER_NEON)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	for (; i + 4 <= n; i += 4) {
+		const float32x4_t v = vld1q_f32(src + i);
+		acc = vmlaq_f32(acc, v, v);
+	}
+	float lanes[4];
+	vst1q_f32(lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+	for (; i < n; i++) {
+		sum += src[i] * src[i];
+	}
+	return sum;
+}
+
+void channel_mixer_init(struct channel_mixer *mixer, size_t channels)
+{
+	mixer->channels = std::min<size_t>(channels, CHANNEL_MIXER_MAX_CHANNELS);
+	mixer->selection = CHANNEL_SELECTION_AUTO;
+	for (size_t c = 0; c < CHANNEL_MIXER_MAX_CHANNELS; c++) {
+		mixer->noise_floor[c] = 0.0f;
+		mixer->signal_level[c] = 0.0f;
+		mixer->snr_db[c] = 0.0f;
+		mixer->weights[c] = c < mixer->channels ? 1.0f / (float)mixer->channels : 0.0f;
+	}
+}
+
+void channel_mixer_update(struct channel_mixer *mixer, const float *const *data, size_t frames,
+			  unsigned int sample_rate)
+{
+	const size_t block = std::max<size_t>(1, sample_rate * CHANNEL_MIXER_BLOCK_MS / 1000);
+	const size_t n_blocks = frames / block;
+	if (mixer->channels == 0 || n_blocks == 0) {
+		return;
+	}
+
+	std::vector<float> energies(n_blocks);
+	float best_snr_db = -1000.0f;
+	for (size_t c = 0; c < mixer->channels; c++) {
+		for (size_t b = 0; b < n_blocks; b++) {
+			energies[b] = sum_squares(data[c] + b * block, block) / (float)block;
+		}
+		std::sort(energies.begin(), energies.end());
+		// quiet blocks give the noise, loud blocks the speech level
+		const float window_noise = energies[n_blocks / 10];
+		const float window_signal = energies[n_blocks * 9 / 10];
+
+		// the floor drops immediately and rises slowly, so speech does not raise it
+		if (mixer->noise_floor[c] == 0.0f || window_noise < mixer->noise_floor[c]) {
+			mixer->noise_floor[c] = window_noise;
+		} else {
+			mixer->noise_floor[c] += 0.05f * (window_noise - mixer->noise_floor[c]);
+		}
+		mixer->signal_level[c] += 0.3f * (window_signal - mixer->signal_level[c]);
+		mixer->snr_db[c] = 10.0f * log10f((mixer->signal_level[c] + 1e-10f) /
+						  (mixer->noise_floor[c] + 1e-10f));
+		// a muted channel has no noise either, but nothing to offer
+		if (mixer->signal_level[c] < 1e-8f) {
+			mixer->snr_db[c] = -1000.0f;
+		}
+		best_snr_db = std::max(best_snr_db, mixer->snr_db[c]);
+	}
+
+	float target[CHANNEL_MIXER_MAX_CHANNELS];
+	float total = 0.0f;
+	for (size_t c = 0; c < mixer->channels; c++) {
+		if (mixer->selection == CHANNEL_SELECTION_MIX) {
+			target[c] = 1.0f;
+		} else if (mixer->selection >= 0) {
+			target[c] = (size_t)mixer->selection == c ||
+						    (size_t)mixer->selection >= mixer->channels
+					    ? 1.0f
+					    : 0.0f;
+		} else if (mixer->snr_db[c] >= best_snr_db - CHANNEL_MIXER_MAX_SNR_GAP_DB) {
+			// close contenders are mixed, weighted by their linear SNR
+			target[c] = powf(10.0f, (mixer->snr_db[c] - best_snr_db) / 10.0f);
+		} else {
+			target[c] = 0.0f;
+		}
+		total += target[c];
+	}
+	for (size_t c = 0; c < mixer->channels; c++) {
+		target[c] = total > 0.0f ? target[c] / total : 1.0f / (float)mixer->channels;
+		if (mixer->selection == CHANNEL_SELECTION_AUTO) {
+			mixer->weights[c] +=
+				CHANNEL_MIXER_WEIGHT_SMOOTHING * (target[c] - mixer->weights[c]);
+		} else {
+			mixer->weights[c] = target[c];
+		}
+	}
+}
+
+void channel_mixer_downmix(const struct channel_mixer *mixer, const float *const *data,
+			   size_t frames, float *mono)
+{
+	if (mixer->channels == 0) {
+		std::fill(mono, mono + frames, 0.0f);
+		return;
+	}
+	scale(mono, data[0], mixer->weights[0], frames);
+	for (size_t c = 1; c < mixer->channels; c++) {
+		if (mixer->weights[c] > 0.0f) {
+			scale_add(mono, data[c], mixer->weights[c], frames);
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef CHANNEL_MIXER_H
+#define CHANNEL_MIXER_H
+
+#include <cstddef>
+
+#define CHANNEL_MIXER_MAX_CHANNELS 8
+
+// channel_selection values, 0 and up pick a single channel
+enum ChannelSelection {
+	// weight the channels by their signal to noise ratio
+	CHANNEL_SELECTION_AUTO = -1,
+	// plain average of all channels
+	CHANNEL_SELECTION_MIX = -2,
+};
+
+// Builds the mono analysis signal from multichannel input. Tracks a noise floor and speech
+// level per channel so a microphone on one channel is not diluted by noise on the others.
+struct channel_mixer {
+	size_t channels;
+	int selection;
+	float noise_floor[CHANNEL_MIXER_MAX_CHANNELS];
+	float signal_level[CHANNEL_MIXER_MAX_CHANNELS];
+	float snr_db[CHANNEL_MIXER_MAX_CHANNELS];
+	// smoothed mixing weights, sum to 1
+	float weights[CHANNEL_MIXER_MAX_CHANNELS];
+};
+
+void channel_mixer_init(struct channel_mixer *mixer, size_t channels);
+// Update the channel statistics with a window of planar input at the input sample rate
+void channel_mixer_update(struct channel_mixer *mixer, const float *const *data, size_t frames,
+			  unsigned int sample_rate);
+// Mix the planar input down to mono with the current weights
+void channel_mixer_downmix(const struct channel_mixer *mixer, const float *const *data,
+			   size_t frames, float *mono);
+
+#endif // CHANNEL_MIXER_H
@@ -0,0 +1,222 @@
+// Command line front-end for batch transcription of recordings.
+//
+// usage: localvocal-batch -m model.bin -i input.mkv [-o output.srt] [-l language]
+//                         [-p processors] [-t threads-per-processor] [-s beam-size]
+//                         [-L lm.arpa] [-W lm-weight] [-r reference.txt] [-b]
+//
+// -b measures the speed on 1, 2, 4 and 8 processors instead of writing subtitles.
+// -r prints the word error rate against a reference transcript, to compare decoding settings
+// such as beam search (-s 5) with greedy decoding and a language model (-L).
+
+#include "batch/batch-transcription.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+static void print_usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s -m model.bin -i input [-o output.srt|.vtt] [-l language]\n"
+		"          [-p processors] [-t threads-per-processor] [-s beam-size]\n"
+		"          [-L lm.arpa] [-W lm-weight] [-r reference.txt] [-b]\n",
+		argv0);
+}
+
+// Lowercase words without punctuation
+static std::vector<std::string> split_words(const std::string &text)
+{
+	std::vector<std::string> words;
+	std::string word;
+	for (unsigned char ch : text + " ") {
+		if (isspace(ch)) {
+			if (!word.empty()) {
+				words.push_back(word);
+			}
+			word.clear();
+		} else if (ch >= 0x80 || isalnum(ch) || ch == '\'') {
+			word += (char)tolower(ch);
+		}
+	}
+	return words;
+}
+
+// Substitutions, deletions and insertions between the word sequences (Levenshtein distance)
+static size_t word_errors(const std::string &reference, const std::string &hypothesis,
+			  size_t &n_reference_words)
+{
+	const std::vector<std::string> ref = split_words(reference);
+	const std::vector<std::string> hyp = split_words(hypothesis);
+	n_reference_words = ref.size();
+	std::vector<size_t> row(hyp.size() + 1);
+	for (size_t j = 0; j <= hyp.size(); j++) {
+		row[j] = j;
+	}
+	for (size_t i = 1; i <= ref.size(); i++) {
+		size_t diagonal = row[0];
+		row[0] = i;
+		for (size_t j = 1; j <= hyp.size(); j++) {
+			const size_t above = row[j];
+			row[j] = std::min({row[j] + 1, row[j - 1] + 1,
+					   diagonal + (ref[i - 1] == hyp[j - 1] ? 0 : 1)});
+			diagonal = above;
+		}
+	}
+	return row[hyp.size()];
+}
+
+// Transcribe the input once per processor count. Scaling stops at the number of chunks, and
+// at the memory bandwidth long before the core count on most machines.
+static int run_bench(struct whisper_context *ctx, const std::vector<float> &pcm16k,
+		     batch_transcription_params params)
+{
+	const double audio_sec = (double)pcm16k.size() / WHISPER_SAMPLE_RATE;
+	fprintf(stderr, "%.1f sec of audio, %d threads per processor\n", audio_sec,
+		params.n_threads_per_processor);
+	fprintf(stderr, "processors     time  real-time  speedup\n");
+	double base_sec = 0.0;
+	for (int n_processors : {1, 2, 4, 8}) {
+		params.n_processors = n_processors;
+		std::vector<subtitle_cue> cues;
+		std::string error;
+		const auto start = std::chrono::high_resolution_clock::now();
+		if (!batch_transcribe(ctx, pcm16k, params, cues, error)) {
+			fprintf(stderr, "error: %s\n", error.c_str());
+			return 1;
+		}
+		const double elapsed_sec = std::max(
+			0.001, std::chrono::duration<double>(
+				       std::chrono::high_resolution_clock::now() - start)
+				       .count());
+		if (n_processors == 1) {
+			base_sec = elapsed_sec;
+		}
+		fprintf(stderr, "%10d %7.1fs %9.1fx %7.2fx\n", n_processors, elapsed_sec,
+			audio_sec / elapsed_sec, base_sec / elapsed_sec);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	std::string model_path;
+	std::string input_path;
+	std::string output_path;
+	std::string reference_path;
+	batch_transcription_params params;
+	bool bench = false;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg == "-b") {
+			bench = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			print_usage(argv[0]);
+			return 1;
+		}
+		if (arg == "-m") {
+			model_path = argv[++i];
+		} else if (arg == "-i") {
+			input_path = argv[++i];
+		} else if (arg == "-o") {
+			output_path = argv[++i];
+		} else if (arg == "-l") {
+			params.language = argv[++i];
+		} else if (arg == "-p") {
+			params.n_processors = atoi(argv[++i]);
+		} else if (arg == "-t") {
+			params.n_threads_per_processor = atoi(argv[++i]);
+		} else if (arg == "-s") {
+			params.beam_size = atoi(argv[++i]);
+		} else if (arg == "-L") {
+			params.lm_path = argv[++i];
+		} else if (arg == "-W") {
+			params.lm_weight = (float)atof(argv[++i]);
+		} else if (arg == "-r") {
+			reference_path = argv[++i];
+		} else {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (model_path.empty() || input_path.empty()) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	if (output_path.empty()) {
+		output_path = input_path.substr(0, input_path.find_last_of('.')) + ".srt";
+	}
+
+	std::string error;
+	std::vector<float> pcm16k;
+	if (!load_audio_file_16k_mono(input_path, pcm16k, error)) {
+		fprintf(stderr, "error: %s\n", error.c_str());
+		return 1;
+	}
+
+	struct whisper_context *ctx = whisper_init_from_file_no_state(model_path.c_str());
+	if (ctx == nullptr) {
+		fprintf(stderr, "error: failed to load model %s\n", model_path.c_str());
+		return 1;
+	}
+
+	if (bench) {
+		const int status = run_bench(ctx, pcm16k, params);
+		whisper_free(ctx);
+		return status;
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	std::vector<subtitle_cue> cues;
+	const bool ok = batch_transcribe(ctx, pcm16k, params, cues, error,
+					 [](size_t done, size_t total) {
+						 fprintf(stderr, "\rtranscribed %zu / %zu chunks",
+							 done, total);
+					 });
+	whisper_free(ctx);
+	fprintf(stderr, "\n");
+	if (!ok) {
+		fprintf(stderr, "error: %s\n", error.c_str());
+		return 1;
+	}
+	const double elapsed_sec =
+		std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start)
+			.count();
+	const double audio_sec = (double)pcm16k.size() / WHISPER_SAMPLE_RATE;
+	fprintf(stderr, "%.1f sec of audio in %.1f sec (%.1fx real-time)\n", audio_sec,
+		elapsed_sec, audio_sec / (elapsed_sec > 0.001 ? elapsed_sec : 0.001));
+
+	if (!reference_path.empty()) {
+		std::ifstream reference_file(reference_path);
+		if (!reference_file.is_open()) {
+			fprintf(stderr, "error: cannot open %s\n", reference_path.c_str());
+			return 1;
+		}
+		const std::string reference((std::istreambuf_iterator<char>(reference_file)),
+					    std::istreambuf_iterator<char>());
+		std::string hypothesis;
+		for (const subtitle_cue &cue : cues) {
+			hypothesis += cue.text + " ";
+		}
+		size_t n_reference_words = 0;
+		const size_t errors = word_errors(reference, hypothesis, n_reference_words);
+		fprintf(stderr, "WER %.2f%% (%zu errors in %zu words)\n",
+			n_reference_words > 0 ? 100.0 * (double)errors / (double)n_reference_words
+					      : 0.0,
+			errors, n_reference_words);
+	}
+
+	if (!write_subtitle_file(output_path, cues, subtitle_format_from_path(output_path))) {
+		fprintf(stderr, "error: failed to write %s\n", output_path.c_str());
+		return 1;
+	}
+	fprintf(stderr, "wrote %zu cues to %s\n", cues.size(), output_path.c_str());
+	return 0;
+}
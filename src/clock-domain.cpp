@@ -0,0 +1,97 @@
+#include "clock-domain.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include "plugin-support.h"
+
+#include <algorithm>
+#include <cmath>
+
+// a timestamp this far from the prediction is a discontinuity, not jitter or drift
+#define CLOCK_DOMAIN_JUMP_NS 100000000LL
+// sample clocks of real devices stay well within 0.5% of the nominal rate
+#define CLOCK_DOMAIN_MAX_DRIFT 0.005
+// the rate is learned once the anchor is old enough to average out timestamp jitter
+#define CLOCK_DOMAIN_MIN_LEARN_SEC 10
+#define CLOCK_DOMAIN_RATE_SMOOTHING 0.05
+
+void clock_domain_reset(struct clock_domain *cd, uint32_t sample_rate)
+{
+	cd->sample_rate = sample_rate;
+	cd->anchored = false;
+	cd->anchor_obs_ns = 0;
+	cd->anchor_ns = 0;
+	cd->samples_since_anchor = 0;
+	cd->ns_per_sample = sample_rate > 0 ? 1e9 / sample_rate : 0.0;
+	cd->end_ns = 0;
+	cd->discontinuities = 0;
+	cd->offset_ns = 0;
+	cd->rate_ratio = 1.0;
+}
+
+static void clock_domain_anchor(struct clock_domain *cd, uint64_t obs_timestamp_ns)
+{
+	cd->anchored = true;
+	cd->anchor_obs_ns = obs_timestamp_ns;
+	// follow the OBS timeline across the jump, but never go back in time
+	cd->anchor_ns = std::max(obs_timestamp_ns, cd->end_ns);
+	cd->samples_since_anchor = 0;
+}
+
+uint64_t clock_domain_push(struct clock_domain *cd, uint64_t obs_timestamp_ns, uint32_t frames)
+{
+	if (cd->sample_rate == 0) {
+		return obs_timestamp_ns;
+	}
+	if (!cd->anchored) {
+		clock_domain_anchor(cd, obs_timestamp_ns);
+	} else {
+		const double nominal_ns_per_sample = 1e9 / cd->sample_rate;
+		const double elapsed_ns = (double)(obs_timestamp_ns - cd->anchor_obs_ns);
+		const double predicted_ns = (double)cd->samples_since_anchor * cd->ns_per_sample;
+		const double error_ns = elapsed_ns - predicted_ns;
+		if (obs_timestamp_ns < cd->anchor_obs_ns || fabs(error_ns) > CLOCK_DOMAIN_JUMP_NS) {
+			obs_log(LOG_INFO, "audio timestamp discontinuity of %.1f ms, re-anchoring",
+				error_ns / 1e6);
+			cd->discontinuities++;
+			clock_domain_anchor(cd, obs_timestamp_ns);
+		} else if (cd->samples_since_anchor >=
+			   (uint64_t)cd->sample_rate * CLOCK_DOMAIN_MIN_LEARN_SEC) {
+			// over a long baseline the timestamp jitter is small next to the drift
+			const double observed = elapsed_ns / (double)cd->samples_since_anchor;
+			const double smoothed =
+				cd->ns_per_sample +
+				(observed - cd->ns_per_sample) * CLOCK_DOMAIN_RATE_SMOOTHING;
+			cd->ns_per_sample =
+				std::clamp(smoothed,
+					   nominal_ns_per_sample * (1.0 - CLOCK_DOMAIN_MAX_DRIFT),
+					   nominal_ns_per_sample * (1.0 + CLOCK_DOMAIN_MAX_DRIFT));
+			cd->rate_ratio = cd->ns_per_sample / nominal_ns_per_sample;
+		}
+	}
+
+	const uint64_t timestamp_ns =
+		cd->anchor_ns +
+		(uint64_t)llround((double)cd->samples_since_anchor * cd->ns_per_sample);
+	cd->samples_since_anchor += frames;
+	cd->end_ns = cd->anchor_ns +
+		     (uint64_t)llround((double)cd->samples_since_anchor * cd->ns_per_sample);
+	cd->offset_ns = (int64_t)(timestamp_ns - obs_timestamp_ns);
+	return timestamp_ns;
+}
+
+uint64_t clock_domain_duration_ns(const struct clock_domain *cd, uint64_t frames,
+				  uint32_t sample_rate)
+{
+	if (sample_rate == 0) {
+		return 0;
+	}
+	return (uint64_t)llround((double)frames * 1e9 / sample_rate * cd->rate_ratio.load());
+}
+
+uint64_t clock_domain_now(const struct clock_domain *cd)
+{
+	// OBS timestamps are on the os_gettime_ns clock, the timeline differs by the offset
+	return (uint64_t)((int64_t)os_gettime_ns() + cd->offset_ns.load());
+}
@@ -0,0 +1,42 @@
+#ifndef CLOCK_DOMAIN_H
+#define CLOCK_DOMAIN_H
+
+#include <atomic>
+#include <cstdint>
+
+// Caption timeline of one filter. OBS audio timestamps follow the os_gettime_ns clock, but
+// per-packet timestamps jitter, jump when a source restarts or resyncs, and the sample clock
+// of the device drifts from the nominal rate over hours. The clock domain counts samples since
+// an anchor packet, learns the real duration of a sample from the OBS timestamps, and gives
+// every packet a timestamp that is smooth, monotonic and stays locked to the OBS timeline.
+// Recording subtitles, the session archive and the live captions all read this timeline.
+struct clock_domain {
+	uint32_t sample_rate = 0;
+	bool anchored = false;
+	// OBS timestamp and corrected timestamp of the anchor packet
+	uint64_t anchor_obs_ns = 0;
+	uint64_t anchor_ns = 0;
+	uint64_t samples_since_anchor = 0;
+	// learned duration of one sample
+	double ns_per_sample = 0.0;
+	// corrected timestamp right after the last packet, the timeline never goes back past it
+	uint64_t end_ns = 0;
+	uint64_t discontinuities = 0;
+	// Written by the audio thread, read by the whisper and UI threads
+	// corrected minus OBS timestamp of the last packet
+	std::atomic<int64_t> offset_ns{0};
+	// real over nominal sample duration
+	std::atomic<double> rate_ratio{1.0};
+};
+
+void clock_domain_reset(struct clock_domain *cd, uint32_t sample_rate);
+// Place an audio packet of frames samples with OBS timestamp obs_timestamp_ns on the timeline,
+// returns the corrected timestamp of its first sample. Called from the audio thread only.
+uint64_t clock_domain_push(struct clock_domain *cd, uint64_t obs_timestamp_ns, uint32_t frames);
+// Duration in ns of frames samples at sample_rate, corrected for the drift of the input clock
+uint64_t clock_domain_duration_ns(const struct clock_domain *cd, uint64_t frames,
+				  uint32_t sample_rate);
+// Current time on the timeline, for sinks that start on a UI event rather than on audio
+uint64_t clock_domain_now(const struct clock_domain *cd);
+
+#endif // CLOCK_DOMAIN_H
@@ -0,0 +1,229 @@
+#include "ingest-kernels.h"
+#include "channel-mixer.h"
+
+#include <whisper.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INGEST_KERNELS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define INGEST_KERNELS_NEON
+#endif
+
+// Channel count known at compile time, or 0 for the count given at run time
+template<size_t Channels> static inline size_t channel_count(size_t channels)
+{
+	return Channels > 0 ? Channels : channels;
+}
+
+static float abs_max(const float *src, size_t n, float peak)
+{
+	size_t i = 0;
+#if defined(INGEST_KERNELS_SSE2)
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 acc = _mm_set1_ps(peak);
+	for (; i + 4 <= n; i += 4) {
+		acc = _mm_max_ps(acc, _mm_and_ps(_mm_loadu_ps(src + i), abs_mask));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(INGEST_KERNELS_NEON)
+	float32x4_t acc = vdupq_n_f32(peak);
+	for (; i + 4 <= n; i += 4) {
+		acc = vmaxq_f32(acc, vabsq_f32(vld1q_f32(src + i)));
+	}
+	float lanes[4];
+	vst1q_f32(lanes, acc);
+	peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+	for (; i < n; i++) {
+		peak = std::max(peak, fabsf(src[i]));
+	}
+	return peak;
+}
+
+template<size_t Channels>
+static float push_kernel(struct circlebuf *buffers, size_t channels, const uint8_t *const *data,
+			 uint32_t frames)
+{
+	const size_t n = channel_count<Channels>(channels);
+	float peak = 0.0f;
+	for (size_t c = 0; c < n; c++) {
+		const float *samples = (const float *)data[c];
+		peak = abs_max(samples, frames, peak);
+		circlebuf_push_back(&buffers[c], samples, frames * sizeof(float));
+	}
+	return peak;
+}
+
+template<size_t Channels>
+static void pop_kernel(struct circlebuf *buffers, size_t channels, float *const *copy_buffers,
+		       size_t frames)
+{
+	const size_t n = channel_count<Channels>(channels);
+	for (size_t c = 0; c < n; c++) {
+		circlebuf_pop_front(&buffers[c], copy_buffers[c], frames * sizeof(float));
+	}
+}
+
+template<size_t Channels>
+static void drop_kernel(struct circlebuf *buffers, size_t channels, size_t frames)
+{
+	const size_t n = channel_count<Channels>(channels);
+	for (size_t c = 0; c < n; c++) {
+		circlebuf_pop_front(&buffers[c], nullptr, frames * sizeof(float));
+	}
+}
+
+static void downmix_mono(const struct channel_mixer *, const float *const *data, size_t frames,
+			 float *mono)
+{
+	memcpy(mono, data[0], frames * sizeof(float));
+}
+
+static void downmix_stereo(const struct channel_mixer *mixer, const float *const *data,
+			   size_t frames, float *mono)
+{
+	const float w0 = mixer->weights[0];
+	const float w1 = mixer->weights[1];
+	const float *left = data[0];
+	const float *right = data[1];
+	for (size_t i = 0; i < frames; i++) {
+		mono[i] = left[i] * w0 + right[i] * w1;
+	}
+}
+
+// Windowed-sinc low-pass below the 8 kHz Nyquist frequency of the output
+template<size_t Factor> static const float *decimator_taps()
+{
+	static const std::vector<float> taps = [] {
+		const size_t n = Factor * INGEST_DECIMATOR_TAPS_PER_FACTOR + 1;
+		// leave a transition band below the output Nyquist frequency
+		const double cutoff = 0.45 / Factor;
+		std::vector<float> h(n);
+		double sum = 0.0;
+		for (size_t k = 0; k < n; k++) {
+			const double m = (double)k - (double)(n - 1) / 2.0;
+			const double sinc = m == 0.0 ? 2.0 * cutoff
+						     : sin(2.0 * M_PI * cutoff * m) / (M_PI * m);
+			const double x = (double)k / (double)(n - 1);
+			const double window = 0.42 - 0.5 * cos(2.0 * M_PI * x) +
+					      0.08 * cos(4.0 * M_PI * x);
+			h[k] = (float)(sinc * window);
+			sum += h[k];
+		}
+		// unity gain at DC
+		for (float &tap : h) {
+			tap = (float)(tap / sum);
+		}
+		return h;
+	}();
+	return taps.data();
+}
+
+// Low-pass and keep every Factor-th sample. The filter ends at the output sample and reaches
+// back into the previous chunks through the state, and the output spacing continues across
+// chunks, so no input sample is dropped or filtered against padding.
+template<size_t Factor>
+static size_t decimate_kernel(struct decimator_state *state, const float *mono, size_t frames,
+			      float *out)
+{
+	const size_t n_taps = Factor * INGEST_DECIMATOR_TAPS_PER_FACTOR + 1;
+	const size_t n_history = n_taps - 1;
+	static_assert(Factor * INGEST_DECIMATOR_TAPS_PER_FACTOR <= INGEST_DECIMATOR_MAX_HISTORY,
+		      "decimator history too short");
+	const float *taps = decimator_taps<Factor>();
+	size_t out_frames = 0;
+	size_t t = state->phase;
+	for (; t < frames && t < n_history; t += Factor) {
+		float acc = 0.0f;
+		for (size_t k = 0; k < n_taps; k++) {
+			const size_t i = t + k;
+			acc += taps[k] *
+			       (i < n_history ? state->history[i] : mono[i - n_history]);
+		}
+		out[out_frames++] = acc;
+	}
+	for (; t < frames; t += Factor) {
+		const float *x = mono + t - n_history;
+		float acc = 0.0f;
+		for (size_t k = 0; k < n_taps; k++) {
+			acc += taps[k] * x[k];
+		}
+		out[out_frames++] = acc;
+	}
+	state->phase = t - frames;
+
+	if (frames >= n_history) {
+		memcpy(state->history, mono + frames - n_history, n_history * sizeof(float));
+	} else {
+		memmove(state->history, state->history + frames,
+			(n_history - frames) * sizeof(float));
+		memcpy(state->history + n_history - frames, mono, frames * sizeof(float));
+	}
+	return out_frames;
+}
+
+// Silence below the ingest threshold is taken as zeros
+template<size_t Factor> static size_t decimate_skip_kernel(struct decimator_state *state,
+							   size_t frames)
+{
+	const size_t out_frames =
+		state->phase < frames ? (frames - state->phase + Factor - 1) / Factor : 0;
+	state->phase = state->phase + out_frames * Factor - frames;
+	memset(state->history, 0, sizeof(state->history));
+	return out_frames;
+}
+
+template<size_t Channels>
+static void select_channel_kernels(struct ingest_kernels *kernels)
+{
+	kernels->push = push_kernel<Channels>;
+	kernels->pop = pop_kernel<Channels>;
+	kernels->drop = drop_kernel<Channels>;
+}
+
+void ingest_kernels_select(struct ingest_kernels *kernels, size_t channels, uint32_t sample_rate)
+{
+	if (channels == 1) {
+		select_channel_kernels<1>(kernels);
+		kernels->name = "mono";
+		kernels->downmix = downmix_mono;
+	} else if (channels == 2) {
+		select_channel_kernels<2>(kernels);
+		kernels->name = "stereo";
+		kernels->downmix = downmix_stereo;
+	} else {
+		select_channel_kernels<0>(kernels);
+		kernels->name = "generic";
+		kernels->downmix = channel_mixer_downmix;
+	}
+
+	// 44.1 kHz has no integer ratio to 16 kHz and keeps the OBS resampler
+	if (sample_rate == WHISPER_SAMPLE_RATE * 3) {
+		kernels->resample = decimate_kernel<3>;
+		kernels->skip = decimate_skip_kernel<3>;
+	} else if (sample_rate == WHISPER_SAMPLE_RATE * 2) {
+		kernels->resample = decimate_kernel<2>;
+		kernels->skip = decimate_skip_kernel<2>;
+	} else {
+		kernels->resample = nullptr;
+		kernels->skip = nullptr;
+	}
+}
+
+size_t ingest_kernels_resample_frames(uint32_t sample_rate, size_t frames)
+{
+	if (sample_rate == 0 || sample_rate % WHISPER_SAMPLE_RATE != 0) {
+		return 0;
+	}
+	// the phase carried from the previous chunk can fit one more output sample in
+	return frames / (sample_rate / WHISPER_SAMPLE_RATE) + 1;
+}
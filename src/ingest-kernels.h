@@ -0,0 +1,54 @@
+#ifndef INGEST_KERNELS_H
+#define INGEST_KERNELS_H
+
+#include <util/circlebuf.h>
+
+#include <cstddef>
+#include <cstdint>
+
+struct channel_mixer;
+
+// taps of the anti-aliasing filter per output sample
+#define INGEST_DECIMATOR_TAPS_PER_FACTOR 16
+// decimation by up to 3 (48 kHz)
+#define INGEST_DECIMATOR_MAX_HISTORY (3 * INGEST_DECIMATOR_TAPS_PER_FACTOR)
+
+// Filter state carried from one chunk to the next, so the chunks are decimated as one stream.
+// All zero at the start of the stream.
+struct decimator_state {
+	// the last input samples of the previous chunks, oldest first
+	float history[INGEST_DECIMATOR_MAX_HISTORY];
+	// input index in the next chunk of its first output sample
+	size_t phase;
+};
+
+// Ingest and downmix/resample routines of the filter, specialized for the channel count and
+// sample rate of the OBS audio output. They are picked once when the filter is created, so the
+// per-packet path runs fixed-count loops without checking the layout again.
+struct ingest_kernels {
+	const char *name;
+	// Append a packet of planar audio to the input buffers, returns its largest absolute sample
+	float (*push)(struct circlebuf *buffers, size_t channels, const uint8_t *const *data,
+		      uint32_t frames);
+	// Move frames from the front of the input buffers to the copy buffers
+	void (*pop)(struct circlebuf *buffers, size_t channels, float *const *copy_buffers,
+		    size_t frames);
+	// Drop frames from the front of the input buffers
+	void (*drop)(struct circlebuf *buffers, size_t channels, size_t frames);
+	// Mix the planar window down to mono with the weights of the channel mixer
+	void (*downmix)(const struct channel_mixer *mixer, const float *const *data, size_t frames,
+			float *mono);
+	// Resample mono audio to 16 kHz, returns the number of output frames. nullptr if the rate
+	// has no integer ratio to 16 kHz and the OBS resampler is used instead.
+	size_t (*resample)(struct decimator_state *state, const float *mono, size_t frames,
+			   float *out);
+	// Advance the decimator over frames of silence that are not resampled, returns the number
+	// of output frames they stand for. Set along with resample.
+	size_t (*skip)(struct decimator_state *state, size_t frames);
+};
+
+void ingest_kernels_select(struct ingest_kernels *kernels, size_t channels, uint32_t sample_rate);
+// Largest number of output frames of kernels->resample for frames input frames
+size_t ingest_kernels_resample_frames(uint32_t sample_rate, size_t frames);
+
+#endif // INGEST_KERNELS_H
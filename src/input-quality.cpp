@@ -0,0 +1,139 @@
+#include "input-quality.h"
+
+#include <obs-module.h>
+
+#include "plugin-support.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define INPUT_QUALITY_FRAME_MSEC 20
+// samples at or above this magnitude count as clipped
+#define INPUT_QUALITY_CLIP_LEVEL 0.99f
+// quantiles of the frame levels taken as the noise floor and as the speech level
+#define INPUT_QUALITY_NOISE_QUANTILE 0.1f
+#define INPUT_QUALITY_SIGNAL_QUANTILE 0.9f
+#define INPUT_QUALITY_MIN_RMS 1e-5f
+// weight of the newest window in the averages
+#define INPUT_QUALITY_SMOOTHING 0.2f
+// a few windows are needed before the averages mean anything
+#define INPUT_QUALITY_MIN_SPEECH_WINDOWS 3
+#define INPUT_QUALITY_MAX_CLIPPING 0.002f
+#define INPUT_QUALITY_MIN_SPEECH_DBFS -50.0f
+#define INPUT_QUALITY_MIN_SNR_DB 10.0f
+// speech has to be this much (6 dB) louder than the noise floor to pass VAD, the floor is
+// taken from the quietest frames and the average noise frame is louder
+#define INPUT_QUALITY_VAD_NOISE_MARGIN 2.0f
+// mean absolute amplitude of Gaussian noise relative to its RMS
+#define INPUT_QUALITY_MEAN_ABS_PER_RMS 0.8f
+
+static float to_dbfs(float rms)
+{
+	return 20.0f * log10f(std::max(rms, INPUT_QUALITY_MIN_RMS));
+}
+
+void input_quality_measure(const float *pcm, size_t n_samples, uint32_t sample_rate,
+			   struct input_quality *quality)
+{
+	*quality = input_quality();
+	if (n_samples == 0) {
+		return;
+	}
+	const size_t frame = std::max<size_t>(1, sample_rate * INPUT_QUALITY_FRAME_MSEC / 1000);
+	std::vector<float> frame_rms;
+	frame_rms.reserve(n_samples / frame + 1);
+	size_t clipped = 0;
+	double total = 0.0;
+	for (size_t start = 0; start < n_samples; start += frame) {
+		const size_t end = std::min(n_samples, start + frame);
+		double energy = 0.0;
+		for (size_t i = start; i < end; i++) {
+			energy += (double)pcm[i] * pcm[i];
+			clipped += fabsf(pcm[i]) >= INPUT_QUALITY_CLIP_LEVEL ? 1 : 0;
+		}
+		total += energy;
+		frame_rms.push_back((float)sqrt(energy / (double)(end - start)));
+	}
+
+	quality->clipping_ratio = (float)clipped / (float)n_samples;
+	quality->rms_dbfs = to_dbfs((float)sqrt(total / (double)n_samples));
+	const size_t noise_index = (size_t)((float)(frame_rms.size() - 1) *
+					    INPUT_QUALITY_NOISE_QUANTILE);
+	const size_t signal_index = (size_t)((float)(frame_rms.size() - 1) *
+					     INPUT_QUALITY_SIGNAL_QUANTILE);
+	std::nth_element(frame_rms.begin(), frame_rms.begin() + noise_index, frame_rms.end());
+	const float noise = frame_rms[noise_index];
+	std::nth_element(frame_rms.begin(), frame_rms.begin() + signal_index, frame_rms.end());
+	const float signal = frame_rms[signal_index];
+	quality->noise_rms = noise;
+	quality->snr_db = to_dbfs(signal) - to_dbfs(noise);
+}
+
+static float smooth(float average, float value, bool first)
+{
+	return first ? value : average + INPUT_QUALITY_SMOOTHING * (value - average);
+}
+
+void input_quality_monitor_add_window(struct input_quality_monitor *monitor,
+				      const struct input_quality &quality)
+{
+	// the floor drops at once, a single loud window only raises it a little
+	monitor->noise_rms = std::min(quality.noise_rms,
+				      smooth(monitor->noise_rms, quality.noise_rms,
+					     monitor->noise_rms <= 0.0f));
+}
+
+void input_quality_monitor_add_speech(struct input_quality_monitor *monitor,
+				      const struct input_quality &quality)
+{
+	const bool first = monitor->n_speech_windows == 0;
+	monitor->clipping_ratio = smooth(monitor->clipping_ratio, quality.clipping_ratio, first);
+	monitor->speech_dbfs = smooth(monitor->speech_dbfs, quality.rms_dbfs, first);
+	monitor->snr_db = smooth(monitor->snr_db, quality.snr_db, first);
+	monitor->n_speech_windows++;
+	if (monitor->n_speech_windows < INPUT_QUALITY_MIN_SPEECH_WINDOWS) {
+		return;
+	}
+
+	InputQualityIssue issue = INPUT_QUALITY_OK;
+	if (monitor->clipping_ratio > INPUT_QUALITY_MAX_CLIPPING) {
+		issue = INPUT_QUALITY_CLIPPING;
+	} else if (monitor->speech_dbfs < INPUT_QUALITY_MIN_SPEECH_DBFS) {
+		issue = INPUT_QUALITY_TOO_QUIET;
+	} else if (monitor->snr_db < INPUT_QUALITY_MIN_SNR_DB) {
+		issue = INPUT_QUALITY_NOISY;
+	}
+	if (issue != monitor->issue) {
+		if (issue == INPUT_QUALITY_OK) {
+			obs_log(LOG_INFO, "input quality recovered");
+		} else {
+			obs_log(LOG_WARNING,
+				"poor input (%s): %.2f%% clipped, %.1f dBFS, %.1f dB SNR, "
+				"check the microphone gain and placement",
+				input_quality_issue_name(issue), monitor->clipping_ratio * 100.0f,
+				monitor->speech_dbfs, monitor->snr_db);
+		}
+	}
+	monitor->issue = issue;
+}
+
+float input_quality_vad_thold(const struct input_quality_monitor *monitor, float base_thold)
+{
+	return std::max(base_thold, monitor->noise_rms * INPUT_QUALITY_MEAN_ABS_PER_RMS *
+					    INPUT_QUALITY_VAD_NOISE_MARGIN);
+}
+
+const char *input_quality_issue_name(InputQualityIssue issue)
+{
+	switch (issue) {
+	case INPUT_QUALITY_CLIPPING:
+		return "clipping";
+	case INPUT_QUALITY_TOO_QUIET:
+		return "too quiet";
+	case INPUT_QUALITY_NOISY:
+		return "noisy";
+	default:
+		return "ok";
+	}
+}
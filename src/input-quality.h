@@ -0,0 +1,51 @@
+#ifndef INPUT_QUALITY_H
+#define INPUT_QUALITY_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Level, clipping and noise of one window of audio
+struct input_quality {
+	// share of the samples at full scale
+	float clipping_ratio = 0.0f;
+	// level of the whole window in dBFS
+	float rms_dbfs = -100.0f;
+	// level of the loud frames over the quiet frames in dB
+	float snr_db = 0.0f;
+	// RMS of the quiet frames, the noise floor
+	float noise_rms = 0.0f;
+};
+
+void input_quality_measure(const float *pcm, size_t n_samples, uint32_t sample_rate,
+			   struct input_quality *quality);
+
+enum InputQualityIssue {
+	INPUT_QUALITY_OK,
+	INPUT_QUALITY_CLIPPING,
+	INPUT_QUALITY_TOO_QUIET,
+	INPUT_QUALITY_NOISY,
+};
+
+// Input quality averaged over recent windows. The noise floor follows every window and raises
+// the VAD threshold in noisy rooms, the other measures follow the windows that reach whisper
+// and flag input that costs a full decode for little text. Owned by the inference stage.
+struct input_quality_monitor {
+	float noise_rms = 0.0f;
+	float clipping_ratio = 0.0f;
+	float speech_dbfs = -100.0f;
+	float snr_db = 0.0f;
+	int n_speech_windows = 0;
+	InputQualityIssue issue = INPUT_QUALITY_OK;
+};
+
+// Follow the noise floor with a window, speech or not, measured on the signal the VAD sees
+void input_quality_monitor_add_window(struct input_quality_monitor *monitor,
+				      const struct input_quality &quality);
+// Follow the speech measures with a window that passed VAD, logs when the issue changes
+void input_quality_monitor_add_speech(struct input_quality_monitor *monitor,
+				      const struct input_quality &quality);
+// VAD threshold (mean absolute amplitude) at least base_thold and above the noise floor
+float input_quality_vad_thold(const struct input_quality_monitor *monitor, float base_thold);
+const char *input_quality_issue_name(InputQualityIssue issue);
+
+#endif // INPUT_QUALITY_H
@@ -0,0 +1,176 @@
+#include "language-router.h"
+#include "plugin-support.h"
+#include "model-utils/model-registry.h"
+
+#include <obs-module.h>
+
+#include <sstream>
+
+// A pause longer than this starts a new utterance, which is detected again
+#define LANGUAGE_ROUTER_UTTERANCE_GAP_NS 1000000000ULL
+
+static std::string trim(const std::string &s)
+{
+	const size_t first = s.find_first_not_of(" \t");
+	if (first == std::string::npos) {
+		return "";
+	}
+	const size_t last = s.find_last_not_of(" \t");
+	return s.substr(first, last - first + 1);
+}
+
+static void release_routes(std::vector<language_route> &routes)
+{
+	for (language_route &route : routes) {
+		model_registry_release(route.ctx);
+	}
+	routes.clear();
+}
+
+void language_router_clear(struct language_router *router)
+{
+	release_routes(router->routes);
+	router->spec.clear();
+	router->requested_spec.clear();
+	router->detected_language.clear();
+	router->last_end_timestamp_ns = 0;
+}
+
+// Load the models of spec, this takes seconds for larger models
+static std::vector<language_route> load_routes(const std::string &spec)
+{
+	std::vector<language_route> routes;
+	std::stringstream entries(spec);
+	std::string entry;
+	while (std::getline(entries, entry, ',')) {
+		const size_t equals = entry.find('=');
+		if (equals == std::string::npos) {
+			continue;
+		}
+		language_route route;
+		route.language = trim(entry.substr(0, equals));
+		route.model_path = trim(entry.substr(equals + 1));
+		if (whisper_lang_id(route.language.c_str()) < 0) {
+			obs_log(LOG_WARNING, "language routing: unknown language '%s'",
+				route.language.c_str());
+			continue;
+		}
+		char *model_file_path = obs_module_file(route.model_path.c_str());
+		if (model_file_path == nullptr) {
+			obs_log(LOG_WARNING, "language routing: model %s not found",
+				route.model_path.c_str());
+			continue;
+		}
+		route.ctx = model_registry_acquire(model_file_path);
+		bfree(model_file_path);
+		if (route.ctx == nullptr) {
+			continue;
+		}
+		obs_log(LOG_INFO, "language routing: %s -> %s", route.language.c_str(),
+			route.model_path.c_str());
+		routes.push_back(route);
+	}
+	return routes;
+}
+
+static void language_router_load(struct language_router *router, std::mutex *ctx_mutex)
+{
+	std::string spec;
+	{
+		std::lock_guard<std::mutex> lock(*ctx_mutex);
+		spec = router->requested_spec;
+	}
+	bool done = false;
+	while (!done) {
+		std::vector<language_route> routes = load_routes(spec);
+		{
+			std::lock_guard<std::mutex> lock(*ctx_mutex);
+			if (router->requested_spec != spec) {
+				// changed again while loading, load the newer spec
+				spec = router->requested_spec;
+			} else {
+				routes.swap(router->routes);
+				router->spec = spec;
+				router->detected_language.clear();
+				router->loading = false;
+				done = true;
+			}
+		}
+		// the replaced or outdated routes, released without holding the lock
+		release_routes(routes);
+	}
+}
+
+void language_router_configure(struct language_router *router, const std::string &spec,
+			       std::mutex *ctx_mutex)
+{
+	std::thread finished_thread;
+	{
+		std::lock_guard<std::mutex> lock(*ctx_mutex);
+		if (spec == router->requested_spec) {
+			return;
+		}
+		router->requested_spec = spec;
+		if (router->loading) {
+			// the running load picks up the new spec
+			return;
+		}
+		router->loading = true;
+		finished_thread.swap(router->load_thread);
+		router->load_thread = std::thread(language_router_load, router, ctx_mutex);
+	}
+	// the previous load has already swapped its routes in
+	if (finished_thread.joinable()) {
+		finished_thread.join();
+	}
+}
+
+void language_router_wait(struct language_router *router)
+{
+	if (router->load_thread.joinable()) {
+		router->load_thread.join();
+	}
+}
+
+bool language_router_enabled(const struct language_router *router)
+{
+	return !router->routes.empty();
+}
+
+const struct language_route *language_router_select(struct language_router *router,
+						    struct whisper_context *ctx,
+						    struct whisper_state *state,
+						    const float *pcm16k, size_t n_samples,
+						    uint64_t start_timestamp_ns, int n_threads,
+						    std::string &language)
+{
+	const bool new_utterance = router->detected_language.empty() ||
+				   start_timestamp_ns >
+					   router->last_end_timestamp_ns +
+						   LANGUAGE_ROUTER_UTTERANCE_GAP_NS;
+	router->last_end_timestamp_ns =
+		start_timestamp_ns + (uint64_t)n_samples * 1000000000 / WHISPER_SAMPLE_RATE;
+
+	if (new_utterance) {
+		// one encoder pass and a single decoder step on the first window only
+		router->detected_language.clear();
+		if (whisper_pcm_to_mel_with_state(ctx, state, pcm16k, (int)n_samples, n_threads) ==
+		    0) {
+			const int lang_id = whisper_lang_auto_detect_with_state(ctx, state, 0,
+										n_threads, nullptr);
+			if (lang_id >= 0) {
+				router->detected_language = whisper_lang_str(lang_id);
+				obs_log(LOG_INFO, "language routing: detected '%s'",
+					router->detected_language.c_str());
+			}
+		}
+	}
+
+	language = router->detected_language;
+	for (const language_route &route : router->routes) {
+		if (route.language == language) {
+			return &route;
+		}
+	}
+	return nullptr;
+}
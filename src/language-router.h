@@ -0,0 +1,58 @@
+#ifndef LANGUAGE_ROUTER_H
+#define LANGUAGE_ROUTER_H
+
+#include <whisper.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A model dedicated to one language, e.g. an English-only .en model for "en"
+struct language_route {
+	std::string language;
+	std::string model_path;
+	// decoded with a state borrowed from the model registry
+	struct whisper_context *ctx = nullptr;
+};
+
+// With the "auto" language, detects the spoken language on the first window of each
+// utterance and dispatches the utterance to the configured model for that language.
+// Languages without a route use the filter's own (multilingual) model.
+struct language_router {
+	// "en=models/ggml-tiny.en.bin, de=models/ggml-base.bin", the spec of routes
+	std::string spec;
+	std::vector<language_route> routes;
+	// the route models are loaded on load_thread and swapped in under the context mutex,
+	// which also guards requested_spec and loading
+	std::string requested_spec;
+	bool loading = false;
+	std::thread load_thread;
+	// language of the current utterance, kept until the next pause in speech
+	std::string detected_language;
+	uint64_t last_end_timestamp_ns = 0;
+};
+
+// Parse spec and load the route models through the model registry on a background thread,
+// which swaps them in under ctx_mutex. Call without holding ctx_mutex. No-op if spec is
+// unchanged, the current routes stay in use until the new ones are loaded.
+void language_router_configure(struct language_router *router, const std::string &spec,
+			       std::mutex *ctx_mutex);
+// Wait for a running load, call without holding the context mutex
+void language_router_wait(struct language_router *router);
+// Release the routes, call with the context mutex held
+void language_router_clear(struct language_router *router);
+bool language_router_enabled(const struct language_router *router);
+
+// Pick the model for a speech window. ctx/state is the multilingual model used for detection.
+// Returns the route to decode with, or nullptr for the filter's own model. language is set
+// to the detected language (empty if detection failed).
+const struct language_route *language_router_select(struct language_router *router,
+						    struct whisper_context *ctx,
+						    struct whisper_state *state,
+						    const float *pcm16k, size_t n_samples,
+						    uint64_t start_timestamp_ns, int n_threads,
+						    std::string &language);
+
+#endif // LANGUAGE_ROUTER_H
@@ -0,0 +1,99 @@
+#include "logits-filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static void logits_filter_chain_callback(struct whisper_context *ctx, struct whisper_state *state,
+					 const whisper_token_data *tokens, int n_tokens,
+					 float *logits, void *user_data)
+{
+	struct logits_filter_chain *chain = static_cast<struct logits_filter_chain *>(user_data);
+	for (const logits_filter &filter : chain->filters) {
+		filter(ctx, state, tokens, n_tokens, logits);
+	}
+}
+
+void logits_filter_chain_install(struct logits_filter_chain *chain, whisper_full_params &params)
+{
+	if (chain->filters.empty()) {
+		params.logits_filter_callback = nullptr;
+		params.logits_filter_callback_user_data = nullptr;
+		return;
+	}
+	params.logits_filter_callback = logits_filter_chain_callback;
+	params.logits_filter_callback_user_data = chain;
+}
+
+bool no_speech_check_init(struct no_speech_check *check, const whisper_full_params &params)
+{
+	check->threshold = params.no_speech_thold;
+	check->has_prompt = (params.prompt_tokens != nullptr && params.prompt_n_tokens > 0) ||
+			    (params.initial_prompt != nullptr && params.initial_prompt[0] != '\0');
+	check->n_threads = params.n_threads;
+	check->checked = false;
+	check->no_speech = false;
+	check->no_speech_prob = 0.0f;
+	// with context carried over, whether the prompt starts with <|startofprev|> depends on
+	// the previous window, so the start-of-transcript position is unknown
+	return check->threshold > 0.0f && check->threshold < 1.0f && params.no_context;
+}
+
+// Probability of <|nospeech|> at the start-of-transcript position
+static bool compute_no_speech_prob(struct no_speech_check *check, struct whisper_context *ctx,
+				   struct whisper_state *state)
+{
+	const int n_vocab = whisper_n_vocab(ctx);
+	float *state_logits = whisper_get_logits_from_state(state);
+	// the other decoders still read the prompt logits at this step, keep them
+	std::vector<float> saved(state_logits, state_logits + n_vocab);
+
+	// position 0 only attends to itself, so decoding it again leaves the cache as it was
+	// when it holds <|startoftranscript|>, and restoring <|startofprev|> undoes the change
+	const whisper_token sot = whisper_token_sot(ctx);
+	bool ok = whisper_decode_with_state(ctx, state, &sot, 1, 0, check->n_threads) == 0;
+	if (ok) {
+		const float *sot_logits = whisper_get_logits_from_state(state);
+		const float max_logit = *std::max_element(sot_logits, sot_logits + n_vocab);
+		double sum = 0.0;
+		for (int i = 0; i < n_vocab; i++) {
+			sum += exp((double)(sot_logits[i] - max_logit));
+		}
+		const whisper_token nosp = whisper_token_nosp(ctx);
+		check->no_speech_prob = (float)(exp((double)(sot_logits[nosp] - max_logit)) / sum);
+	}
+	if (check->has_prompt) {
+		const whisper_token prev = whisper_token_prev(ctx);
+		ok = whisper_decode_with_state(ctx, state, &prev, 1, 0, check->n_threads) == 0 &&
+		     ok;
+	}
+	memcpy(whisper_get_logits_from_state(state), saved.data(), n_vocab * sizeof(float));
+	return ok;
+}
+
+void logits_filter_chain_add_no_speech_check(struct logits_filter_chain *chain,
+					     struct no_speech_check *check)
+{
+	chain->filters.push_back([check](struct whisper_context *ctx, struct whisper_state *state,
+					 const whisper_token_data *, int n_tokens, float *logits) {
+		if (n_tokens > 0) {
+			return;
+		}
+		// the first step runs once per decoder and again on temperature fallback
+		if (!check->checked) {
+			check->checked = true;
+			check->no_speech = compute_no_speech_prob(check, ctx, state) &&
+					   check->no_speech_prob > check->threshold;
+		}
+		if (check->no_speech) {
+			// end the segment right away
+			const whisper_token eot = whisper_token_eot(ctx);
+			const int n_vocab = whisper_n_vocab(ctx);
+			for (int i = 0; i < n_vocab; i++) {
+				if (i != eot) {
+					logits[i] = -INFINITY;
+				}
+			}
+		}
+	});
+}
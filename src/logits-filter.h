@@ -0,0 +1,41 @@
+#ifndef LOGITS_FILTER_H
+#define LOGITS_FILTER_H
+
+#include <whisper.h>
+
+#include <functional>
+#include <vector>
+
+// whisper_full accepts a single logits filter callback, the chain runs several in order
+typedef std::function<void(struct whisper_context *ctx, struct whisper_state *state,
+			   const whisper_token_data *tokens, int n_tokens, float *logits)>
+	logits_filter;
+
+struct logits_filter_chain {
+	std::vector<logits_filter> filters;
+};
+
+// Point params at the chain, which must outlive the whisper_full call
+void logits_filter_chain_install(struct logits_filter_chain *chain, whisper_full_params &params);
+
+// Stops decoding of windows without speech after the first decoder step. Whisper computes the
+// probability of the <|nospeech|> token at the start-of-transcript position, the check decodes
+// that position once more to read it and forces end-of-text above params.no_speech_thold.
+struct no_speech_check {
+	float threshold = 1.0f;
+	// the prompt starts with <|startofprev|> and a text prompt instead of <|startoftranscript|>
+	bool has_prompt = false;
+	int n_threads = 1;
+	// result of the last whisper_full call
+	bool checked = false;
+	bool no_speech = false;
+	float no_speech_prob = 0.0f;
+};
+
+// Prepare the check for a whisper_full call with params, returns false if it cannot run
+// (disabled, or a prompt from an earlier window with an unknown layout)
+bool no_speech_check_init(struct no_speech_check *check, const whisper_full_params &params);
+void logits_filter_chain_add_no_speech_check(struct logits_filter_chain *chain,
+					     struct no_speech_check *check);
+
+#endif // LOGITS_FILTER_H
@@ -0,0 +1,353 @@
+#include "metrics-server.h"
+#include "worker/net-socket.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include "plugin-support.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// how often the server thread checks for shutdown while idle
+#define METRICS_POLL_MSEC 250
+#define METRICS_REQUEST_TIMEOUT_MSEC 1000
+#define METRICS_MAX_REQUEST_BYTES 8192
+
+struct metrics_filter {
+	const struct transcription_stats *stats;
+	std::string name;
+};
+
+struct metrics_counter {
+	const char *name;
+	const char *help;
+	const std::atomic<uint64_t> transcription_stats::*value;
+	// the counters are kept in ms, the metrics are in seconds
+	double scale;
+};
+
+static const metrics_counter metrics_counters[] = {
+	{"localvocal_windows_total", "Audio windows taken from the input buffer",
+	 &transcription_stats::windows, 1.0},
+	{"localvocal_vad_skipped_windows_total", "Windows dropped by VAD before inference",
+	 &transcription_stats::vad_skipped, 1.0},
+	{"localvocal_decoder_skipped_windows_total",
+	 "Inferences stopped after the first decoder step for lack of speech",
+	 &transcription_stats::decoder_skipped, 1.0},
+	{"localvocal_reused_windows_total",
+	 "Windows without new speech that reused the caption of the carried words",
+	 &transcription_stats::reused_windows, 1.0},
+	{"localvocal_inferences_total", "Windows that went through whisper",
+	 &transcription_stats::inferences, 1.0},
+	{"localvocal_segments_total", "Captions sent to the outputs",
+	 &transcription_stats::segments, 1.0},
+	{"localvocal_dropped_windows_total", "Windows lost to a failed inference backend",
+	 &transcription_stats::dropped, 1.0},
+	{"localvocal_model_loads_total", "Whisper models loaded by the filter",
+	 &transcription_stats::model_loads, 1.0},
+	{"localvocal_low_power_windows_total",
+	 "Windows transcribed in the low-power profile on battery or when hot",
+	 &transcription_stats::low_power_windows, 1.0},
+	{"localvocal_poor_input_windows_total",
+	 "Windows decoded cheaply because the input was clipped, faint or noisy",
+	 &transcription_stats::poor_input_windows, 1.0},
+	{"localvocal_inference_seconds_total", "Time spent in inference",
+	 &transcription_stats::inference_time_ms, 0.001},
+	{"localvocal_inference_audio_seconds_total", "Duration of the audio sent to inference",
+	 &transcription_stats::inference_audio_ms, 0.001},
+};
+
+struct metrics_gauge {
+	const char *name;
+	const char *help;
+	const std::atomic<float> transcription_stats::*value;
+};
+
+static const metrics_gauge metrics_gauges[] = {
+	{"localvocal_input_clipping_ratio", "Share of the samples of the last window at full scale",
+	 &transcription_stats::input_clipping_ratio},
+	{"localvocal_input_rms_dbfs", "Level of the last window",
+	 &transcription_stats::input_rms_dbfs},
+	{"localvocal_input_snr_db", "Loud over quiet frames of the last window",
+	 &transcription_stats::input_snr_db},
+};
+
+static const char *const stage_labels[PIPELINE_STAGE_COUNT] = {
+	",stage=\"preprocess\"",
+	",stage=\"inference\"",
+	",stage=\"postprocess\"",
+	",stage=\"sink\"",
+};
+
+// filters are only added and removed under registry_mutex, server start and stop are
+// serialized by server_mutex so a stopping server never holds the port of a starting one
+static std::mutex registry_mutex;
+static std::vector<metrics_filter> registry_filters;
+static std::mutex server_mutex;
+static std::thread server_thread;
+static std::atomic<bool> server_running{false};
+static net_socket server_listener = NET_INVALID_SOCKET;
+static int server_port = 0;
+
+static std::string escape_label(const std::string &value)
+{
+	std::string escaped;
+	for (char ch : value) {
+		if (ch == '\\' || ch == '"') {
+			escaped += '\\';
+			escaped += ch;
+		} else if (ch == '\n') {
+			escaped += "\\n";
+		} else {
+			escaped += ch;
+		}
+	}
+	return escaped;
+}
+
+static void append_header(std::string &out, const char *name, const char *help,
+			  const char *type)
+{
+	out += std::string("# HELP ") + name + " " + help + "\n";
+	out += std::string("# TYPE ") + name + " " + type + "\n";
+}
+
+static void append_sample(std::string &out, const std::string &name, const std::string &labels,
+			  double value)
+{
+	char number[32];
+	snprintf(number, sizeof(number), "%.12g", value);
+	out += name + "{" + labels + "} " + number + "\n";
+}
+
+static void append_histogram(std::string &out, const std::string &name, const std::string &label,
+			     const struct stats_histogram &histogram)
+{
+	// the count is taken from the buckets so that it always matches the +Inf bucket
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < histogram.n_bounds; i++) {
+		cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+		char le[32];
+		snprintf(le, sizeof(le), "%g", histogram.bounds[i]);
+		append_sample(out, name + "_bucket", label + ",le=\"" + le + "\"",
+			      (double)cumulative);
+	}
+	cumulative += histogram.buckets[histogram.n_bounds].load(std::memory_order_relaxed);
+	append_sample(out, name + "_bucket", label + ",le=\"+Inf\"", (double)cumulative);
+	append_sample(out, name + "_sum", label,
+		      (double)histogram.sum_micros.load(std::memory_order_relaxed) / 1e6);
+	append_sample(out, name + "_count", label, (double)cumulative);
+}
+
+static std::string render_metrics()
+{
+	std::string out;
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::vector<std::string> labels;
+	for (const metrics_filter &filter : registry_filters) {
+		labels.push_back("filter=\"" + escape_label(filter.name) + "\"");
+	}
+
+	for (const metrics_counter &counter : metrics_counters) {
+		append_header(out, counter.name, counter.help, "counter");
+		for (size_t i = 0; i < registry_filters.size(); i++) {
+			const struct transcription_stats *stats = registry_filters[i].stats;
+			const uint64_t value = (stats->*counter.value).load();
+			append_sample(out, counter.name, labels[i], (double)value * counter.scale);
+		}
+	}
+
+	append_header(out, "localvocal_backlog_seconds",
+		      "Audio waiting in the input buffer for the pre-processing stage", "gauge");
+	for (size_t i = 0; i < registry_filters.size(); i++) {
+		const uint64_t backlog_ms = registry_filters[i].stats->backlog_ms.load();
+		append_sample(out, "localvocal_backlog_seconds", labels[i],
+			      (double)backlog_ms / 1000.0);
+	}
+
+	for (const metrics_gauge &gauge : metrics_gauges) {
+		append_header(out, gauge.name, gauge.help, "gauge");
+		for (size_t i = 0; i < registry_filters.size(); i++) {
+			const struct transcription_stats *stats = registry_filters[i].stats;
+			const float value = (stats->*gauge.value).load();
+			append_sample(out, gauge.name, labels[i], (double)value);
+		}
+	}
+
+	append_header(out, "localvocal_stage_busy_seconds_total",
+		      "Time each pipeline stage spent on items", "counter");
+	for (size_t i = 0; i < registry_filters.size(); i++) {
+		for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++) {
+			const uint64_t busy_us = registry_filters[i].stats->stage_busy_us[stage];
+			append_sample(out, "localvocal_stage_busy_seconds_total",
+				      labels[i] + stage_labels[stage], (double)busy_us / 1e6);
+		}
+	}
+
+	append_header(out, "localvocal_stage_queue_depth", "Items waiting in front of each stage",
+		      "gauge");
+	for (size_t i = 0; i < registry_filters.size(); i++) {
+		for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++) {
+			const uint64_t depth = registry_filters[i].stats->stage_queue_depth[stage];
+			append_sample(out, "localvocal_stage_queue_depth",
+				      labels[i] + stage_labels[stage], (double)depth);
+		}
+	}
+
+	append_header(out, "localvocal_stage_dropped_total",
+		      "Items a full queue dropped in front of each stage", "counter");
+	for (size_t i = 0; i < registry_filters.size(); i++) {
+		for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++) {
+			const uint64_t dropped = registry_filters[i].stats->stage_dropped[stage];
+			append_sample(out, "localvocal_stage_dropped_total",
+				      labels[i] + stage_labels[stage], (double)dropped);
+		}
+	}
+
+	append_header(out, "localvocal_caption_latency_seconds",
+		      "Delay from the end of a window to its caption", "histogram");
+	for (size_t i = 0; i < registry_filters.size(); i++) {
+		append_histogram(out, "localvocal_caption_latency_seconds", labels[i],
+				 registry_filters[i].stats->latency);
+	}
+
+	append_header(out, "localvocal_real_time_factor",
+		      "Inference time over the duration of the window", "histogram");
+	for (size_t i = 0; i < registry_filters.size(); i++) {
+		append_histogram(out, "localvocal_real_time_factor", labels[i],
+				 registry_filters[i].stats->real_time_factor);
+	}
+
+	append_header(out, "localvocal_process_resident_memory_bytes",
+		      "Resident size of the OBS process", "gauge");
+	char rss[32];
+	snprintf(rss, sizeof(rss), "%llu", (unsigned long long)os_get_proc_resident_size());
+	out += std::string("localvocal_process_resident_memory_bytes ") + rss + "\n";
+	return out;
+}
+
+static void send_response(net_socket client, const char *status, const std::string &body)
+{
+	char header[256];
+	snprintf(header, sizeof(header),
+		 "HTTP/1.1 %s\r\n"
+		 "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+		 "Content-Length: %zu\r\n"
+		 "Connection: close\r\n\r\n",
+		 status, body.size());
+	if (net_send_all(client, header, strlen(header))) {
+		net_send_all(client, body.data(), body.size());
+	}
+}
+
+static void handle_client(net_socket client)
+{
+	std::string request;
+	char chunk[1024];
+	while (request.find("\r\n\r\n") == std::string::npos &&
+	       request.size() < METRICS_MAX_REQUEST_BYTES) {
+		const size_t received =
+			net_recv_some(client, chunk, sizeof(chunk), METRICS_REQUEST_TIMEOUT_MSEC);
+		if (received == 0) {
+			return;
+		}
+		request.append(chunk, received);
+	}
+
+	const std::string line = request.substr(0, request.find("\r\n"));
+	if (line.rfind("GET ", 0) != 0) {
+		send_response(client, "405 Method Not Allowed", "only GET is supported\n");
+		return;
+	}
+	const size_t path_end = line.find(' ', 4);
+	const std::string path = line.substr(4, path_end == std::string::npos ? std::string::npos
+									      : path_end - 4);
+	if (path == "/metrics" || path.rfind("/metrics?", 0) == 0) {
+		send_response(client, "200 OK", render_metrics());
+	} else {
+		send_response(client, "404 Not Found", "metrics are served at /metrics\n");
+	}
+}
+
+static void server_loop(net_socket listener)
+{
+	while (server_running) {
+		if (!net_wait_readable(listener, METRICS_POLL_MSEC)) {
+			continue;
+		}
+		net_socket client = net_accept(listener);
+		if (client == NET_INVALID_SOCKET) {
+			continue;
+		}
+		// scrapes are rare and small, one at a time is enough
+		handle_client(client);
+		net_close(client);
+	}
+}
+
+static void start_server(int port)
+{
+	// loopback only, the endpoint has no authentication
+	server_listener = net_listen("127.0.0.1", port);
+	if (server_listener == NET_INVALID_SOCKET) {
+		obs_log(LOG_ERROR, "metrics: cannot listen on 127.0.0.1:%d", port);
+		return;
+	}
+	server_port = port;
+	server_running = true;
+	server_thread = std::thread(server_loop, server_listener);
+	obs_log(LOG_INFO, "metrics: serving http://127.0.0.1:%d/metrics", port);
+}
+
+static void stop_server()
+{
+	server_running = false;
+	if (server_thread.joinable()) {
+		server_thread.join();
+	}
+	net_close(server_listener);
+	server_listener = NET_INVALID_SOCKET;
+	server_port = 0;
+	obs_log(LOG_INFO, "metrics: server stopped");
+}
+
+void metrics_server_register(const struct transcription_stats *stats, const std::string &name,
+			     int port)
+{
+	std::lock_guard<std::mutex> lock(server_mutex);
+	{
+		std::lock_guard<std::mutex> registry_lock(registry_mutex);
+		registry_filters.push_back({stats, name});
+	}
+	if (!server_running) {
+		start_server(port);
+	} else if (port != server_port) {
+		obs_log(LOG_WARNING, "metrics: '%s' is served on port %d, not %d", name.c_str(),
+			server_port, port);
+	}
+}
+
+void metrics_server_unregister(const struct transcription_stats *stats)
+{
+	std::lock_guard<std::mutex> lock(server_mutex);
+	bool empty = false;
+	{
+		std::lock_guard<std::mutex> registry_lock(registry_mutex);
+		for (auto it = registry_filters.begin(); it != registry_filters.end(); ++it) {
+			if (it->stats == stats) {
+				registry_filters.erase(it);
+				break;
+			}
+		}
+		empty = registry_filters.empty();
+	}
+	// the thread takes registry_mutex to render, it is joined without holding it
+	if (empty && server_running) {
+		stop_server();
+	}
+}
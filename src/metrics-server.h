@@ -0,0 +1,19 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <string>
+
+#include "transcription-stats.h"
+
+#define METRICS_DEFAULT_PORT 9521
+
+// Prometheus text endpoint at http://127.0.0.1:<port>/metrics serving the counters of the
+// registered filters. It only binds to the loopback interface and answers on its own thread,
+// reading the counters without taking any lock of the filters. All filters share one server,
+// started with the first registration on its port and stopped with the last.
+void metrics_server_register(const struct transcription_stats *stats, const std::string &name,
+			     int port);
+// Must be called before stats is freed
+void metrics_server_unregister(const struct transcription_stats *stats);
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,165 @@
+#include "model-registry.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct model_registry_entry {
+	// nullptr while loading
+	struct whisper_context *ctx;
+	int refcount;
+	// states not lent out, and all states of the model including those
+	std::vector<struct whisper_state *> idle_states;
+	int n_states;
+};
+
+// Guards the map only, models are loaded and freed without it so the state leases of other
+// models never wait on a load
+static std::mutex registry_mutex;
+static std::condition_variable state_returned;
+static std::condition_variable model_loaded;
+static std::map<std::string, model_registry_entry> registry_models;
+
+// A decode uses several threads, more states than this would only contend for the cores
+static int max_states_per_model()
+{
+	return std::max(2, (int)std::thread::hardware_concurrency() / 2);
+}
+
+static model_registry_entry *find_entry(struct whisper_context *ctx)
+{
+	if (ctx == nullptr) {
+		return nullptr;
+	}
+	for (auto &entry : registry_models) {
+		if (entry.second.ctx == ctx) {
+			return &entry.second;
+		}
+	}
+	return nullptr;
+}
+
+struct whisper_context *model_registry_acquire(const std::string &model_file_path)
+{
+	std::unique_lock<std::mutex> lock(registry_mutex);
+	while (true) {
+		auto it = registry_models.find(model_file_path);
+		if (it == registry_models.end()) {
+			break;
+		}
+		if (it->second.ctx != nullptr) {
+			it->second.refcount++;
+			return it->second.ctx;
+		}
+		// another user is loading the model, or failed to and removed the entry
+		model_loaded.wait(lock);
+	}
+	registry_models[model_file_path] = {nullptr, 1, {}, 0};
+	lock.unlock();
+
+	obs_log(LOG_INFO, "Loading whisper model from %s", model_file_path.c_str());
+	// every user decodes with a pooled state, the context needs none of its own
+	struct whisper_context *ctx = whisper_init_from_file_no_state(model_file_path.c_str());
+
+	lock.lock();
+	auto it = registry_models.find(model_file_path);
+	if (ctx == nullptr) {
+		registry_models.erase(it);
+		model_loaded.notify_all();
+		obs_log(LOG_ERROR, "Failed to load whisper model %s", model_file_path.c_str());
+		return nullptr;
+	}
+	it->second.ctx = ctx;
+	model_loaded.notify_all();
+	return ctx;
+}
+
+void model_registry_release(struct whisper_context *ctx)
+{
+	if (ctx == nullptr) {
+		return;
+	}
+	std::vector<struct whisper_state *> states;
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		auto it = registry_models.begin();
+		while (it != registry_models.end() && it->second.ctx != ctx) {
+			++it;
+		}
+		if (it == registry_models.end() || --it->second.refcount > 0) {
+			return;
+		}
+		obs_log(LOG_INFO, "Unloading whisper model %s", it->first.c_str());
+		// every user returns its states before dropping its reference
+		states.swap(it->second.idle_states);
+		registry_models.erase(it);
+	}
+	for (struct whisper_state *state : states) {
+		whisper_free_state(state);
+	}
+	whisper_free(ctx);
+}
+
+struct whisper_state *model_registry_acquire_state(struct whisper_context *ctx)
+{
+	if (ctx == nullptr) {
+		return nullptr;
+	}
+	std::unique_lock<std::mutex> lock(registry_mutex);
+	model_registry_entry *entry = nullptr;
+	state_returned.wait(lock, [&] {
+		entry = find_entry(ctx);
+		return entry == nullptr || !entry->idle_states.empty() ||
+		       entry->n_states < max_states_per_model();
+	});
+	if (entry == nullptr) {
+		lock.unlock();
+		return whisper_init_state(ctx);
+	}
+	if (!entry->idle_states.empty()) {
+		struct whisper_state *state = entry->idle_states.back();
+		entry->idle_states.pop_back();
+		return state;
+	}
+
+	// allocating a state takes a while, other models stay available meanwhile
+	entry->n_states++;
+	const int n_states = entry->n_states;
+	lock.unlock();
+	struct whisper_state *state = whisper_init_state(ctx);
+	lock.lock();
+	if (state == nullptr) {
+		entry = find_entry(ctx);
+		if (entry != nullptr) {
+			entry->n_states--;
+		}
+		state_returned.notify_all();
+		obs_log(LOG_ERROR, "Failed to allocate a whisper state");
+		return nullptr;
+	}
+	obs_log(LOG_INFO, "Allocated whisper state %d of the model", n_states);
+	return state;
+}
+
+void model_registry_release_state(struct whisper_context *ctx, struct whisper_state *state)
+{
+	if (state == nullptr) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		model_registry_entry *entry = find_entry(ctx);
+		if (entry != nullptr) {
+			entry->idle_states.push_back(state);
+			state_returned.notify_all();
+			return;
+		}
+	}
+	whisper_free_state(state);
+}
@@ -0,0 +1,57 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <whisper.h>
+
+#include <string>
+
+// Process wide cache of loaded whisper models, keyed by model file path.
+// Filters, routes and background jobs using the same model share one copy of the weights.
+// A shared context must only be used through whisper_*_with_state with a state owned by
+// the caller.
+
+// Load the model or take another reference to it, returns nullptr on failure. The load runs
+// without the registry lock, other users of the same path wait for it.
+struct whisper_context *model_registry_acquire(const std::string &model_file_path);
+// Drop a reference, the model is freed with the last one
+void model_registry_release(struct whisper_context *ctx);
+
+// Decoder states are pooled per model and lent out for one inference at a time. Whisper sizes
+// the KV caches and compute buffers of a state for its full 30 s window and text context,
+// whatever the window, so streams sharing a model hold as many states as decode at the same
+// time rather than one each. Blocks while the pool of the model is exhausted, returns nullptr
+// on failure. Contexts that do not come from the registry get a state of their own.
+struct whisper_state *model_registry_acquire_state(struct whisper_context *ctx);
+void model_registry_release_state(struct whisper_context *ctx, struct whisper_state *state);
+
+// Lends a state of ctx until release(), reset() or the end of the scope
+struct model_state_lease {
+	struct whisper_context *ctx;
+	struct whisper_state *state;
+
+	explicit model_state_lease(struct whisper_context *ctx_)
+		: ctx(ctx_), state(model_registry_acquire_state(ctx_))
+	{
+	}
+	~model_state_lease() { release(); }
+	model_state_lease(const model_state_lease &) = delete;
+	model_state_lease &operator=(const model_state_lease &) = delete;
+
+	void release()
+	{
+		if (state != nullptr) {
+			model_registry_release_state(ctx, state);
+			state = nullptr;
+		}
+	}
+	// return the state before borrowing one of another model, two pools are never waited on
+	// while holding a state
+	void reset(struct whisper_context *ctx_)
+	{
+		release();
+		ctx = ctx_;
+		state = model_registry_acquire_state(ctx_);
+	}
+};
+
+#endif // MODEL_REGISTRY_H
@@ -0,0 +1,685 @@
+#include "ngram-lm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define NGRAM_LM_MAGIC "LVNGRAM1"
+// candidates rescored at each decoder step, the model cannot promote tokens below them
+#define LM_FUSION_CANDIDATES 16
+
+static uint64_t hash_word(const char *word, size_t length)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (uint8_t)word[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static size_t align8(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+// Bytes of one record of the given order: the word ids, the log-probability and the backoff.
+// Unigrams are indexed by the word id and leave it out.
+static size_t record_size(uint32_t order)
+{
+	return (order == 1 ? 2 : order + 2) * sizeof(uint32_t);
+}
+
+bool ngram_lm_convert_arpa(const std::string &arpa_path, const std::string &binary_path,
+			   std::string &error)
+{
+	std::ifstream arpa(arpa_path);
+	if (!arpa.is_open()) {
+		error = "cannot open " + arpa_path;
+		return false;
+	}
+
+	// ARPA stores log10 probabilities
+	const float ln10 = (float)std::log(10.0);
+	uint64_t expected[NGRAM_LM_MAX_ORDER] = {};
+	uint32_t order = 0;
+	uint32_t section = 0; // order of the n-grams being read, 0 in the header
+	std::vector<std::string> words;
+	std::unordered_map<std::string, uint32_t> word_ids;
+	std::vector<float> unigrams; // log-probability and backoff by word id
+	std::vector<uint32_t> ids[NGRAM_LM_MAX_ORDER];
+	std::vector<float> values[NGRAM_LM_MAX_ORDER];
+
+	std::string line;
+	size_t line_number = 0;
+	while (std::getline(arpa, line)) {
+		line_number++;
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty()) {
+			continue;
+		}
+		if (line[0] == '\\') {
+			if (line == "\\data\\") {
+				section = 0;
+			} else if (line == "\\end\\") {
+				break;
+			} else if (sscanf(line.c_str(), "\\%u-grams:", &section) != 1 ||
+				   section < 1 || section > order) {
+				error = "unexpected section " + line;
+				return false;
+			}
+			continue;
+		}
+		if (section == 0) {
+			unsigned int n = 0;
+			unsigned long long count = 0;
+			if (sscanf(line.c_str(), "ngram %u=%llu", &n, &count) == 2) {
+				if (n < 1 || n > NGRAM_LM_MAX_ORDER) {
+					error = "models above order " +
+						std::to_string(NGRAM_LM_MAX_ORDER) +
+						" are not supported";
+					return false;
+				}
+				expected[n - 1] = count;
+				order = std::max(order, (uint32_t)n);
+			}
+			continue;
+		}
+
+		std::istringstream fields(line);
+		float logprob = 0.0f;
+		float backoff = 0.0f;
+		std::string gram[NGRAM_LM_MAX_ORDER];
+		fields >> logprob;
+		for (uint32_t k = 0; k < section; k++) {
+			fields >> gram[k];
+		}
+		if (fields.fail()) {
+			error = "malformed n-gram on line " + std::to_string(line_number);
+			return false;
+		}
+		if (!(fields >> backoff)) {
+			backoff = 0.0f;
+		}
+
+		if (section == 1) {
+			if (word_ids.count(gram[0]) == 0) {
+				word_ids[gram[0]] = (uint32_t)words.size();
+				words.push_back(gram[0]);
+				unigrams.push_back(logprob * ln10);
+				unigrams.push_back(backoff * ln10);
+			}
+			continue;
+		}
+		bool known = true;
+		for (uint32_t k = 0; k < section; k++) {
+			const auto it = word_ids.find(gram[k]);
+			if (it == word_ids.end()) {
+				known = false;
+				break;
+			}
+			ids[section - 1].push_back(it->second);
+		}
+		if (!known) {
+			// every word of a valid model is a unigram, drop the partial record
+			ids[section - 1].resize(values[section - 1].size() / 2 * section);
+			continue;
+		}
+		values[section - 1].push_back(logprob * ln10);
+		values[section - 1].push_back(backoff * ln10);
+	}
+	if (order == 0 || words.empty()) {
+		error = arpa_path + " is not an ARPA model";
+		return false;
+	}
+	if (words.size() != expected[0]) {
+		error = "the \\data\\ section announces " + std::to_string(expected[0]) +
+			" unigrams, the file has " + std::to_string(words.size());
+		return false;
+	}
+
+	ngram_lm_header header = {};
+	memcpy(header.magic, NGRAM_LM_MAGIC, sizeof(header.magic));
+	header.order = order;
+	header.n_words = (uint32_t)words.size();
+	header.unk_id = word_ids.count("<unk>") ? (int32_t)word_ids["<unk>"] : -1;
+	header.bos_id = word_ids.count("<s>") ? (int32_t)word_ids["<s>"] : -1;
+
+	std::vector<uint64_t> word_offsets;
+	std::string word_text;
+	for (const std::string &word : words) {
+		word_offsets.push_back(word_text.size());
+		word_text += word;
+		word_text += '\0';
+	}
+	uint64_t hash_size = 1;
+	while (hash_size < words.size() * 2) {
+		hash_size <<= 1;
+	}
+	std::vector<uint32_t> hash_table((size_t)hash_size, 0);
+	for (uint32_t id = 0; id < words.size(); id++) {
+		uint64_t slot = hash_word(words[id].data(), words[id].size()) & (hash_size - 1);
+		while (hash_table[(size_t)slot] != 0) {
+			slot = (slot + 1) & (hash_size - 1);
+		}
+		hash_table[(size_t)slot] = id + 1;
+	}
+
+	size_t offset = align8(sizeof(header));
+	header.word_offsets_offset = offset;
+	offset = align8(offset + word_offsets.size() * sizeof(uint64_t));
+	header.word_text_offset = offset;
+	offset = align8(offset + word_text.size());
+	header.hash_offset = offset;
+	header.hash_size = hash_size;
+	offset = align8(offset + hash_table.size() * sizeof(uint32_t));
+	for (uint32_t k = 1; k <= order; k++) {
+		header.n_grams[k - 1] = k == 1 ? words.size() : values[k - 1].size() / 2;
+		header.grams_offset[k - 1] = offset;
+		offset = align8(offset + header.n_grams[k - 1] * record_size(k));
+	}
+
+	std::ofstream out(binary_path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		error = "cannot write " + binary_path;
+		return false;
+	}
+	auto write_at = [&out](uint64_t position, const void *data, size_t size) {
+		// zero padding up to the aligned offset
+		for (uint64_t current = (uint64_t)out.tellp(); current < position; current++) {
+			out.put('\0');
+		}
+		out.write((const char *)data, (std::streamsize)size);
+	};
+	write_at(0, &header, sizeof(header));
+	write_at(header.word_offsets_offset, word_offsets.data(),
+		 word_offsets.size() * sizeof(uint64_t));
+	write_at(header.word_text_offset, word_text.data(), word_text.size());
+	write_at(header.hash_offset, hash_table.data(), hash_table.size() * sizeof(uint32_t));
+	for (uint32_t k = 1; k <= order; k++) {
+		std::vector<uint32_t> records;
+		if (k == 1) {
+			records.resize(unigrams.size());
+			memcpy(records.data(), unigrams.data(), unigrams.size() * sizeof(float));
+		} else {
+			// sort by the word ids for binary search
+			const std::vector<uint32_t> &gram_ids = ids[k - 1];
+			std::vector<size_t> sorted(values[k - 1].size() / 2);
+			for (size_t i = 0; i < sorted.size(); i++) {
+				sorted[i] = i;
+			}
+			std::sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) {
+				return std::lexicographical_compare(
+					gram_ids.begin() + a * k, gram_ids.begin() + (a + 1) * k,
+					gram_ids.begin() + b * k, gram_ids.begin() + (b + 1) * k);
+			});
+			records.resize(sorted.size() * (k + 2));
+			uint32_t *record = records.data();
+			for (size_t i : sorted) {
+				memcpy(record, gram_ids.data() + i * k, k * sizeof(uint32_t));
+				memcpy(record + k, values[k - 1].data() + i * 2, 2 * sizeof(float));
+				record += k + 2;
+			}
+		}
+		write_at(header.grams_offset[k - 1], records.data(),
+			 records.size() * sizeof(uint32_t));
+	}
+	write_at(align8((size_t)out.tellp()), nullptr, 0);
+	if (!out.good()) {
+		error = "failed to write " + binary_path;
+		return false;
+	}
+	return true;
+}
+
+static bool map_file(struct ngram_lm *lm, const std::string &path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+				  FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	// the mapping keeps the file open
+	CloseHandle(file);
+	if (mapping == NULL) {
+		return false;
+	}
+	lm->data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (lm->data == nullptr) {
+		CloseHandle(mapping);
+		return false;
+	}
+	lm->size = (size_t)size.QuadPart;
+	lm->mapping_handle = mapping;
+#else
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	void *data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	lm->data = (const uint8_t *)data;
+	lm->size = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+static void unmap_file(struct ngram_lm *lm)
+{
+	if (lm->data == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(lm->data);
+	CloseHandle((HANDLE)lm->mapping_handle);
+#else
+	munmap((void *)lm->data, lm->size);
+#endif
+	lm->data = nullptr;
+	lm->size = 0;
+}
+
+// Every section must lie within the file before anything is read from it
+static bool validate_header(const struct ngram_lm *lm)
+{
+	const struct ngram_lm_header *h = lm->header;
+	auto fits = [lm](uint64_t offset, uint64_t count, uint64_t size) {
+		return offset <= lm->size && (size == 0 || count <= (lm->size - offset) / size);
+	};
+	if (memcmp(h->magic, NGRAM_LM_MAGIC, sizeof(h->magic)) != 0 || h->order < 1 ||
+	    h->order > NGRAM_LM_MAX_ORDER || h->n_words == 0 || h->n_grams[0] != h->n_words ||
+	    h->hash_size < h->n_words || (h->hash_size & (h->hash_size - 1)) != 0 ||
+	    h->unk_id >= (int32_t)h->n_words || h->bos_id >= (int32_t)h->n_words) {
+		return false;
+	}
+	if (!fits(h->word_offsets_offset, h->n_words, sizeof(uint64_t)) ||
+	    !fits(h->word_text_offset, 0, 0) || !fits(h->hash_offset, h->hash_size, 4)) {
+		return false;
+	}
+	for (uint32_t k = 1; k <= h->order; k++) {
+		if (!fits(h->grams_offset[k - 1], h->n_grams[k - 1], record_size(k))) {
+			return false;
+		}
+	}
+	// the words must be terminated inside the text block
+	const uint64_t *word_offsets = (const uint64_t *)(lm->data + h->word_offsets_offset);
+	const size_t text_size = lm->size - (size_t)h->word_text_offset;
+	for (uint32_t id = 0; id < h->n_words; id++) {
+		if (word_offsets[id] >= text_size ||
+		    memchr(lm->data + h->word_text_offset + word_offsets[id], '\0',
+			   text_size - (size_t)word_offsets[id]) == nullptr) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct ngram_lm *ngram_lm_open(const std::string &path, std::string &error)
+{
+	std::string binary_path = path;
+	std::string extension = path.substr(std::min(path.size(), path.find_last_of('.') + 1));
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	if (extension == "arpa") {
+		binary_path = path + ".bin";
+		std::error_code ec;
+		const bool up_to_date =
+			std::filesystem::exists(binary_path, ec) &&
+			std::filesystem::last_write_time(binary_path, ec) >=
+				std::filesystem::last_write_time(path, ec) &&
+			!ec;
+		if (!up_to_date && !ngram_lm_convert_arpa(path, binary_path, error)) {
+			return nullptr;
+		}
+	}
+
+	struct ngram_lm *lm = new ngram_lm();
+	lm->path = binary_path;
+	if (!map_file(lm, binary_path)) {
+		error = "cannot map " + binary_path;
+		delete lm;
+		return nullptr;
+	}
+	lm->header = (const struct ngram_lm_header *)lm->data;
+	if (lm->size < sizeof(ngram_lm_header) || !validate_header(lm)) {
+		error = binary_path + " is not a valid binary model, convert the ARPA file again";
+		ngram_lm_close(lm);
+		return nullptr;
+	}
+	return lm;
+}
+
+void ngram_lm_close(struct ngram_lm *lm)
+{
+	if (lm == nullptr) {
+		return;
+	}
+	unmap_file(lm);
+	delete lm;
+}
+
+int32_t ngram_lm_word_id(const struct ngram_lm *lm, const std::string &word)
+{
+	const struct ngram_lm_header *h = lm->header;
+	const uint64_t *word_offsets = (const uint64_t *)(lm->data + h->word_offsets_offset);
+	const char *word_text = (const char *)(lm->data + h->word_text_offset);
+	const uint32_t *hash_table = (const uint32_t *)(lm->data + h->hash_offset);
+	uint64_t slot = hash_word(word.data(), word.size()) & (h->hash_size - 1);
+	for (uint64_t probes = 0; probes < h->hash_size; probes++) {
+		const uint32_t entry = hash_table[slot];
+		if (entry == 0) {
+			break;
+		}
+		if (entry <= h->n_words && word == word_text + word_offsets[entry - 1]) {
+			return (int32_t)(entry - 1);
+		}
+		slot = (slot + 1) & (h->hash_size - 1);
+	}
+	return h->unk_id;
+}
+
+// Log-probability and backoff of an n-gram of order n, nullptr if the model does not have it
+static const float *find_gram(const struct ngram_lm *lm, const int32_t *words, uint32_t n)
+{
+	const struct ngram_lm_header *h = lm->header;
+	const uint8_t *records = lm->data + h->grams_offset[n - 1];
+	if (n == 1) {
+		return (const float *)records + (size_t)words[0] * 2;
+	}
+	const size_t stride = record_size(n);
+	size_t low = 0;
+	size_t high = (size_t)h->n_grams[n - 1];
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+		const uint32_t *record = (const uint32_t *)(records + mid * stride);
+		int cmp = 0;
+		for (uint32_t k = 0; k < n && cmp == 0; k++) {
+			cmp = record[k] < (uint32_t)words[k] ? -1 : record[k] > (uint32_t)words[k];
+		}
+		if (cmp == 0) {
+			return (const float *)(record + n);
+		}
+		if (cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return nullptr;
+}
+
+float ngram_lm_score(const struct ngram_lm *lm, const int32_t *context, int n_context,
+		     int32_t word)
+{
+	const uint32_t order = lm->header->order;
+	int32_t gram[NGRAM_LM_MAX_ORDER];
+	float backoff = 0.0f;
+	// from the longest context down to the unigram, which always exists
+	for (int n = std::min(n_context, (int)order - 1); n >= 0; n--) {
+		memcpy(gram, context + n_context - n, n * sizeof(int32_t));
+		gram[n] = word;
+		const float *value = find_gram(lm, gram, (uint32_t)n + 1);
+		if (value != nullptr) {
+			return backoff + value[0];
+		}
+		const float *context_value = n > 0 ? find_gram(lm, gram, (uint32_t)n) : nullptr;
+		if (context_value != nullptr) {
+			backoff += context_value[1];
+		}
+	}
+	return backoff;
+}
+
+// Lowercase the word and drop its punctuation, sets sentence_end if it ends a sentence
+static std::string normalize_word(const std::string &text, bool *sentence_end = nullptr)
+{
+	std::string word;
+	for (unsigned char ch : text) {
+		if (ch >= 0x80 || isalnum(ch) || ch == '\'') {
+			word += (char)tolower(ch);
+		}
+	}
+	if (sentence_end != nullptr) {
+		const size_t last = text.find_last_not_of(" \"')");
+		*sentence_end = last != std::string::npos &&
+				(text[last] == '.' || text[last] == '?' || text[last] == '!');
+	}
+	return word;
+}
+
+static void lm_fusion_load(struct lm_fusion *fusion, std::mutex *ctx_mutex)
+{
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(*ctx_mutex);
+		path = fusion->requested_path;
+	}
+	bool done = false;
+	while (!done) {
+		// converting a large ARPA file takes seconds, mapping the result is cheap
+		std::string error;
+		struct ngram_lm *lm = path.empty() ? nullptr : ngram_lm_open(path, error);
+		{
+			std::lock_guard<std::mutex> lock(*ctx_mutex);
+			if (fusion->requested_path != path) {
+				// changed again while loading, load the newer path
+				path = fusion->requested_path;
+			} else {
+				std::swap(lm, fusion->lm);
+				fusion->path = path;
+				fusion->token_words.clear();
+				fusion->load_error = error;
+				fusion->loading = false;
+				done = true;
+			}
+		}
+		// the replaced or outdated model, closed without holding the lock
+		ngram_lm_close(lm);
+	}
+}
+
+void lm_fusion_configure(struct lm_fusion *fusion, const std::string &path,
+			 std::mutex *ctx_mutex)
+{
+	std::thread finished_thread;
+	{
+		std::lock_guard<std::mutex> lock(*ctx_mutex);
+		if (path == fusion->requested_path) {
+			return;
+		}
+		fusion->requested_path = path;
+		// the previous model must not be used in the meantime
+		ngram_lm_close(fusion->lm);
+		fusion->lm = nullptr;
+		fusion->token_words.clear();
+		if (fusion->loading) {
+			// the running load picks up the new path
+			return;
+		}
+		fusion->loading = true;
+		finished_thread.swap(fusion->load_thread);
+		fusion->load_thread = std::thread(lm_fusion_load, fusion, ctx_mutex);
+	}
+	// the previous load has already swapped its model in
+	if (finished_thread.joinable()) {
+		finished_thread.join();
+	}
+}
+
+void lm_fusion_wait(struct lm_fusion *fusion)
+{
+	if (fusion->load_thread.joinable()) {
+		fusion->load_thread.join();
+	}
+}
+
+bool lm_fusion_prepare(struct lm_fusion *fusion, struct whisper_context *ctx)
+{
+	if (fusion->lm == nullptr) {
+		return false;
+	}
+
+	std::vector<int32_t> &token_words = fusion->token_words[ctx];
+	const whisper_token eot = whisper_token_eot(ctx);
+	if (token_words.size() == (size_t)eot) {
+		return true;
+	}
+	token_words.assign((size_t)eot, LM_FUSION_NOT_A_WORD);
+	const int32_t unk_id = fusion->lm->header->unk_id;
+	for (whisper_token id = 0; id < eot; id++) {
+		const char *text = whisper_token_to_str(ctx, id);
+		if (text == nullptr || text[0] != ' ') {
+			continue;
+		}
+		const std::string word = normalize_word(text + 1);
+		if (word.empty()) {
+			continue;
+		}
+		const int32_t word_id = ngram_lm_word_id(fusion->lm, word);
+		if (word_id >= 0 && word_id != unk_id) {
+			token_words[id] = word_id;
+		}
+	}
+	return true;
+}
+
+void lm_fusion_free(struct lm_fusion *fusion)
+{
+	ngram_lm_close(fusion->lm);
+	fusion->lm = nullptr;
+	fusion->path.clear();
+	fusion->requested_path.clear();
+	fusion->token_words.clear();
+}
+
+// Word ids of the current sentence, the last word is complete when the next token starts a word
+static void decoded_context(const struct lm_fusion *fusion, struct whisper_context *ctx,
+			    const whisper_token_data *tokens, int n_tokens,
+			    std::vector<int32_t> &context)
+{
+	const struct ngram_lm_header *h = fusion->lm->header;
+	const whisper_token eot = whisper_token_eot(ctx);
+	auto start_sentence = [&]() {
+		context.clear();
+		if (h->bos_id >= 0) {
+			context.push_back(h->bos_id);
+		}
+	};
+	std::string current;
+	auto end_word = [&]() {
+		bool sentence_end = false;
+		const std::string word = normalize_word(current, &sentence_end);
+		current.clear();
+		if (word.empty()) {
+			return;
+		}
+		const int32_t word_id = ngram_lm_word_id(fusion->lm, word);
+		if (word_id < 0) {
+			// no <unk> to condition on, start over after the word
+			context.clear();
+		} else {
+			context.push_back(word_id);
+		}
+		if (sentence_end) {
+			start_sentence();
+		}
+	};
+
+	start_sentence();
+	for (int i = 0; i < n_tokens; i++) {
+		if (tokens[i].id >= eot) {
+			continue;
+		}
+		const char *text = whisper_token_to_str(ctx, tokens[i].id);
+		if (text[0] == ' ') {
+			end_word();
+		}
+		current += text;
+	}
+	end_word();
+}
+
+void logits_filter_chain_add_lm_fusion(struct logits_filter_chain *chain,
+				       const struct lm_fusion *fusion, struct whisper_context *ctx)
+{
+	const auto table = fusion->token_words.find(ctx);
+	if (fusion->lm == nullptr || table == fusion->token_words.end()) {
+		return;
+	}
+	const std::vector<int32_t> *token_words = &table->second;
+	chain->filters.push_back([fusion, token_words](struct whisper_context *filter_ctx,
+						       struct whisper_state *,
+						       const whisper_token_data *tokens,
+						       int n_tokens, float *logits) {
+		// heap of the best text tokens with the lowest of them at the front
+		std::vector<whisper_token> candidates;
+		auto greater = [logits](whisper_token a, whisper_token b) {
+			return logits[a] > logits[b];
+		};
+		for (whisper_token id = 0; id < (whisper_token)token_words->size(); id++) {
+			if (std::isinf(logits[id])) {
+				continue;
+			}
+			if (candidates.size() < LM_FUSION_CANDIDATES) {
+				candidates.push_back(id);
+				std::push_heap(candidates.begin(), candidates.end(), greater);
+			} else if (logits[id] > logits[candidates.front()]) {
+				std::pop_heap(candidates.begin(), candidates.end(), greater);
+				candidates.back() = id;
+				std::push_heap(candidates.begin(), candidates.end(), greater);
+			}
+		}
+
+		std::vector<std::pair<whisper_token, float>> scored;
+		std::vector<int32_t> context;
+		for (whisper_token id : candidates) {
+			const int32_t word_id = (*token_words)[id];
+			if (word_id < 0) {
+				continue;
+			}
+			if (scored.empty()) {
+				decoded_context(fusion, filter_ctx, tokens, n_tokens, context);
+			}
+			scored.push_back({id, ngram_lm_score(fusion->lm, context.data(),
+							     (int)context.size(), word_id)});
+		}
+		if (scored.size() < 2) {
+			return;
+		}
+		float best = -INFINITY;
+		for (const auto &candidate : scored) {
+			best = std::max(best, candidate.second);
+		}
+		for (const auto &candidate : scored) {
+			logits[candidate.first] += fusion->weight * (candidate.second - best);
+		}
+	});
+}
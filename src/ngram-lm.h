@@ -0,0 +1,103 @@
+#ifndef NGRAM_LM_H
+#define NGRAM_LM_H
+
+#include <whisper.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logits-filter.h"
+
+#define NGRAM_LM_MAX_ORDER 6
+
+// Layout of the binary model, all offsets are from the start of the file
+struct ngram_lm_header {
+	char magic[8];
+	uint32_t order;
+	uint32_t n_words;
+	// <unk> and <s>, -1 if the model does not have them
+	int32_t unk_id;
+	int32_t bos_id;
+	// word strings: n_words offsets into the text block, then the NUL terminated words
+	uint64_t word_offsets_offset;
+	uint64_t word_text_offset;
+	// open addressing table of word id + 1 by word hash, 0 is empty, size is a power of two
+	uint64_t hash_offset;
+	uint64_t hash_size;
+	// order k: n_grams[k - 1] records of k word ids, a log-probability and a backoff, sorted
+	// by the ids. Unigrams are indexed by the word id.
+	uint64_t n_grams[NGRAM_LM_MAX_ORDER];
+	uint64_t grams_offset[NGRAM_LM_MAX_ORDER];
+};
+
+// Word n-gram model converted once from an ARPA file (as written by KenLM or SRILM) and
+// memory mapped, so opening it costs no parsing and its pages are shared with other filters.
+// Probabilities are stored as natural logarithms.
+struct ngram_lm {
+	std::string path;
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	const struct ngram_lm_header *header = nullptr;
+	void *mapping_handle = nullptr;
+};
+
+// Write the binary form of an ARPA model
+bool ngram_lm_convert_arpa(const std::string &arpa_path, const std::string &binary_path,
+			   std::string &error);
+// Map a binary model. An .arpa path is converted first to <path>.bin, unless that file is
+// newer than the ARPA file. Returns nullptr and sets error on failure.
+struct ngram_lm *ngram_lm_open(const std::string &path, std::string &error);
+void ngram_lm_close(struct ngram_lm *lm);
+
+// Id of a word, the <unk> id if the model does not know it and has <unk>, otherwise -1
+int32_t ngram_lm_word_id(const struct ngram_lm *lm, const std::string &word);
+// log P(word | context) with backoff, context holds word ids oldest first
+float ngram_lm_score(const struct ngram_lm *lm, const int32_t *context, int n_context,
+		     int32_t word);
+
+// Shallow fusion of the n-gram model with the decoder. Whisper decodes BPE tokens while the
+// model knows words, so it rescores the candidates that start a known word after the words
+// decoded so far. The best of them keeps its logit and the others lose
+// weight * (its log-probability - theirs), so the model only reorders words the decoder already
+// considers and never pushes it towards or away from ending a word. The model is expected to
+// be trained on lowercase text without punctuation, as usual for speech recognition.
+struct lm_fusion {
+	std::string path;
+	struct ngram_lm *lm = nullptr;
+	float weight = 0.3f;
+	// the model is converted and mapped on load_thread and swapped in under the context
+	// mutex, which also guards requested_path and loading
+	std::string requested_path;
+	bool loading = false;
+	std::thread load_thread;
+	// why the last load failed, for the owner to report, also guarded by the context mutex
+	std::string load_error;
+	// word id of each text token that starts a word, LM_FUSION_NOT_A_WORD for the others.
+	// Kept per context, models with the same vocabulary size share the vocabulary.
+	std::map<struct whisper_context *, std::vector<int32_t>> token_words;
+};
+
+#define LM_FUSION_NOT_A_WORD -2
+
+// Convert and map the model at path on a background thread, which swaps it in under
+// ctx_mutex. Call without holding ctx_mutex. No-op if path is unchanged, fusion stays off
+// until the new model is ready. An empty path turns fusion off.
+void lm_fusion_configure(struct lm_fusion *fusion, const std::string &path,
+			 std::mutex *ctx_mutex);
+// Wait for a running load, call without holding the context mutex
+void lm_fusion_wait(struct lm_fusion *fusion);
+// Map the vocabulary of ctx, call with the context mutex held. Returns false while no model
+// is loaded.
+bool lm_fusion_prepare(struct lm_fusion *fusion, struct whisper_context *ctx);
+// Close the model, call after lm_fusion_wait
+void lm_fusion_free(struct lm_fusion *fusion);
+// The fusion must be prepared for the context of the whisper_full call and outlive it
+void logits_filter_chain_add_lm_fusion(struct logits_filter_chain *chain,
+				       const struct lm_fusion *fusion, struct whisper_context *ctx);
+
+#endif // NGRAM_LM_H
@@ -0,0 +1,101 @@
+#ifndef PIPELINE_QUEUE_H
+#define PIPELINE_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// how long an idle stage sleeps before it checks for shutdown
+#define PIPELINE_WAIT_MSEC 10
+
+// What a stage does when the queue to the next stage is full
+enum PipelineBackpressure {
+	// wait for room, the delay backs up to the input buffer which absorbs it
+	PIPELINE_BACKPRESSURE_BLOCK,
+	// drop the item, for outputs that are stale once they are late
+	PIPELINE_BACKPRESSURE_DROP,
+};
+
+// Bounded queue between two stage threads, one producer and one consumer. Push and pop never
+// take a lock, the mutex and condition variable only park an idle consumer or a blocked
+// producer, which also wake up on their own after PIPELINE_WAIT_MSEC.
+template<typename T> struct pipeline_queue {
+	std::vector<T> slots;
+	// positions only ever grow, the slot is the position modulo the capacity
+	std::atomic<size_t> head{0}; // next to pop, written by the consumer
+	std::atomic<size_t> tail{0}; // next to push, written by the producer
+	PipelineBackpressure backpressure = PIPELINE_BACKPRESSURE_BLOCK;
+	std::mutex wait_mutex;
+	std::condition_variable wait_cv;
+};
+
+template<typename T>
+void pipeline_queue_init(struct pipeline_queue<T> *queue, size_t capacity,
+			 PipelineBackpressure backpressure)
+{
+	queue->slots.resize(capacity);
+	queue->head = 0;
+	queue->tail = 0;
+	queue->backpressure = backpressure;
+}
+
+template<typename T> size_t pipeline_queue_size(const struct pipeline_queue<T> *queue)
+{
+	const size_t head = queue->head.load(std::memory_order_acquire);
+	return queue->tail.load(std::memory_order_acquire) - head;
+}
+
+template<typename T> bool pipeline_queue_try_push(struct pipeline_queue<T> *queue, T &item)
+{
+	const size_t tail = queue->tail.load(std::memory_order_relaxed);
+	if (tail - queue->head.load(std::memory_order_acquire) >= queue->slots.size()) {
+		return false;
+	}
+	queue->slots[tail % queue->slots.size()] = std::move(item);
+	queue->tail.store(tail + 1, std::memory_order_release);
+	queue->wait_cv.notify_all();
+	return true;
+}
+
+template<typename T> bool pipeline_queue_try_pop(struct pipeline_queue<T> *queue, T &item)
+{
+	const size_t head = queue->head.load(std::memory_order_relaxed);
+	if (head == queue->tail.load(std::memory_order_acquire)) {
+		return false;
+	}
+	item = std::move(queue->slots[head % queue->slots.size()]);
+	queue->head.store(head + 1, std::memory_order_release);
+	queue->wait_cv.notify_all();
+	return true;
+}
+
+// Park until the queue has an item, or room with for_room, for PIPELINE_WAIT_MSEC at most
+template<typename T> void pipeline_queue_wait(struct pipeline_queue<T> *queue, bool for_room)
+{
+	std::unique_lock<std::mutex> lock(queue->wait_mutex);
+	queue->wait_cv.wait_for(lock, std::chrono::milliseconds(PIPELINE_WAIT_MSEC), [&] {
+		const size_t size = pipeline_queue_size(queue);
+		return for_room ? size < queue->slots.size() : size > 0;
+	});
+}
+
+// Push following the backpressure policy of the queue. Returns false if the item was dropped,
+// or the pipeline is stopping while waiting for room.
+template<typename T>
+bool pipeline_queue_push(struct pipeline_queue<T> *queue, T &item,
+			 const std::atomic<bool> &stopping)
+{
+	while (!pipeline_queue_try_push(queue, item)) {
+		if (queue->backpressure == PIPELINE_BACKPRESSURE_DROP || stopping) {
+			return false;
+		}
+		pipeline_queue_wait(queue, true);
+	}
+	return true;
+}
+
+#endif // PIPELINE_QUEUE_H
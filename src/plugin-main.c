@@ -28,10 +28,12 @@ MODULE_EXPORT const char *obs_module_description(void)
 }
 
 extern struct obs_source_info transcription_filter_info;
+extern void register_batch_transcription_tool(void);
 
 bool obs_module_load(void)
 {
 	obs_register_source(&transcription_filter_info);
+	register_batch_transcription_tool();
 	blog(LOG_INFO, "plugin loaded successfully (version %s)", PLUGIN_VERSION);
 	return true;
 }
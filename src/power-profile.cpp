@@ -0,0 +1,124 @@
+#include "power-profile.h"
+
+#include <obs-module.h>
+
+#include "plugin-support.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+#define POWER_PROFILE_POLL_INTERVAL_NS 10000000000ULL
+// the low-power profile starts at this temperature and ends below the cool one
+#define POWER_PROFILE_HOT_C 85.0f
+#define POWER_PROFILE_COOL_C 75.0f
+// zones reporting outside of this range are unused or broken sensors
+#define POWER_PROFILE_MAX_SANE_C 150.0f
+
+// First line of a sysfs attribute, empty if it cannot be read
+static std::string read_attribute(const std::filesystem::path &path)
+{
+	std::ifstream file(path);
+	std::string line;
+	std::getline(file, line);
+	while (!line.empty() && (line.back() == '\n' || line.back() == ' ')) {
+		line.pop_back();
+	}
+	return line;
+}
+
+bool power_status_read(const std::string &sysfs_root, struct power_status *status)
+{
+	*status = power_status();
+	const std::filesystem::path supplies = std::filesystem::path(sysfs_root) / "class" /
+					       "power_supply";
+	const std::filesystem::path zones = std::filesystem::path(sysfs_root) / "class" /
+					    "thermal";
+	std::error_code ec;
+	bool found = false;
+
+	bool has_mains = false;
+	bool mains_online = false;
+	bool has_battery = false;
+	for (const auto &entry : std::filesystem::directory_iterator(supplies, ec)) {
+		found = true;
+		const std::string type = read_attribute(entry.path() / "type");
+		if (type == "Mains" || type == "USB" || type == "USB_C") {
+			has_mains = true;
+			mains_online |= read_attribute(entry.path() / "online") == "1";
+		} else if (type == "Battery") {
+			// peripherals such as mice report their batteries here as well
+			if (read_attribute(entry.path() / "scope") == "Device") {
+				continue;
+			}
+			has_battery = true;
+			const std::string state = read_attribute(entry.path() / "status");
+			status->on_battery |= state == "Discharging";
+			const std::string capacity = read_attribute(entry.path() / "capacity");
+			const int percent = capacity.empty() ? -1 : atoi(capacity.c_str());
+			if (percent >= 0 &&
+			    (status->battery_percent < 0 || percent < status->battery_percent)) {
+				status->battery_percent = percent;
+			}
+		}
+	}
+	// some batteries stay "Unknown" or "Not charging" when unplugged
+	if (has_battery && has_mains && !mains_online) {
+		status->on_battery = true;
+	}
+
+	for (const auto &entry : std::filesystem::directory_iterator(zones, ec)) {
+		found = true;
+		if (entry.path().filename().string().rfind("thermal_zone", 0) != 0) {
+			continue;
+		}
+		// millidegrees Celsius
+		const std::string temp = read_attribute(entry.path() / "temp");
+		if (temp.empty()) {
+			continue;
+		}
+		const float celsius = (float)atol(temp.c_str()) / 1000.0f;
+		if (celsius > 0.0f && celsius < POWER_PROFILE_MAX_SANE_C) {
+			status->max_temperature_c = std::max(status->max_temperature_c, celsius);
+		}
+	}
+	return found;
+}
+
+void power_profile_init(struct power_profile *profile)
+{
+	const char *root = getenv("LOCALVOCAL_SYSFS_ROOT");
+	profile->sysfs_root = root != nullptr && root[0] != '\0' ? root : "/sys";
+	profile->next_poll_ns = 0;
+	profile->hot = false;
+	profile->low_power = false;
+}
+
+bool power_profile_update(struct power_profile *profile, uint64_t now_ns)
+{
+	if (now_ns < profile->next_poll_ns) {
+		return profile->low_power;
+	}
+	profile->next_poll_ns = now_ns + POWER_PROFILE_POLL_INTERVAL_NS;
+	if (!power_status_read(profile->sysfs_root, &profile->status)) {
+		profile->low_power = false;
+		return false;
+	}
+
+	const float temperature = profile->status.max_temperature_c;
+	if (temperature >= POWER_PROFILE_HOT_C) {
+		profile->hot = true;
+	} else if (temperature < POWER_PROFILE_COOL_C) {
+		profile->hot = false;
+	}
+	const bool low_power = profile->status.on_battery || profile->hot;
+	if (low_power != profile->low_power) {
+		obs_log(LOG_INFO, "%s the low-power profile: %s, battery %d%%, %.0f C",
+			low_power ? "entering" : "leaving",
+			profile->status.on_battery ? "on battery" : "plugged in",
+			profile->status.battery_percent, temperature);
+	}
+	profile->low_power = low_power;
+	return low_power;
+}
@@ -0,0 +1,36 @@
+#ifndef POWER_PROFILE_H
+#define POWER_PROFILE_H
+
+#include <cstdint>
+#include <string>
+
+// Power source and temperature of the machine
+struct power_status {
+	// a battery is discharging
+	bool on_battery = false;
+	// lowest charge of the batteries, -1 without a battery
+	int battery_percent = -1;
+	// hottest thermal zone in degrees Celsius, -1 if unknown
+	float max_temperature_c = -1.0f;
+};
+
+// Read <sysfs_root>/class/power_supply and <sysfs_root>/class/thermal as laid out by Linux.
+// Returns false if neither exists, as on other systems.
+bool power_status_read(const std::string &sysfs_root, struct power_status *status);
+
+// Switches the filter to a low-power profile while the laptop runs on battery or hot, and
+// back once it is plugged in and has cooled down. Polled by the inference stage, which owns it.
+struct power_profile {
+	// "/sys", or $LOCALVOCAL_SYSFS_ROOT to read a fake tree instead
+	std::string sysfs_root;
+	uint64_t next_poll_ns = 0;
+	bool hot = false;
+	bool low_power = false;
+	struct power_status status;
+};
+
+void power_profile_init(struct power_profile *profile);
+// Poll sysfs when due at now_ns, returns whether the low-power profile is active
+bool power_profile_update(struct power_profile *profile, uint64_t now_ns);
+
+#endif // POWER_PROFILE_H
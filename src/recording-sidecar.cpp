@@ -0,0 +1,78 @@
+#include "recording-sidecar.h"
+
+#include <obs-module.h>
+
+#include "plugin-support.h"
+
+#include <algorithm>
+
+std::string recording_sidecar_path(const std::string &recording_path, subtitle_format format)
+{
+	const size_t dot = recording_path.find_last_of('.');
+	const size_t slash = recording_path.find_last_of("/\\");
+	std::string base = recording_path;
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+		base = recording_path.substr(0, dot);
+	}
+	return base + (format == SUBTITLE_FORMAT_VTT ? ".vtt" : ".srt");
+}
+
+bool recording_sidecar_start(struct recording_sidecar *sidecar, const std::string &recording_path,
+			     subtitle_format format, uint64_t start_timestamp_ns)
+{
+	std::lock_guard<std::mutex> lock(sidecar->mutex);
+	if (sidecar->file.is_open()) {
+		sidecar->file.close();
+	}
+	sidecar->path = recording_sidecar_path(recording_path, format);
+	sidecar->file.open(sidecar->path, std::ios::out | std::ios::trunc);
+	if (!sidecar->file.is_open()) {
+		obs_log(LOG_ERROR, "failed to open subtitle sidecar %s", sidecar->path.c_str());
+		sidecar->active = false;
+		return false;
+	}
+	sidecar->format = format;
+	sidecar->start_timestamp_ns = start_timestamp_ns;
+	sidecar->last_end_ms = 0;
+	sidecar->cue_index = 0;
+	sidecar->active = true;
+	sidecar->file << subtitle_file_header(format);
+	sidecar->file.flush();
+	obs_log(LOG_INFO, "writing recording subtitles to %s", sidecar->path.c_str());
+	return true;
+}
+
+void recording_sidecar_add_cue(struct recording_sidecar *sidecar, uint64_t start_timestamp_ns,
+			       uint64_t end_timestamp_ns, const std::string &text)
+{
+	std::lock_guard<std::mutex> lock(sidecar->mutex);
+	if (!sidecar->active || end_timestamp_ns <= sidecar->start_timestamp_ns) {
+		return;
+	}
+	subtitle_cue cue;
+	cue.start_ms = (int64_t)(start_timestamp_ns - std::min(start_timestamp_ns,
+							       sidecar->start_timestamp_ns)) /
+		       1000000;
+	cue.end_ms = (int64_t)(end_timestamp_ns - sidecar->start_timestamp_ns) / 1000000;
+	// overlapping windows produce overlapping cues, start where the previous one ended
+	cue.start_ms = std::max(cue.start_ms, sidecar->last_end_ms);
+	if (cue.end_ms <= cue.start_ms) {
+		return;
+	}
+	cue.text = text;
+	sidecar->file << format_subtitle_cue(cue, ++sidecar->cue_index, sidecar->format);
+	sidecar->file.flush();
+	sidecar->last_end_ms = cue.end_ms;
+}
+
+void recording_sidecar_stop(struct recording_sidecar *sidecar)
+{
+	std::lock_guard<std::mutex> lock(sidecar->mutex);
+	if (!sidecar->active) {
+		return;
+	}
+	sidecar->active = false;
+	sidecar->file.close();
+	obs_log(LOG_INFO, "finished recording subtitles %s (%d cues)", sidecar->path.c_str(),
+		(int)sidecar->cue_index);
+}
@@ -0,0 +1,35 @@
+#ifndef RECORDING_SIDECAR_H
+#define RECORDING_SIDECAR_H
+
+#include "subtitle-format.h"
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+// Subtitle file written next to an OBS recording while it is running.
+// Cues are streamed to disk as they arrive so the file is complete when recording stops.
+struct recording_sidecar {
+	std::mutex mutex;
+	std::ofstream file;
+	std::string path;
+	subtitle_format format = SUBTITLE_FORMAT_SRT;
+	// clock-domain timestamp (ns) at which the recording started
+	uint64_t start_timestamp_ns = 0;
+	// end of the last written cue, cues are not allowed to overlap
+	int64_t last_end_ms = 0;
+	size_t cue_index = 0;
+	bool active = false;
+};
+
+// Path of the sidecar for a recording, e.g. "2023-10-01 12-00-00.mkv" -> "2023-10-01 12-00-00.srt"
+std::string recording_sidecar_path(const std::string &recording_path, subtitle_format format);
+bool recording_sidecar_start(struct recording_sidecar *sidecar, const std::string &recording_path,
+			     subtitle_format format, uint64_t start_timestamp_ns);
+// Timestamps are clock-domain timestamps in ns, cues before the recording start are dropped
+void recording_sidecar_add_cue(struct recording_sidecar *sidecar, uint64_t start_timestamp_ns,
+			       uint64_t end_timestamp_ns, const std::string &text);
+void recording_sidecar_stop(struct recording_sidecar *sidecar);
+
+#endif // RECORDING_SIDECAR_H
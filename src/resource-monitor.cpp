@@ -0,0 +1,122 @@
+#include "resource-monitor.h"
+
+#include <obs-module.h>
+
+#include "plugin-support.h"
+
+#include <functional>
+
+#define RESOURCE_MONITOR_INTERVAL_NS 60000000000ULL
+// 30 minutes of history, growth has to last that long to be reported
+#define RESOURCE_MONITOR_HISTORY 30
+// growth below these is allocator and cache noise
+#define RESOURCE_MONITOR_MIN_RSS_GROWTH (64ULL * 1024 * 1024)
+#define RESOURCE_MONITOR_MIN_BUFFER_GROWTH (1024ULL * 1024)
+#define RESOURCE_MONITOR_MIN_BACKLOG_GROWTH_MS 2000
+#define RESOURCE_MONITOR_MIN_LATENCY_DRIFT_MS 1000
+
+void resource_monitor_add_latency(struct resource_monitor *monitor, int64_t latency_ms)
+{
+	if (latency_ms < 0) {
+		return;
+	}
+	monitor->latency_sum_ms += (uint64_t)latency_ms;
+	monitor->latency_count++;
+}
+
+bool resource_monitor_due(struct resource_monitor *monitor, uint64_t now_ns)
+{
+	if (monitor->next_sample_ns == 0) {
+		// the first sample is taken after one interval, once the pipeline has warmed up
+		monitor->next_sample_ns = now_ns + RESOURCE_MONITOR_INTERVAL_NS;
+		return false;
+	}
+	return now_ns >= monitor->next_sample_ns;
+}
+
+// Whether the value never went down over the whole history and grew by at least min_growth
+static bool grows_steadily(const std::vector<resource_sample> &samples,
+			   const std::function<uint64_t(const resource_sample &)> &value,
+			   uint64_t min_growth)
+{
+	if (samples.size() < RESOURCE_MONITOR_HISTORY) {
+		return false;
+	}
+	for (size_t i = 1; i < samples.size(); i++) {
+		if (value(samples[i]) < value(samples[i - 1])) {
+			return false;
+		}
+	}
+	return value(samples.back()) - value(samples.front()) >= min_growth;
+}
+
+void resource_monitor_sample(struct resource_monitor *monitor, struct resource_sample sample,
+			     int log_level)
+{
+	monitor->next_sample_ns = sample.timestamp_ns + RESOURCE_MONITOR_INTERVAL_NS;
+	sample.latency_ms = monitor->latency_count > 0
+				    ? (int64_t)(monitor->latency_sum_ms / monitor->latency_count)
+				    : -1;
+	monitor->latency_sum_ms = 0;
+	monitor->latency_count = 0;
+
+	if (monitor->samples.size() >= RESOURCE_MONITOR_HISTORY) {
+		monitor->samples.erase(monitor->samples.begin());
+	}
+	monitor->samples.push_back(sample);
+
+	obs_log(log_level,
+		"resources: rss %llu MB, buffers %llu KB, backlog %llu ms, latency %lld ms",
+		(unsigned long long)(sample.rss_bytes / (1024 * 1024)),
+		(unsigned long long)(sample.buffer_bytes / 1024),
+		(unsigned long long)sample.backlog_ms, (long long)sample.latency_ms);
+
+	const std::vector<resource_sample> &samples = monitor->samples;
+	bool warned = false;
+	if (grows_steadily(
+		    samples, [](const resource_sample &s) { return s.rss_bytes; },
+		    RESOURCE_MONITOR_MIN_RSS_GROWTH)) {
+		obs_log(LOG_WARNING, "memory grew steadily from %llu to %llu MB in %d minutes",
+			(unsigned long long)(samples.front().rss_bytes / (1024 * 1024)),
+			(unsigned long long)(sample.rss_bytes / (1024 * 1024)),
+			RESOURCE_MONITOR_HISTORY);
+		warned = true;
+	}
+	if (grows_steadily(
+		    samples, [](const resource_sample &s) { return s.buffer_bytes; },
+		    RESOURCE_MONITOR_MIN_BUFFER_GROWTH)) {
+		obs_log(LOG_WARNING, "audio buffers grew steadily from %llu to %llu KB",
+			(unsigned long long)(samples.front().buffer_bytes / 1024),
+			(unsigned long long)(sample.buffer_bytes / 1024));
+		warned = true;
+	}
+	if (grows_steadily(
+		    samples, [](const resource_sample &s) { return s.backlog_ms; },
+		    RESOURCE_MONITOR_MIN_BACKLOG_GROWTH_MS)) {
+		obs_log(LOG_WARNING,
+			"transcription is falling behind, backlog grew from %llu to %llu ms",
+			(unsigned long long)samples.front().backlog_ms,
+			(unsigned long long)sample.backlog_ms);
+		warned = true;
+	}
+
+	// latency drift, from the first to the last interval with captions
+	const resource_sample *first = nullptr;
+	for (const resource_sample &s : samples) {
+		if (s.latency_ms >= 0) {
+			first = &s;
+			break;
+		}
+	}
+	if (samples.size() >= RESOURCE_MONITOR_HISTORY && first != nullptr &&
+	    sample.latency_ms - first->latency_ms >= RESOURCE_MONITOR_MIN_LATENCY_DRIFT_MS) {
+		obs_log(LOG_WARNING, "caption latency drifted from %lld to %lld ms",
+			(long long)first->latency_ms, (long long)sample.latency_ms);
+		warned = true;
+	}
+
+	if (warned) {
+		// report the same trend again only after another full history
+		monitor->samples.erase(monitor->samples.begin(), monitor->samples.end() - 1);
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef RESOURCE_MONITOR_H
+#define RESOURCE_MONITOR_H
+
+#include <cstdint>
+#include <vector>
+
+// One reading of the memory and latency of a filter
+struct resource_sample {
+	uint64_t timestamp_ns;
+	// resident size of the OBS process
+	uint64_t rss_bytes;
+	// allocated by the input and info buffers of the filter
+	uint64_t buffer_bytes;
+	// audio waiting for the whisper thread
+	uint64_t backlog_ms;
+	// mean delay from the end of a window to its caption over the last interval, -1 if none
+	int64_t latency_ms;
+};
+
+// Watches a long-running filter for memory that only ever grows and captions that fall
+// further behind the audio. Sampled once a minute by the post-processing stage, which owns it.
+struct resource_monitor {
+	// last samples, oldest first
+	std::vector<resource_sample> samples;
+	uint64_t next_sample_ns = 0;
+	uint64_t latency_sum_ms = 0;
+	uint64_t latency_count = 0;
+};
+
+// Record the delay of one caption
+void resource_monitor_add_latency(struct resource_monitor *monitor, int64_t latency_ms);
+// Whether the next sample is due at now_ns
+bool resource_monitor_due(struct resource_monitor *monitor, uint64_t now_ns);
+// Add a sample (latency_ms is filled in from the recorded delays), log it at log_level and
+// warn about steady growth
+void resource_monitor_sample(struct resource_monitor *monitor, struct resource_sample sample,
+			     int log_level);
+
+#endif // RESOURCE_MONITOR_H
@@ -0,0 +1,348 @@
+#include "session-archive.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <whisper.h>
+
+#include "plugin-support.h"
+#include "model-utils/model-registry.h"
+#include "batch/batch-transcription.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Utterances handed to the re-transcription model, kept under the 30 s whisper window
+#define ARCHIVE_MAX_UTTERANCE_MS 28000
+// Pieces closer than this are considered contiguous speech
+#define ARCHIVE_MAX_GAP_MS 100
+// Back off while OBS uses more than this share of the CPU (percent of all cores)
+#define ARCHIVE_CPU_BUSY_PERCENT 50.0
+// Threads of each whisper state, the utterances are spread over as many states as fit
+#define ARCHIVE_THREADS_PER_PROCESSOR 2
+
+static void set_current_thread_low_priority()
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__APPLE__)
+	pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+#else
+	// on Linux the nice value is per thread
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+}
+
+bool session_archive_start(struct session_archive *archive, const std::string &base_directory,
+			   uint64_t start_timestamp_ns, const std::string &subtitle_path,
+			   subtitle_format format)
+{
+	std::lock_guard<std::mutex> lock(archive->mutex);
+	if (archive->active) {
+		archive->pcm_file.close();
+		archive->index_file.close();
+	}
+	char session_name[64];
+	const std::time_t now = std::time(nullptr);
+	std::strftime(session_name, sizeof(session_name), "%Y-%m-%d %H-%M-%S",
+		      std::localtime(&now));
+	archive->directory = base_directory + "/" + session_name;
+	if (os_mkdirs(archive->directory.c_str()) < 0) {
+		obs_log(LOG_ERROR, "failed to create archive directory %s",
+			archive->directory.c_str());
+		return false;
+	}
+	archive->pcm_file.open(archive->directory + "/segments.pcm",
+			       std::ios::out | std::ios::binary | std::ios::trunc);
+	archive->index_file.open(archive->directory + "/segments.idx",
+				 std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!archive->pcm_file.is_open() || !archive->index_file.is_open()) {
+		obs_log(LOG_ERROR, "failed to open archive files in %s",
+			archive->directory.c_str());
+		archive->pcm_file.close();
+		archive->index_file.close();
+		return false;
+	}
+	archive->start_timestamp_ns = start_timestamp_ns;
+	archive->last_end_timestamp_ns = start_timestamp_ns;
+	archive->samples_written = 0;
+	archive->subtitle_path = subtitle_path;
+	archive->format = format;
+	archive->active = true;
+	obs_log(LOG_INFO, "archiving session speech to %s", archive->directory.c_str());
+	return true;
+}
+
+void session_archive_add_speech(struct session_archive *archive, const float *pcm16k,
+				size_t n_samples, uint64_t start_timestamp_ns)
+{
+	std::lock_guard<std::mutex> lock(archive->mutex);
+	if (!archive->active) {
+		return;
+	}
+
+	// skip the part of the window that was already archived with the previous one
+	size_t skip = 0;
+	if (start_timestamp_ns < archive->last_end_timestamp_ns) {
+		skip = (size_t)((archive->last_end_timestamp_ns - start_timestamp_ns) *
+				WHISPER_SAMPLE_RATE / 1000000000);
+	}
+	if (skip >= n_samples) {
+		return;
+	}
+
+	std::vector<int16_t> pcm16(n_samples - skip);
+	for (size_t i = skip; i < n_samples; i++) {
+		const float v = std::min(1.0f, std::max(-1.0f, pcm16k[i]));
+		pcm16[i - skip] = (int16_t)(v * 32767.0f);
+	}
+
+	const uint64_t piece_start_ns =
+		start_timestamp_ns + (uint64_t)skip * 1000000000 / WHISPER_SAMPLE_RATE;
+	session_archive_segment segment;
+	segment.start_ms = (int64_t)(piece_start_ns - std::min(piece_start_ns,
+								archive->start_timestamp_ns)) /
+			   1000000;
+	segment.sample_offset = archive->samples_written;
+	segment.n_samples = (uint32_t)pcm16.size();
+
+	archive->pcm_file.write((const char *)pcm16.data(),
+				(std::streamsize)(pcm16.size() * sizeof(int16_t)));
+	archive->index_file.write((const char *)&segment, sizeof(segment));
+	archive->samples_written += pcm16.size();
+	archive->last_end_timestamp_ns =
+		start_timestamp_ns + (uint64_t)n_samples * 1000000000 / WHISPER_SAMPLE_RATE;
+}
+
+static bool retranscribe_encoder_begin(struct whisper_context *, struct whisper_state *,
+				       void *user_data)
+{
+	// returning false aborts whisper_full
+	return !static_cast<std::atomic<bool> *>(user_data)->load();
+}
+
+static void retranscribe_session(std::atomic<bool> *abort, std::string directory,
+				 std::string subtitle_path, subtitle_format format,
+				 std::string model_file_path, std::string language)
+{
+	set_current_thread_low_priority();
+
+	// read back the index and the samples
+	std::vector<session_archive_segment> segments;
+	{
+		std::ifstream index_file(directory + "/segments.idx", std::ios::binary);
+		session_archive_segment segment;
+		while (index_file.read((char *)&segment, sizeof(segment))) {
+			segments.push_back(segment);
+		}
+	}
+	if (segments.empty()) {
+		obs_log(LOG_INFO, "archive %s has no speech, nothing to re-transcribe",
+			directory.c_str());
+		return;
+	}
+	std::vector<int16_t> pcm16;
+	{
+		std::ifstream pcm_file(directory + "/segments.pcm", std::ios::binary);
+		const uint64_t total = segments.back().sample_offset + segments.back().n_samples;
+		pcm16.resize(total);
+		pcm_file.read((char *)pcm16.data(), (std::streamsize)(total * sizeof(int16_t)));
+		pcm16.resize((size_t)pcm_file.gcount() / sizeof(int16_t));
+	}
+
+	// join contiguous pieces into utterances, cut at the pauses between them. The utterances
+	// are transcribed in parallel, on half of the cores so OBS keeps the others.
+	std::vector<batch_audio_chunk> chunks;
+	size_t i = 0;
+	while (i < segments.size()) {
+		size_t j = i + 1;
+		int64_t end_ms = segments[i].start_ms +
+				 (int64_t)segments[i].n_samples * 1000 / WHISPER_SAMPLE_RATE;
+		while (j < segments.size() && segments[j].start_ms - end_ms < ARCHIVE_MAX_GAP_MS) {
+			const int64_t next_end_ms =
+				segments[j].start_ms +
+				(int64_t)segments[j].n_samples * 1000 / WHISPER_SAMPLE_RATE;
+			if (next_end_ms - segments[i].start_ms > ARCHIVE_MAX_UTTERANCE_MS) {
+				break;
+			}
+			end_ms = next_end_ms;
+			j++;
+		}
+		const session_archive_segment &last = segments[j - 1];
+		chunks.push_back({(size_t)segments[i].sample_offset,
+				  (size_t)(last.sample_offset + last.n_samples),
+				  segments[i].start_ms});
+		i = j;
+	}
+	std::vector<float> pcm32f(pcm16.size());
+	for (size_t k = 0; k < pcm16.size(); k++) {
+		pcm32f[k] = (float)pcm16[k] / 32768.0f;
+	}
+	std::vector<int16_t>().swap(pcm16);
+
+	struct whisper_context *ctx = model_registry_acquire(model_file_path);
+	if (ctx == nullptr) {
+		obs_log(LOG_ERROR, "failed to load re-transcription model %s",
+			model_file_path.c_str());
+		return;
+	}
+
+	const int n_cores = std::max(1, (int)std::thread::hardware_concurrency() / 2);
+	const int n_threads_per_processor = std::min(n_cores, ARCHIVE_THREADS_PER_PROCESSOR);
+	whisper_full_params params = whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH);
+	params.language = language.c_str();
+	params.n_threads = n_threads_per_processor;
+	params.no_context = true;
+	params.print_progress = false;
+	params.print_realtime = false;
+	params.suppress_non_speech_tokens = true;
+	params.encoder_begin_callback = retranscribe_encoder_begin;
+	params.encoder_begin_callback_user_data = abort;
+
+	// stay out of the way while OBS is busy. The usage includes our own inference, workers
+	// queue up on cpu_mutex before their next utterance while one of them waits, so our load
+	// drains and only OBS keeps the usage above the limit.
+	os_cpu_usage_info_t *cpu_info = os_cpu_usage_info_start();
+	std::mutex cpu_mutex;
+	auto wait_for_idle_cpu = [&](size_t) {
+		// worker threads do not inherit the priority everywhere
+		set_current_thread_low_priority();
+		std::lock_guard<std::mutex> lock(cpu_mutex);
+		while (!*abort && os_cpu_usage_info_query(cpu_info) > ARCHIVE_CPU_BUSY_PERCENT) {
+			os_sleep_ms(500);
+		}
+		return !*abort;
+	};
+	os_cpu_usage_info_query(cpu_info);
+	os_sleep_ms(200);
+
+	std::vector<subtitle_cue> cues;
+	std::string error;
+	const auto start = std::chrono::high_resolution_clock::now();
+	const bool ok = batch_transcribe_chunks(ctx, pcm32f, chunks, params,
+						n_cores / n_threads_per_processor, cues, error,
+						nullptr, wait_for_idle_cpu);
+	os_cpu_usage_info_destroy(cpu_info);
+	model_registry_release(ctx);
+
+	if (*abort) {
+		obs_log(LOG_INFO, "re-transcription of %s aborted", directory.c_str());
+		return;
+	}
+	if (!ok) {
+		obs_log(LOG_ERROR, "re-transcription of %s failed: %s", directory.c_str(),
+			error.c_str());
+		return;
+	}
+
+	const double elapsed_sec =
+		std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start)
+			.count();
+	obs_log(LOG_INFO, "re-transcribed %.1f sec of speech in %.1f sec on %d processors",
+		(double)pcm32f.size() / WHISPER_SAMPLE_RATE, elapsed_sec,
+		std::min(n_cores / n_threads_per_processor, (int)chunks.size()));
+
+	const std::string archive_subtitle_path =
+		directory + (format == SUBTITLE_FORMAT_VTT ? "/transcript.vtt" : "/transcript.srt");
+	write_subtitle_file(archive_subtitle_path, cues, format);
+	if (!subtitle_path.empty()) {
+		// replace the live subtitles atomically so players never see a partial file
+		const std::string tmp_path = subtitle_path + ".tmp";
+		std::error_code ec;
+		if (write_subtitle_file(tmp_path, cues, format)) {
+			std::filesystem::rename(tmp_path, subtitle_path, ec);
+		}
+		if (ec) {
+			obs_log(LOG_ERROR, "failed to replace %s: %s", subtitle_path.c_str(),
+				ec.message().c_str());
+		} else {
+			obs_log(LOG_INFO, "replaced %s with the re-transcribed text",
+				subtitle_path.c_str());
+		}
+	}
+}
+
+static void retranscribe_worker(struct session_archive *archive)
+{
+	for (;;) {
+		session_archive_job job;
+		{
+			std::lock_guard<std::mutex> lock(archive->mutex);
+			if (archive->pending.empty() || archive->abort_retranscribe) {
+				archive->retranscribe_running = false;
+				return;
+			}
+			job = archive->pending.front();
+			archive->pending.pop_front();
+		}
+		retranscribe_session(&archive->abort_retranscribe, job.directory, job.subtitle_path,
+				     job.format, job.model_file_path, job.language);
+	}
+}
+
+void session_archive_finish(struct session_archive *archive, const std::string &model_file_path,
+			    const std::string &language)
+{
+	// the previous worker has left its loop, it is joined once the lock is released
+	std::thread finished_thread;
+	{
+		std::lock_guard<std::mutex> lock(archive->mutex);
+		if (!archive->active) {
+			return;
+		}
+		archive->active = false;
+		archive->pcm_file.close();
+		archive->index_file.close();
+		if (model_file_path.empty()) {
+			return;
+		}
+
+		archive->pending.push_back({archive->directory, archive->subtitle_path,
+					    archive->format, model_file_path, language});
+		if (!archive->retranscribe_running) {
+			archive->retranscribe_running = true;
+			archive->abort_retranscribe = false;
+			finished_thread.swap(archive->retranscribe_thread);
+			archive->retranscribe_thread = std::thread(retranscribe_worker, archive);
+		} else {
+			obs_log(LOG_INFO, "re-transcription of %s queued behind %d session(s)",
+				archive->directory.c_str(), (int)archive->pending.size() - 1);
+		}
+	}
+	if (finished_thread.joinable()) {
+		finished_thread.join();
+	}
+}
+
+void session_archive_shutdown(struct session_archive *archive)
+{
+	std::thread thread;
+	{
+		std::lock_guard<std::mutex> lock(archive->mutex);
+		archive->abort_retranscribe = true;
+		archive->pending.clear();
+		thread.swap(archive->retranscribe_thread);
+	}
+	if (thread.joinable()) {
+		thread.join();
+	}
+	std::lock_guard<std::mutex> lock(archive->mutex);
+	if (archive->active) {
+		archive->active = false;
+		archive->pcm_file.close();
+		archive->index_file.close();
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef SESSION_ARCHIVE_H
+#define SESSION_ARCHIVE_H
+
+#include "subtitle-format.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Record in segments.idx, one per archived piece of 16 kHz speech
+struct session_archive_segment {
+	// start of the piece relative to the session start
+	int64_t start_ms;
+	// offset and length in samples within segments.pcm
+	uint64_t sample_offset;
+	uint32_t n_samples;
+};
+
+// A closed session waiting for re-transcription
+struct session_archive_job {
+	std::string directory;
+	std::string subtitle_path;
+	subtitle_format format;
+	std::string model_file_path;
+	std::string language;
+};
+
+// Retains the speech of a streaming/recording session on disk as 16-bit 16 kHz PCM,
+// so it can be re-transcribed with a larger model once the session is over.
+struct session_archive {
+	std::mutex mutex;
+	bool active = false;
+	std::string directory;
+	std::ofstream pcm_file;
+	std::ofstream index_file;
+	uint64_t start_timestamp_ns = 0;
+	// end of the last archived sample, windows overlap so earlier audio is skipped
+	uint64_t last_end_timestamp_ns = 0;
+	uint64_t samples_written = 0;
+	// subtitle file to replace with the re-transcribed text, may be empty
+	std::string subtitle_path;
+	subtitle_format format = SUBTITLE_FORMAT_SRT;
+
+	// closed sessions are re-transcribed one after the other by retranscribe_thread, which
+	// exits once the queue is empty. Both are guarded by mutex.
+	std::deque<session_archive_job> pending;
+	bool retranscribe_running = false;
+	std::thread retranscribe_thread;
+	std::atomic<bool> abort_retranscribe{false};
+};
+
+// Open a new session directory under base_directory
+bool session_archive_start(struct session_archive *archive, const std::string &base_directory,
+			   uint64_t start_timestamp_ns, const std::string &subtitle_path,
+			   subtitle_format format);
+// Append a 16 kHz speech window starting at the clock-domain timestamp start_timestamp_ns
+void session_archive_add_speech(struct session_archive *archive, const float *pcm16k,
+				size_t n_samples, uint64_t start_timestamp_ns);
+// Close the session and queue it for re-transcription on a low priority thread with the
+// given model. Never waits for a running re-transcription. An empty model path only closes it.
+void session_archive_finish(struct session_archive *archive, const std::string &model_file_path,
+			    const std::string &language);
+// Abort a running re-transcription and wait for it to exit
+void session_archive_shutdown(struct session_archive *archive);
+
+#endif // SESSION_ARCHIVE_H
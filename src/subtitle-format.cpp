@@ -0,0 +1,68 @@
+#include "subtitle-format.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+
+std::string format_subtitle_timestamp(int64_t ms, subtitle_format format)
+{
+	if (ms < 0) {
+		ms = 0;
+	}
+	const int64_t hours = ms / 3600000;
+	const int64_t minutes = (ms / 60000) % 60;
+	const int64_t seconds = (ms / 1000) % 60;
+	const int64_t millis = ms % 1000;
+
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%02d:%02d:%02d%c%03d", (int)hours, (int)minutes, (int)seconds,
+		 format == SUBTITLE_FORMAT_VTT ? '.' : ',', (int)millis);
+	return std::string(buf);
+}
+
+std::string subtitle_file_header(subtitle_format format)
+{
+	if (format == SUBTITLE_FORMAT_VTT) {
+		return "WEBVTT\n\n";
+	}
+	return "";
+}
+
+std::string format_subtitle_cue(const subtitle_cue &cue, size_t index, subtitle_format format)
+{
+	std::string out;
+	if (format == SUBTITLE_FORMAT_SRT) {
+		out += std::to_string(index) + "\n";
+	}
+	out += format_subtitle_timestamp(cue.start_ms, format) + " --> " +
+	       format_subtitle_timestamp(std::max(cue.end_ms, cue.start_ms), format) + "\n";
+	out += cue.text + "\n\n";
+	return out;
+}
+
+subtitle_format subtitle_format_from_path(const std::string &path)
+{
+	const size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) {
+		return SUBTITLE_FORMAT_SRT;
+	}
+	std::string ext = path.substr(dot + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == "vtt" ? SUBTITLE_FORMAT_VTT : SUBTITLE_FORMAT_SRT;
+}
+
+bool write_subtitle_file(const std::string &path, const std::vector<subtitle_cue> &cues,
+			 subtitle_format format)
+{
+	std::ofstream output_file(path, std::ios::out | std::ios::trunc);
+	if (!output_file.is_open()) {
+		return false;
+	}
+	output_file << subtitle_file_header(format);
+	for (size_t i = 0; i < cues.size(); i++) {
+		output_file << format_subtitle_cue(cues[i], i + 1, format);
+	}
+	output_file.close();
+	return !output_file.fail();
+}
@@ -0,0 +1,31 @@
+#ifndef SUBTITLE_FORMAT_H
+#define SUBTITLE_FORMAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum subtitle_format {
+	SUBTITLE_FORMAT_SRT = 0,
+	SUBTITLE_FORMAT_VTT = 1,
+};
+
+struct subtitle_cue {
+	int64_t start_ms;
+	int64_t end_ms;
+	std::string text;
+};
+
+// Format a timestamp in ms as "HH:MM:SS,mmm" (SRT) or "HH:MM:SS.mmm" (VTT)
+std::string format_subtitle_timestamp(int64_t ms, subtitle_format format);
+// Text that must precede the first cue in the file (empty for SRT)
+std::string subtitle_file_header(subtitle_format format);
+// Format a single cue, index is 1-based and only used for SRT
+std::string format_subtitle_cue(const subtitle_cue &cue, size_t index, subtitle_format format);
+// Pick the format from a file name extension, defaults to SRT
+subtitle_format subtitle_format_from_path(const std::string &path);
+// Write a complete subtitle file, returns false on I/O error
+bool write_subtitle_file(const std::string &path, const std::vector<subtitle_cue> &cues,
+			 subtitle_format format);
+
+#endif // SUBTITLE_FORMAT_H
@@ -0,0 +1,49 @@
+#include "token-budget.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+// room for fast bursts above the average rate
+#define TOKEN_BUDGET_MARGIN 1.5f
+// timestamps and punctuation not covered by the word rate
+#define TOKEN_BUDGET_EXTRA_TOKENS 4
+#define TOKEN_BUDGET_MIN_TOKENS 8
+// windows shorter than this say little about the speech rate
+#define TOKEN_BUDGET_MIN_LEARN_MS 1000
+
+int token_budget_for_window(const struct token_budget *budget, int speech_ms, int max_tokens)
+{
+	const float expected_tokens = (float)speech_ms / 1000.0f * budget->words_per_sec *
+				      budget->tokens_per_word * TOKEN_BUDGET_MARGIN;
+	int tokens = std::max(TOKEN_BUDGET_MIN_TOKENS,
+			      (int)ceilf(expected_tokens) + TOKEN_BUDGET_EXTRA_TOKENS);
+	if (max_tokens > 0) {
+		tokens = std::min(tokens, max_tokens);
+	}
+	return tokens;
+}
+
+void token_budget_update(struct token_budget *budget, const std::string &text, int n_tokens,
+			 int speech_ms)
+{
+	int words = 0;
+	bool in_word = false;
+	for (unsigned char c : text) {
+		const bool space = std::isspace(c) != 0;
+		if (!space && !in_word) {
+			words++;
+		}
+		in_word = !space;
+	}
+	if (words == 0 || speech_ms < TOKEN_BUDGET_MIN_LEARN_MS) {
+		return;
+	}
+	const float words_per_sec = (float)words * 1000.0f / (float)speech_ms;
+	budget->words_per_sec += 0.2f * (std::min(words_per_sec, 6.0f) - budget->words_per_sec);
+	budget->words_per_sec = std::max(budget->words_per_sec, 0.5f);
+	if (n_tokens > 0) {
+		const float tokens_per_word = std::min((float)n_tokens / (float)words, 4.0f);
+		budget->tokens_per_word += 0.2f * (tokens_per_word - budget->tokens_per_word);
+	}
+}
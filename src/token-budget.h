@@ -0,0 +1,20 @@
+#ifndef TOKEN_BUDGET_H
+#define TOKEN_BUDGET_H
+
+#include <cstddef>
+#include <string>
+
+// Running estimate of how fast the speaker talks, used to size max_tokens per window
+// so a runaway decode is cut short while normal speech still fits.
+struct token_budget {
+	float words_per_sec = 2.5f;
+	float tokens_per_word = 1.5f;
+};
+
+// Token limit for a window of speech_ms milliseconds, capped by max_tokens (0 = no cap)
+int token_budget_for_window(const struct token_budget *budget, int speech_ms, int max_tokens);
+// Learn from a decoded window. n_tokens is the number of text tokens, or -1 if unknown.
+void token_budget_update(struct token_budget *budget, const std::string &text, int n_tokens,
+			 int speech_ms);
+
+#endif // TOKEN_BUDGET_H
@@ -8,14 +8,36 @@
 
 #include <whisper.h>
 
+#include "whisper-processing.h"
+#include "recording-sidecar.h"
+#include "session-archive.h"
+#include "language-router.h"
+#include "channel-mixer.h"
+#include "ingest-kernels.h"
+#include "transcription-stats.h"
+#include "token-budget.h"
+#include "voice-command.h"
+#include "ngram-lm.h"
+#include "utterance-endpointer.h"
+#include "wake-word.h"
+#include "clock-domain.h"
+#include "resource-monitor.h"
+#include "power-profile.h"
+#include "input-quality.h"
+#include "metrics-server.h"
+#include "worker/inference-worker.h"
+#include "worker/remote-worker.h"
+
+#include <atomic>
 #include <thread>
 #include <memory>
 #include <mutex>
+#include <vector>
 #include <condition_variable>
 #include <functional>
 #include <string>
 
-#define MAX_PREPROC_CHANNELS 2
+#define MAX_PREPROC_CHANNELS MAX_AUDIO_CHANNELS
 
 #define MT_ obs_module_text
 
@@ -23,31 +45,105 @@ struct transcription_filter_data {
 	obs_source_t *context; // obs input source
 	size_t channels;       // number of channels
 	uint32_t sample_rate;  // input sample rate
-	// How many input frames (in input sample rate) are needed for the next whisper frame
+	// Input frames (in input sample rate) of one whisper window, the most a chunk can hold
 	size_t frames;
-	// How many ms/frames are needed to overlap with the next whisper frame
-	size_t overlap_frames;
+	// How many ms are needed to overlap with the next whisper frame
 	size_t overlap_ms;
-	// How many frames were processed in the last whisper frame (this is dynamic)
-	size_t last_num_frames;
+	// start the next window at the last sure word boundary instead of the fixed overlap
+	bool word_boundary_carry;
+	// audio at the end of the last window holding its unfinished words, -1 to use the
+	// fixed overlap when the window had no word timing
+	int word_carry_ms;
+	// caption of the carried words as decoded in the last window, empty if none
+	struct DetectionResultWithText *carried_hypothesis = nullptr;
 
 	/* PCM buffers */
 	float *copy_buffers[MAX_PREPROC_CHANNELS];
 	struct circlebuf info_buffer;
 	struct circlebuf input_buffers[MAX_PREPROC_CHANNELS];
+	// timeline the packet timestamps in info_buffer are placed on
+	struct clock_domain *clock_domain = nullptr;
+
+	/* Mono analysis signal at the input sample rate */
+	struct channel_mixer channel_mixer;
+	float *mono_buffer;
+	// input frames of dropped silent chunks not yet counted as a whole 16 kHz sample, in
+	// units of 1 / (sample_rate * 16000) s
+	uint64_t silent_remainder;
+	// 16 kHz output of ingest_kernels.resample
+	float *resample_buffer;
+	struct decimator_state decimator;
+	// specialized for the channel count and sample rate at create time
+	struct ingest_kernels ingest_kernels;
 
 	/* Resampler */
 	audio_resampler_t *resampler = nullptr;
 
 	/* whisper */
 	std::string whisper_model_path = "models/ggml-tiny.en.bin";
+	// the context comes from the model registry and may be shared with other filters, states
+	// are borrowed from its pool for each inference
 	struct whisper_context *whisper_context = nullptr;
 	whisper_full_params whisper_params;
+	// text tokens of the previous windows, the prompt when no_context is off
+	std::vector<whisper_token> *prompt_past = nullptr;
+	// encode only the window instead of whisper's 30 s context
+	bool window_audio_ctx;
+	// Where inference runs, the model is loaded either in OBS or in the worker process
+	InferenceBackend inference_backend;
+	struct inference_worker *inference_worker = nullptr;
+	// decode time of the worker per audio time, averaged over its windows, 0 until one is
+	// timed. Sets how long a window may take before the worker counts as hung.
+	float worker_rtf;
+	std::string remote_worker_address;
+	struct remote_worker *remote_worker = nullptr;
+	// set with whisper_ctx_mutex held when the backend starts and stops, read without it by
+	// the preprocess loop and the audio callback
+	std::atomic<bool> backend_ready;
+	// per-language models used with the "auto" language
+	struct language_router *language_router = nullptr;
+	struct transcription_stats *stats = nullptr;
+	// memory and latency trends of long sessions, owned by the post-processing stage
+	struct resource_monitor *resource_monitor = nullptr;
+	// size max_tokens per window from its length and the speech rate
+	bool adaptive_max_tokens;
+	struct token_budget *token_budget = nullptr;
+	// n-gram model fused with the decoder, loaded in the background when lm_path changes
+	struct lm_fusion *lm_fusion = nullptr;
+	// fewer threads, greedy decoding, a stricter VAD and optionally a smaller model while the
+	// machine runs on battery or hot, polled by the inference stage
+	bool low_power_profile;
+	bool low_power = false;
+	struct power_profile *power_profile = nullptr;
+	// empty to keep the whisper model. Loaded on low_power_load_thread when configured and
+	// swapped in under whisper_ctx_mutex, which also guards the requested path and loading.
+	std::string low_power_requested_path;
+	bool low_power_loading;
+	std::thread low_power_load_thread;
+	struct whisper_context *low_power_context = nullptr;
+	// raise the VAD threshold with the noise floor and decode poor input in low power
+	bool input_quality_policy;
+	struct input_quality_monitor *input_quality_monitor = nullptr;
+
+	// recognize the phrases of voice_commands instead of transcribing
+	bool command_mode;
+	std::string voice_commands;
+	struct voice_command_grammar *voice_command_grammar = nullptr;
+	struct utterance_endpointer *voice_command_endpointer = nullptr;
+	// transcribe only for wake_word_listen_sec after the wake word
+	bool wake_word_enabled;
+	int wake_word_listen_sec;
+	struct wake_word_spotter *wake_word = nullptr;
+	// port of the metrics server the filter is registered with, 0 if none
+	int metrics_port;
 
 	float filler_p_threshold;
 
 	bool do_silence;
 	bool vad_enabled;
+	// cut pauses longer than silence_compression_min_ms out of each window
+	bool silence_compression;
+	int silence_compression_min_ms;
 	int log_level;
 	bool log_words;
 	bool caption_to_stream;
@@ -61,6 +157,16 @@ struct transcription_filter_data {
 	std::function<void(const std::string &str)> setTextCallback;
 	// Output file path to write the subtitles
 	std::string output_file_path;
+	// Subtitle file written next to OBS recordings
+	bool recording_sidecar_enabled;
+	subtitle_format recording_sidecar_format;
+	struct recording_sidecar *recording_sidecar = nullptr;
+	// Session speech retained for re-transcription with a larger model
+	bool archive_enabled;
+	bool archive_started_by_recording;
+	std::string archive_model_path;
+	std::string language;
+	struct session_archive *session_archive = nullptr;
 
 	// Use std for thread and mutex
 	std::thread whisper_thread;
@@ -74,8 +180,11 @@ struct transcription_filter_data {
 struct transcription_filter_audio_info {
 	uint32_t frames;
 	uint64_t timestamp;
+	// largest absolute sample over all channels, for the ingest silence check
+	float peak;
 };
 
-void set_text_callback(struct transcription_filter_data *gf, const std::string &str);
+void set_text_callback(struct transcription_filter_data *gf,
+		       const DetectionResultWithText &result);
 
 #endif /* TRANSCRIPTION_FILTER_DATA_H */
@@ -1,5 +1,6 @@
 #include <obs-module.h>
 #include <obs-frontend-api.h>
+#include <util/platform.h>
 
 #include "plugin-support.h"
 #include "transcription-filter.h"
@@ -7,6 +8,7 @@
 #include "whisper-processing.h"
 #include "whisper-language.h"
 #include "model-utils/model-downloader.h"
+#include "model-utils/model-registry.h"
 
 #include <algorithm>
 #include <fstream>
@@ -49,6 +51,98 @@ bool add_sources_to_list(void *list_property, obs_source_t *source)
 	return true;
 }
 
+void start_recording_sidecar(struct transcription_filter_data *gf)
+{
+	obs_output_t *recording_output = obs_frontend_get_recording_output();
+	if (!recording_output) {
+		obs_log(LOG_ERROR, "recording output is null");
+		return;
+	}
+	obs_data_t *output_settings = obs_output_get_settings(recording_output);
+	std::string recording_path = obs_data_get_string(output_settings, "path");
+	if (recording_path.empty()) {
+		// custom ffmpeg output
+		recording_path = obs_data_get_string(output_settings, "url");
+	}
+	obs_data_release(output_settings);
+	obs_output_release(recording_output);
+	if (recording_path.empty()) {
+		obs_log(LOG_ERROR, "cannot determine the recording path");
+		return;
+	}
+	// cues are placed on the clock-domain timeline of the audio
+	recording_sidecar_start(gf->recording_sidecar, recording_path,
+				gf->recording_sidecar_format, clock_domain_now(gf->clock_domain));
+}
+
+void start_session_archive(struct transcription_filter_data *gf, bool by_recording)
+{
+	char *archive_dir = obs_module_config_path("archive");
+	if (archive_dir == nullptr) {
+		obs_log(LOG_ERROR, "cannot determine the archive directory");
+		return;
+	}
+	// re-transcribed text replaces the recording subtitles when they are written
+	std::string subtitle_path;
+	{
+		std::lock_guard<std::mutex> lock(gf->recording_sidecar->mutex);
+		if (by_recording && gf->recording_sidecar->active) {
+			subtitle_path = gf->recording_sidecar->path;
+		}
+	}
+	const uint64_t start_timestamp = subtitle_path.empty()
+						 ? clock_domain_now(gf->clock_domain)
+						 : gf->recording_sidecar->start_timestamp_ns;
+	if (session_archive_start(gf->session_archive, archive_dir, start_timestamp, subtitle_path,
+				  gf->recording_sidecar_format)) {
+		gf->archive_started_by_recording = by_recording;
+	}
+	bfree(archive_dir);
+}
+
+void finish_session_archive(struct transcription_filter_data *gf)
+{
+	char *model_file_path = obs_module_file(gf->archive_model_path.c_str());
+	if (model_file_path == nullptr) {
+		obs_log(LOG_ERROR, "re-transcription model %s not found, download it first",
+			gf->archive_model_path.c_str());
+		// keeps the archive on disk without waiting for other sessions
+		session_archive_finish(gf->session_archive, "", gf->language);
+		return;
+	}
+	session_archive_finish(gf->session_archive, model_file_path, gf->language);
+	bfree(model_file_path);
+}
+
+// Follow recording and streaming for the subtitle sidecar and the session archive
+void frontend_event_callback(enum obs_frontend_event event, void *data)
+{
+	struct transcription_filter_data *gf =
+		static_cast<struct transcription_filter_data *>(data);
+	const bool archive_active = gf->session_archive->active;
+	if (event == OBS_FRONTEND_EVENT_RECORDING_STARTED) {
+		if (gf->recording_sidecar_enabled) {
+			start_recording_sidecar(gf);
+		}
+		if (gf->archive_enabled && !archive_active) {
+			start_session_archive(gf, true);
+		}
+	} else if (event == OBS_FRONTEND_EVENT_STREAMING_STARTED) {
+		if (gf->archive_enabled && !archive_active) {
+			start_session_archive(gf, false);
+		}
+	} else if (event == OBS_FRONTEND_EVENT_RECORDING_STOPPED) {
+		recording_sidecar_stop(gf->recording_sidecar);
+		if (archive_active && gf->archive_started_by_recording) {
+			finish_session_archive(gf);
+		}
+	} else if (event == OBS_FRONTEND_EVENT_STREAMING_STOPPED) {
+		if (archive_active && !gf->archive_started_by_recording) {
+			finish_session_archive(gf);
+		}
+	}
+}
+
 struct obs_audio_data *transcription_filter_filter_audio(void *data, struct obs_audio_data *audio)
 {
 	if (!audio) {
@@ -65,7 +159,7 @@ struct obs_audio_data *transcription_filter_filter_audio(void *data, struct obs_
 		return audio;
 	}
 
-	if (gf->whisper_context == nullptr) {
+	if (!inference_backend_ready(gf)) {
 		// Whisper not initialized, just pass through
 		return audio;
 	}
@@ -81,14 +175,15 @@ struct obs_audio_data *transcription_filter_filter_audio(void *data, struct obs_
 			"pushing %lu frames to input buffer. current size: %lu (bytes)",
 			(size_t)(audio->frames), gf->input_buffers[0].size);
 		// push back current audio data to input circlebuf
-		for (size_t c = 0; c < gf->channels; c++) {
-			circlebuf_push_back(&gf->input_buffers[c], audio->data[c],
-					    audio->frames * sizeof(float));
-		}
+		const float peak = gf->ingest_kernels.push(gf->input_buffers, gf->channels,
+							   audio->data, audio->frames);
 		// push audio packet info (timestamp/frame count) to info circlebuf
 		struct transcription_filter_audio_info info = {0};
 		info.frames = audio->frames;       // number of frames in this packet
-		info.timestamp = audio->timestamp; // timestamp of this packet
+		// timestamp of this packet, corrected for jitter, jumps and drift
+		info.timestamp =
+			clock_domain_push(gf->clock_domain, audio->timestamp, audio->frames);
+		info.peak = peak;
 		circlebuf_push_back(&gf->info_buffer, &info, sizeof(info));
 	}
 
@@ -107,13 +202,24 @@ void transcription_filter_destroy(void *data)
 		static_cast<struct transcription_filter_data *>(data);
 
 	obs_log(gf->log_level, "transcription_filter_destroy");
+	obs_frontend_remove_event_callback(frontend_event_callback, gf);
+	if (gf->metrics_port != 0) {
+		metrics_server_unregister(gf->stats);
+	}
+	recording_sidecar_stop(gf->recording_sidecar);
+	session_archive_shutdown(gf->session_archive);
+	language_router_wait(gf->language_router);
+	lm_fusion_wait(gf->lm_fusion);
+	low_power_model_wait(gf);
 	{
 		std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
-		if (gf->whisper_context != nullptr) {
-			whisper_free(gf->whisper_context);
-			gf->whisper_context = nullptr;
+		if (inference_backend_ready(gf)) {
+			stop_inference_backend(gf);
 			gf->wshiper_thread_cv->notify_all();
 		}
+		language_router_clear(gf->language_router);
+		model_registry_release(gf->low_power_context);
+		gf->low_power_context = nullptr;
 	}
 
 	// join the thread
@@ -139,6 +245,10 @@ void transcription_filter_destroy(void *data)
 		std::lock_guard<std::mutex> lockbuf(*gf->whisper_buf_mutex);
 		bfree(gf->copy_buffers[0]);
 		gf->copy_buffers[0] = nullptr;
+		bfree(gf->mono_buffer);
+		gf->mono_buffer = nullptr;
+		bfree(gf->resample_buffer);
+		gf->resample_buffer = nullptr;
 		for (size_t i = 0; i < gf->channels; i++) {
 			circlebuf_free(&gf->input_buffers[i]);
 		}
@@ -149,6 +259,22 @@ void transcription_filter_destroy(void *data)
 	delete gf->whisper_ctx_mutex;
 	delete gf->wshiper_thread_cv;
 	delete gf->text_source_mutex;
+	delete gf->recording_sidecar;
+	delete gf->session_archive;
+	delete gf->language_router;
+	delete gf->stats;
+	delete gf->token_budget;
+	delete gf->clock_domain;
+	delete gf->resource_monitor;
+	delete gf->power_profile;
+	delete gf->input_quality_monitor;
+	delete gf->prompt_past;
+	delete gf->carried_hypothesis;
+	lm_fusion_free(gf->lm_fusion);
+	delete gf->lm_fusion;
+	delete gf->voice_command_grammar;
+	delete gf->voice_command_endpointer;
+	delete gf->wake_word;
 
 	bfree(gf);
 }
@@ -176,8 +302,15 @@ void acquire_weak_text_source_ref(struct transcription_filter_data *gf)
 	}
 }
 
-void set_text_callback(struct transcription_filter_data *gf, const std::string &str)
+void set_text_callback(struct transcription_filter_data *gf,
+		       const DetectionResultWithText &result)
 {
+	const std::string &str = result.text;
+	if (gf->recording_sidecar_enabled && result.result == DETECTION_RESULT_SPEECH &&
+	    result.end_timestamp_ns > 0) {
+		recording_sidecar_add_cue(gf->recording_sidecar, result.start_timestamp_ns,
+					  result.end_timestamp_ns, str);
+	}
 	if (gf->caption_to_stream) {
 		obs_output_t *streaming_output = obs_frontend_get_streaming_output();
 		if (streaming_output) {
@@ -215,6 +348,7 @@ void set_text_callback(struct transcription_filter_data *gf, const std::string &
 		auto text_settings = obs_source_get_settings(target);
 		obs_data_set_string(text_settings, "text", str.c_str());
 		obs_source_update(target, text_settings);
+		obs_data_release(text_settings);
 		obs_source_release(target);
 	}
 };
@@ -227,8 +361,18 @@ void transcription_filter_update(void *data, obs_data_t *s)
 	obs_log(gf->log_level, "transcription_filter_update");
 	gf->log_level = (int)obs_data_get_int(s, "log_level");
 	gf->vad_enabled = obs_data_get_bool(s, "vad_enabled");
+	gf->input_quality_policy = obs_data_get_bool(s, "input_quality_policy");
+	gf->silence_compression = obs_data_get_bool(s, "silence_compression");
+	gf->silence_compression_min_ms = (int)obs_data_get_int(s, "silence_compression_min_ms");
+	gf->word_boundary_carry = obs_data_get_bool(s, "word_boundary_carry");
 	gf->log_words = obs_data_get_bool(s, "log_words");
+	gf->channel_mixer.selection = (int)obs_data_get_int(s, "channel_selection");
 	gf->caption_to_stream = obs_data_get_bool(s, "caption_to_stream");
+	gf->recording_sidecar_enabled = obs_data_get_bool(s, "recording_sidecar");
+	gf->recording_sidecar_format =
+		(subtitle_format)obs_data_get_int(s, "recording_sidecar_format");
+	gf->archive_enabled = obs_data_get_bool(s, "archive_enabled");
+	gf->archive_model_path = obs_data_get_string(s, "archive_model_path");
 
 	obs_log(gf->log_level, "transcription_filter: update text source");
 	// update the text source
@@ -292,25 +436,31 @@ void transcription_filter_update(void *data, obs_data_t *s)
 	obs_log(gf->log_level, "transcription_filter: update whisper model");
 	// update the whisper model path
 	std::string new_model_path = obs_data_get_string(s, "whisper_model_path");
-
-	if (new_model_path != gf->whisper_model_path) {
-		// model path changed, reload the model
+	const InferenceBackend new_backend =
+		(InferenceBackend)obs_data_get_int(s, "inference_backend");
+	const std::string new_remote_address = obs_data_get_string(s, "remote_worker_address");
+
+	if (new_model_path != gf->whisper_model_path || new_backend != gf->inference_backend ||
+	    (new_backend == INFERENCE_BACKEND_REMOTE &&
+	     new_remote_address != gf->remote_worker_address)) {
+		// model path or backend changed, reload the model
 		obs_log(LOG_INFO, "model path changed, reloading model");
-		if (gf->whisper_context != nullptr) {
+		if (inference_backend_ready(gf)) {
 			// acquire the mutex before freeing the context
 			if (!gf->whisper_ctx_mutex || !gf->wshiper_thread_cv) {
 				obs_log(LOG_ERROR, "whisper_ctx_mutex is null");
 				return;
 			}
 			std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
-			whisper_free(gf->whisper_context);
-			gf->whisper_context = nullptr;
+			stop_inference_backend(gf);
 			gf->wshiper_thread_cv->notify_all();
 		}
 		if (gf->whisper_thread.joinable()) {
 			gf->whisper_thread.join();
 		}
 		gf->whisper_model_path = new_model_path;
+		gf->inference_backend = new_backend;
+		gf->remote_worker_address = new_remote_address;
 
 		// check if the model exists, if not, download it
 		if (!check_if_model_exists(gf->whisper_model_path)) {
@@ -319,8 +469,7 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				gf->whisper_model_path, [gf](int download_status) {
 					if (download_status == 0) {
 						obs_log(LOG_INFO, "Model download complete");
-						gf->whisper_context = init_whisper_context(
-							gf->whisper_model_path);
+						start_inference_backend(gf);
 						std::thread new_whisper_thread(whisper_loop, gf);
 						gf->whisper_thread.swap(new_whisper_thread);
 					} else {
@@ -329,7 +478,7 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				});
 		} else {
 			// Model exists, just load it
-			gf->whisper_context = init_whisper_context(gf->whisper_model_path);
+			start_inference_backend(gf);
 			std::thread new_whisper_thread(whisper_loop, gf);
 			gf->whisper_thread.swap(new_whisper_thread);
 		}
@@ -340,18 +489,37 @@ void transcription_filter_update(void *data, obs_data_t *s)
 		return;
 	}
 
+	// routing replaces auto detection inside whisper_full, so it only applies to "auto". The
+	// route models load in the background, this takes the context mutex only to hand over.
+	const std::string language = obs_data_get_string(s, "whisper_language_select");
+	const std::string language_models =
+		language == "auto" ? obs_data_get_string(s, "language_models") : "";
+	language_router_configure(gf->language_router, language_models, gf->whisper_ctx_mutex);
+	// converting an ARPA model takes seconds, fusion starts once it is mapped
+	lm_fusion_configure(gf->lm_fusion, obs_data_get_string(s, "lm_path"),
+			    gf->whisper_ctx_mutex);
+	// preloaded so switching to battery or overheating does not stall on a model load, the
+	// worker process keeps its own model
+	const bool low_power_model = obs_data_get_bool(s, "low_power_profile") &&
+				     gf->inference_backend != INFERENCE_BACKEND_WORKER_PROCESS;
+	low_power_model_configure(gf, low_power_model
+					      ? obs_data_get_string(s, "low_power_model_path")
+					      : "");
+
 	obs_log(gf->log_level, "transcription_filter: update whisper params");
 	std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
 
 	gf->whisper_params = whisper_full_default_params(
 		(whisper_sampling_strategy)obs_data_get_int(s, "whisper_sampling_method"));
 	gf->whisper_params.duration_ms = BUFFER_SIZE_MSEC;
-	gf->whisper_params.language = obs_data_get_string(s, "whisper_language_select");
+	gf->language = language;
+	gf->whisper_params.language = gf->language.c_str();
 	gf->whisper_params.initial_prompt = obs_data_get_string(s, "initial_prompt");
 	gf->whisper_params.n_threads = (int)obs_data_get_int(s, "n_threads");
 	gf->whisper_params.n_max_text_ctx = (int)obs_data_get_int(s, "n_max_text_ctx");
 	gf->whisper_params.translate = obs_data_get_bool(s, "translate");
 	gf->whisper_params.no_context = obs_data_get_bool(s, "no_context");
+	gf->window_audio_ctx = obs_data_get_bool(s, "window_audio_ctx");
 	gf->whisper_params.single_segment = obs_data_get_bool(s, "single_segment");
 	gf->whisper_params.print_special = obs_data_get_bool(s, "print_special");
 	gf->whisper_params.print_progress = obs_data_get_bool(s, "print_progress");
@@ -363,6 +531,7 @@ void transcription_filter_update(void *data, obs_data_t *s)
 	gf->whisper_params.max_len = (int)obs_data_get_int(s, "max_len");
 	gf->whisper_params.split_on_word = obs_data_get_bool(s, "split_on_word");
 	gf->whisper_params.max_tokens = (int)obs_data_get_int(s, "max_tokens");
+	gf->adaptive_max_tokens = obs_data_get_bool(s, "adaptive_max_tokens");
 	gf->whisper_params.speed_up = obs_data_get_bool(s, "speed_up");
 	gf->whisper_params.suppress_blank = obs_data_get_bool(s, "suppress_blank");
 	gf->whisper_params.suppress_non_speech_tokens =
@@ -370,6 +539,27 @@ void transcription_filter_update(void *data, obs_data_t *s)
 	gf->whisper_params.temperature = (float)obs_data_get_double(s, "temperature");
 	gf->whisper_params.max_initial_ts = (float)obs_data_get_double(s, "max_initial_ts");
 	gf->whisper_params.length_penalty = (float)obs_data_get_double(s, "length_penalty");
+	// not used by whisper itself, see no_speech_check
+	gf->whisper_params.no_speech_thold = (float)obs_data_get_double(s, "no_speech_thold");
+	gf->lm_fusion->weight = (float)obs_data_get_double(s, "lm_weight");
+	gf->low_power_profile = obs_data_get_bool(s, "low_power_profile");
+	// the grammar is rebuilt by the inference stage when the list changes
+	gf->command_mode = obs_data_get_bool(s, "command_mode");
+	gf->voice_commands = obs_data_get_string(s, "voice_commands");
+	gf->wake_word_enabled = obs_data_get_bool(s, "wake_word_enabled");
+	gf->wake_word_listen_sec = (int)obs_data_get_int(s, "wake_word_listen_sec");
+
+	// a changed port moves the filter to the server on that port
+	const bool metrics_enabled = obs_data_get_bool(s, "metrics_enabled");
+	const int metrics_port = (int)obs_data_get_int(s, "metrics_port");
+	if (gf->metrics_port != 0 && (!metrics_enabled || metrics_port != gf->metrics_port)) {
+		metrics_server_unregister(gf->stats);
+		gf->metrics_port = 0;
+	}
+	if (metrics_enabled && gf->metrics_port == 0) {
+		metrics_server_register(gf->stats, obs_source_get_name(gf->context), metrics_port);
+		gf->metrics_port = metrics_port;
+	}
 }
 
 void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
@@ -381,7 +571,6 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	gf->channels = audio_output_get_channels(obs_get_audio());
 	gf->sample_rate = audio_output_get_sample_rate(obs_get_audio());
 	gf->frames = (size_t)((float)gf->sample_rate / (1000.0f / (float)BUFFER_SIZE_MSEC));
-	gf->last_num_frames = 0;
 
 	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
 		circlebuf_init(&gf->input_buffers[i]);
@@ -394,17 +583,31 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	for (size_t c = 1; c < gf->channels; c++) { // set the channel pointers
 		gf->copy_buffers[c] = gf->copy_buffers[0] + c * gf->frames;
 	}
+	gf->mono_buffer = static_cast<float *>(bzalloc(gf->frames * sizeof(float)));
+	channel_mixer_init(&gf->channel_mixer, gf->channels);
+	ingest_kernels_select(&gf->ingest_kernels, gf->channels, gf->sample_rate);
+	if (gf->ingest_kernels.resample) {
+		const size_t resampled_frames =
+			ingest_kernels_resample_frames(gf->sample_rate, gf->frames);
+		gf->resample_buffer =
+			static_cast<float *>(bzalloc(resampled_frames * sizeof(float)));
+	}
+	obs_log(LOG_INFO, "transcription_filter: %s ingest, %s", gf->ingest_kernels.name,
+		gf->ingest_kernels.resample ? "integer decimation" : "resampler");
 
 	gf->context = filter;
 	gf->whisper_model_path = std::string(obs_data_get_string(settings, "whisper_model_path"));
-	gf->whisper_context = init_whisper_context(gf->whisper_model_path);
-	if (gf->whisper_context == nullptr) {
+	gf->inference_backend = (InferenceBackend)obs_data_get_int(settings, "inference_backend");
+	gf->remote_worker_address = obs_data_get_string(settings, "remote_worker_address");
+	// counts the model loads from here on
+	gf->stats = new transcription_stats();
+	if (!start_inference_backend(gf)) {
 		obs_log(LOG_ERROR, "Failed to load whisper model");
 		return nullptr;
 	}
 
 	gf->overlap_ms = OVERLAP_SIZE_MSEC;
-	gf->overlap_frames = (size_t)((float)gf->sample_rate / (1000.0f / (float)gf->overlap_ms));
+	gf->word_carry_ms = -1;
 	obs_log(gf->log_level, "transcription_filter: channels %d, frames %d, sample_rate %d",
 		(int)gf->channels, (int)gf->frames, gf->sample_rate);
 
@@ -412,7 +615,8 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	struct resample_info src, dst;
 	src.samples_per_sec = gf->sample_rate;
 	src.format = AUDIO_FORMAT_FLOAT_PLANAR;
-	src.speakers = convert_speaker_layout((uint8_t)gf->channels);
+	// the channels are mixed down before resampling
+	src.speakers = convert_speaker_layout((uint8_t)1);
 
 	dst.samples_per_sec = WHISPER_SAMPLE_RATE;
 	dst.format = AUDIO_FORMAT_FLOAT_PLANAR;
@@ -428,6 +632,23 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	gf->text_source = nullptr;
 	gf->text_source_name = bstrdup(obs_data_get_string(settings, "subtitle_sources"));
 	gf->output_file_path = std::string("");
+	gf->recording_sidecar = new recording_sidecar();
+	gf->session_archive = new session_archive();
+	gf->language_router = new language_router();
+	gf->token_budget = new token_budget();
+	gf->clock_domain = new clock_domain();
+	gf->resource_monitor = new resource_monitor();
+	gf->power_profile = new power_profile();
+	power_profile_init(gf->power_profile);
+	gf->input_quality_monitor = new input_quality_monitor();
+	gf->prompt_past = new std::vector<whisper_token>();
+	gf->carried_hypothesis = new DetectionResultWithText();
+	gf->lm_fusion = new lm_fusion();
+	gf->voice_command_grammar = new voice_command_grammar();
+	gf->voice_command_endpointer = new utterance_endpointer();
+	gf->wake_word = new wake_word_spotter();
+	wake_word_load(gf->wake_word);
+	clock_domain_reset(gf->clock_domain, gf->sample_rate);
 
 	obs_log(gf->log_level, "transcription_filter: run update");
 	// get the settings updated on the filter data struct
@@ -440,6 +661,8 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 
 	gf->active = true;
 
+	obs_frontend_add_event_callback(frontend_event_callback, gf);
+
 	obs_log(gf->log_level, "transcription_filter: filter created.");
 	return gf;
 }
@@ -463,20 +686,47 @@ void transcription_filter_deactivate(void *data)
 void transcription_filter_defaults(obs_data_t *s)
 {
 	obs_data_set_default_bool(s, "vad_enabled", true);
+	obs_data_set_default_bool(s, "input_quality_policy", true);
+	obs_data_set_default_bool(s, "silence_compression", false);
+	obs_data_set_default_int(s, "silence_compression_min_ms", 300);
+	obs_data_set_default_bool(s, "word_boundary_carry", true);
 	obs_data_set_default_int(s, "log_level", LOG_DEBUG);
 	obs_data_set_default_bool(s, "log_words", true);
+	obs_data_set_default_int(s, "channel_selection", CHANNEL_SELECTION_AUTO);
 	obs_data_set_default_bool(s, "caption_to_stream", false);
+	obs_data_set_default_bool(s, "recording_sidecar", false);
+	obs_data_set_default_int(s, "recording_sidecar_format", SUBTITLE_FORMAT_SRT);
+	obs_data_set_default_bool(s, "archive_enabled", false);
+	obs_data_set_default_string(s, "archive_model_path", "models/ggml-small.en.bin");
 	obs_data_set_default_string(s, "whisper_model_path", "models/ggml-tiny.en.bin");
+	obs_data_set_default_bool(s, "low_power_profile", true);
+	obs_data_set_default_string(s, "low_power_model_path", "");
+	obs_data_set_default_int(s, "inference_backend", INFERENCE_BACKEND_IN_PROCESS);
+	obs_data_set_default_string(s, "remote_worker_address", "127.0.0.1:9520");
 	obs_data_set_default_string(s, "whisper_language_select", "en");
+	obs_data_set_default_string(s, "language_models", "");
 	obs_data_set_default_string(s, "subtitle_sources", "none");
+	obs_data_set_default_bool(s, "wake_word_enabled", false);
+	obs_data_set_default_int(s, "wake_word_listen_sec", 5);
+	obs_data_set_default_bool(s, "metrics_enabled", false);
+	obs_data_set_default_int(s, "metrics_port", METRICS_DEFAULT_PORT);
+	obs_data_set_default_bool(s, "command_mode", false);
+	obs_data_set_default_string(s, "voice_commands",
+				    "start recording = start_recording\n"
+				    "stop recording = stop_recording\n"
+				    "switch to camera one = scene:Camera 1\n"
+				    "switch to camera two = scene:Camera 2");
 
 	// Whisper parameters
 	obs_data_set_default_int(s, "whisper_sampling_method", WHISPER_SAMPLING_BEAM_SEARCH);
+	obs_data_set_default_string(s, "lm_path", "");
+	obs_data_set_default_double(s, "lm_weight", 0.3);
 	obs_data_set_default_string(s, "initial_prompt", "");
 	obs_data_set_default_int(s, "n_threads", 4);
 	obs_data_set_default_int(s, "n_max_text_ctx", 16384);
 	obs_data_set_default_bool(s, "translate", false);
 	obs_data_set_default_bool(s, "no_context", true);
+	obs_data_set_default_bool(s, "window_audio_ctx", false);
 	obs_data_set_default_bool(s, "single_segment", true);
 	obs_data_set_default_bool(s, "print_special", false);
 	obs_data_set_default_bool(s, "print_progress", false);
@@ -488,12 +738,25 @@ void transcription_filter_defaults(obs_data_t *s)
 	obs_data_set_default_int(s, "max_len", 0);
 	obs_data_set_default_bool(s, "split_on_word", false);
 	obs_data_set_default_int(s, "max_tokens", 32);
+	obs_data_set_default_bool(s, "adaptive_max_tokens", true);
 	obs_data_set_default_bool(s, "speed_up", false);
 	obs_data_set_default_bool(s, "suppress_blank", false);
 	obs_data_set_default_bool(s, "suppress_non_speech_tokens", true);
 	obs_data_set_default_double(s, "temperature", 0.5);
 	obs_data_set_default_double(s, "max_initial_ts", 1.0);
 	obs_data_set_default_double(s, "length_penalty", -1.0);
+	obs_data_set_default_double(s, "no_speech_thold", 0.8);
+}
+
+static bool wake_word_record_clicked(obs_properties_t *props, obs_property_t *property,
+				     void *data)
+{
+	UNUSED_PARAMETER(props);
+	UNUSED_PARAMETER(property);
+	struct transcription_filter_data *gf =
+		static_cast<struct transcription_filter_data *>(data);
+	wake_word_start_enrollment(gf->wake_word);
+	return false;
 }
 
 obs_properties_t *transcription_filter_properties(void *data)
@@ -501,6 +764,26 @@ obs_properties_t *transcription_filter_properties(void *data)
 	obs_properties_t *ppts = obs_properties_create();
 
 	obs_properties_add_bool(ppts, "vad_enabled", "VAD Enabled");
+	obs_property_t *input_quality = obs_properties_add_bool(ppts, "input_quality_policy",
+								"Adapt to poor input");
+	obs_property_set_long_description(
+		input_quality,
+		"Raise the VAD threshold with the background noise, and decode clipped, faint "
+		"or noisy speech with the low-power settings instead of a full decode.");
+	obs_properties_add_bool(ppts, "silence_compression", "Remove pauses within the window");
+	obs_properties_add_int_slider(ppts, "silence_compression_min_ms", "Minimum pause (ms)", 150,
+				      1000, 50);
+	obs_properties_add_bool(ppts, "word_boundary_carry",
+				"Start the next window at the last whole word");
+	obs_property_t *channel_selection_list =
+		obs_properties_add_list(ppts, "channel_selection", "Input Channel",
+					OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(channel_selection_list, "Auto (best signal)",
+				  CHANNEL_SELECTION_AUTO);
+	obs_property_list_add_int(channel_selection_list, "Mix all channels",
+				  CHANNEL_SELECTION_MIX);
+	obs_property_list_add_int(channel_selection_list, "Left / Channel 1", 0);
+	obs_property_list_add_int(channel_selection_list, "Right / Channel 2", 1);
 	obs_property_t *list = obs_properties_add_list(ppts, "log_level", "Log level",
 						       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 	obs_property_list_add_int(list, "DEBUG", LOG_DEBUG);
@@ -508,6 +791,24 @@ obs_properties_t *transcription_filter_properties(void *data)
 	obs_property_list_add_int(list, "WARNING", LOG_WARNING);
 	obs_properties_add_bool(ppts, "log_words", "Log output words");
 	obs_properties_add_bool(ppts, "caption_to_stream", "Stream captions");
+	obs_properties_add_bool(ppts, "recording_sidecar", "Save subtitles with recordings");
+	obs_property_t *sidecar_format_list =
+		obs_properties_add_list(ppts, "recording_sidecar_format",
+					"Recording subtitles format", OBS_COMBO_TYPE_LIST,
+					OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(sidecar_format_list, "SubRip (.srt)", SUBTITLE_FORMAT_SRT);
+	obs_property_list_add_int(sidecar_format_list, "WebVTT (.vtt)", SUBTITLE_FORMAT_VTT);
+	obs_properties_add_bool(ppts, "archive_enabled",
+				"Re-transcribe the session with a larger model afterwards");
+	obs_property_t *archive_models_list =
+		obs_properties_add_list(ppts, "archive_model_path", "Re-transcription Model",
+					OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(archive_models_list, "Base (Eng) 142Mb",
+				     "models/ggml-base.en.bin");
+	obs_property_list_add_string(archive_models_list, "Base 142Mb", "models/ggml-base.bin");
+	obs_property_list_add_string(archive_models_list, "Small (Eng) 466Mb",
+				     "models/ggml-small.en.bin");
+	obs_property_list_add_string(archive_models_list, "Small 466Mb", "models/ggml-small.bin");
 
 	obs_property_t *subs_output =
 		obs_properties_add_list(ppts, "subtitle_sources", "Subtitles Output",
@@ -553,6 +854,97 @@ obs_properties_t *transcription_filter_properties(void *data)
 				     "models/ggml-small.en.bin");
 	obs_property_list_add_string(whisper_models_list, "Small 466Mb", "models/ggml-small.bin");
 
+	obs_property_t *low_power = obs_properties_add_bool(ppts, "low_power_profile",
+							    "Save power on battery or when hot");
+	obs_property_set_long_description(
+		low_power,
+		"While a laptop runs on battery or overheats, use half the threads, greedy "
+		"decoding, a stricter VAD and the Low Power Model. Linux only.");
+	obs_property_t *low_power_models_list =
+		obs_properties_add_list(ppts, "low_power_model_path", "Low Power Model",
+					OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(low_power_models_list, "Same as Whisper Model", "");
+	obs_property_list_add_string(low_power_models_list, "Tiny (Eng) 75Mb",
+				     "models/ggml-tiny.en.bin");
+	obs_property_list_add_string(low_power_models_list, "Tiny 75Mb", "models/ggml-tiny.bin");
+
+	// Run the model in OBS or isolated in the localvocal-worker helper process
+	obs_property_t *inference_backend_list =
+		obs_properties_add_list(ppts, "inference_backend", "Inference Backend",
+					OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(inference_backend_list, "In-process",
+				  INFERENCE_BACKEND_IN_PROCESS);
+	obs_property_list_add_int(inference_backend_list, "Helper process",
+				  INFERENCE_BACKEND_WORKER_PROCESS);
+	obs_property_list_add_int(inference_backend_list, "Remote worker",
+				  INFERENCE_BACKEND_REMOTE);
+	obs_properties_add_text(ppts, "remote_worker_address", "Remote Worker Address",
+				OBS_TEXT_DEFAULT);
+
+	obs_property_set_modified_callback(inference_backend_list, [](obs_properties_t *props,
+								      obs_property_t *property,
+								      obs_data_t *settings) {
+		UNUSED_PARAMETER(property);
+		// the address is only used by the remote backend
+		const bool remote = obs_data_get_int(settings, "inference_backend") ==
+				    INFERENCE_BACKEND_REMOTE;
+		obs_property_set_visible(obs_properties_get(props, "remote_worker_address"),
+					 remote);
+		return true;
+	});
+
+	// Listen for a wake word and only transcribe for a while after it
+	obs_property_t *wake_word = obs_properties_add_bool(ppts, "wake_word_enabled",
+							    "Transcribe after a wake word");
+	obs_properties_add_int_slider(ppts, "wake_word_listen_sec",
+				      "Transcribe after the wake word (s)", 2, 30, 1);
+	obs_properties_add_button(ppts, "wake_word_record", "Record the wake word (say it 3 times)",
+				  wake_word_record_clicked);
+
+	obs_property_set_modified_callback(wake_word, [](obs_properties_t *props,
+							 obs_property_t *property,
+							 obs_data_t *settings) {
+		UNUSED_PARAMETER(property);
+		const bool enabled = obs_data_get_bool(settings, "wake_word_enabled");
+		obs_property_set_visible(obs_properties_get(props, "wake_word_listen_sec"),
+					 enabled);
+		obs_property_set_visible(obs_properties_get(props, "wake_word_record"), enabled);
+		return true;
+	});
+
+	// Control OBS by voice instead of transcribing
+	obs_property_t *command_mode = obs_properties_add_bool(ppts, "command_mode",
+							       "Voice command mode");
+	obs_properties_add_text(ppts, "voice_commands", "Voice Commands (phrase = action)",
+				OBS_TEXT_MULTILINE);
+	obs_property_set_long_description(
+		obs_properties_get(ppts, "voice_commands"),
+		"One command per line. Actions: scene:<name>, mute:<source>, unmute:<source>, "
+		"start_recording, stop_recording, start_streaming, stop_streaming, save_replay");
+
+	obs_property_set_modified_callback(command_mode, [](obs_properties_t *props,
+							    obs_property_t *property,
+							    obs_data_t *settings) {
+		UNUSED_PARAMETER(property);
+		obs_property_set_visible(obs_properties_get(props, "voice_commands"),
+					 obs_data_get_bool(settings, "command_mode"));
+		return true;
+	});
+
+	// Prometheus counters for monitoring long sessions, served on localhost only
+	obs_property_t *metrics = obs_properties_add_bool(ppts, "metrics_enabled",
+							  "Serve metrics on localhost");
+	obs_properties_add_int(ppts, "metrics_port", "Metrics Port", 1024, 65535, 1);
+
+	obs_property_set_modified_callback(metrics, [](obs_properties_t *props,
+						       obs_property_t *property,
+						       obs_data_t *settings) {
+		UNUSED_PARAMETER(property);
+		obs_property_set_visible(obs_properties_get(props, "metrics_port"),
+					 obs_data_get_bool(settings, "metrics_enabled"));
+		return true;
+	});
+
 	obs_properties_t *whisper_params_group = obs_properties_create();
 	obs_properties_add_group(ppts, "whisper_params_group", "Whisper Parameters",
 				 OBS_GROUP_NORMAL, whisper_params_group);
@@ -576,6 +968,14 @@ obs_properties_t *transcription_filter_properties(void *data)
 					     pair.second.c_str());
 	}
 
+	// With the "auto" language, route detected languages to dedicated models
+	obs_property_t *language_models = obs_properties_add_text(
+		whisper_params_group, "language_models", "Per-language Models", OBS_TEXT_DEFAULT);
+	obs_property_set_long_description(
+		language_models,
+		"Used with the Auto language, e.g. \"en=models/ggml-tiny.en.bin\". "
+		"Other languages use the Whisper Model, which must be multilingual.");
+
 	obs_property_t *whisper_sampling_method_list = obs_properties_add_list(
 		whisper_params_group, "whisper_sampling_method", "whisper_sampling_method",
 		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
@@ -583,6 +983,17 @@ obs_properties_t *transcription_filter_properties(void *data)
 				  WHISPER_SAMPLING_BEAM_SEARCH);
 	obs_property_list_add_int(whisper_sampling_method_list, "Greedy", WHISPER_SAMPLING_GREEDY);
 
+	obs_property_t *lm_path = obs_properties_add_path(whisper_params_group, "lm_path",
+							  "Language Model", OBS_PATH_FILE,
+							  "N-gram models (*.arpa *.bin)", NULL);
+	obs_property_set_long_description(
+		lm_path,
+		"Word n-gram model of the domain, e.g. built with KenLM from lowercase text. "
+		"Rescoring the words the decoder considers lets greedy decoding get close to beam "
+		"search. An ARPA file is converted next to it on first use.");
+	obs_properties_add_float_slider(whisper_params_group, "lm_weight", "Language Model Weight",
+					0.0, 1.0, 0.05);
+
 	// int n_threads;
 	obs_properties_add_int_slider(whisper_params_group, "n_threads", "n_threads", 1, 8, 1);
 	// int n_max_text_ctx;     // max tokens to use from past text as prompt for the decoder
@@ -594,6 +1005,12 @@ obs_properties_t *transcription_filter_properties(void *data)
 	obs_properties_add_bool(whisper_params_group, "translate", "translate");
 	// bool no_context;        // do not use past transcription (if any) as initial prompt for the decoder
 	obs_properties_add_bool(whisper_params_group, "no_context", "no_context");
+	obs_property_t *window_audio_ctx = obs_properties_add_bool(
+		whisper_params_group, "window_audio_ctx", "Encode only the window (faster)");
+	obs_property_set_long_description(
+		window_audio_ctx,
+		"Whisper encodes every window as 30 s of audio. Encoding only the window length "
+		"is several times faster but can lower accuracy, depending on the model.");
 	// bool single_segment;    // force single segment output (useful for streaming)
 	obs_properties_add_bool(whisper_params_group, "single_segment", "single_segment");
 	// bool print_special;     // print special tokens (e.g. <SOT>, <EOT>, <BEG>, etc.)
@@ -618,6 +1035,9 @@ obs_properties_t *transcription_filter_properties(void *data)
 	obs_properties_add_bool(whisper_params_group, "split_on_word", "split_on_word");
 	// int   max_tokens;       // max tokens per segment (0 = no limit)
 	obs_properties_add_int_slider(whisper_params_group, "max_tokens", "max_tokens", 0, 100, 1);
+	// bool adaptive_max_tokens; // per-window budget from speech rate, capped by max_tokens
+	obs_properties_add_bool(whisper_params_group, "adaptive_max_tokens",
+				"adaptive_max_tokens");
 	// bool speed_up;          // speed-up the audio by 2x using Phase Vocoder
 	obs_properties_add_bool(whisper_params_group, "speed_up", "speed_up");
 	// const char * initial_prompt;
@@ -637,6 +1057,9 @@ obs_properties_t *transcription_filter_properties(void *data)
 	// float length_penalty
 	obs_properties_add_float_slider(whisper_params_group, "length_penalty", "length_penalty",
 					-1.0f, 1.0f, 0.1f);
+	// float no_speech_thold, 1 disables the check
+	obs_properties_add_float_slider(whisper_params_group, "no_speech_thold", "no_speech_thold",
+					0.0f, 1.0f, 0.05f);
 
 	UNUSED_PARAMETER(data);
 	return ppts;
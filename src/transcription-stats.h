@@ -0,0 +1,96 @@
+#ifndef TRANSCRIPTION_STATS_H
+#define TRANSCRIPTION_STATS_H
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#define STATS_HISTOGRAM_MAX_BOUNDS 8
+
+// upper bounds of the caption latency buckets, in seconds
+static const double STATS_LATENCY_BOUNDS[] = {0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0};
+// upper bounds of the real-time factor buckets (inference time / audio duration)
+static const double STATS_RTF_BOUNDS[] = {0.05, 0.1, 0.25, 0.5, 1.0, 2.0};
+
+// Histogram with fixed buckets, updated without locks. Buckets are not cumulative, the
+// last one counts the values above every bound.
+struct stats_histogram {
+	const double *bounds;
+	size_t n_bounds;
+	std::atomic<uint64_t> buckets[STATS_HISTOGRAM_MAX_BOUNDS + 1] = {};
+	// in millionths of the unit of the bounds
+	std::atomic<uint64_t> sum_micros{0};
+
+	template<size_t N> explicit stats_histogram(const double (&b)[N]) : bounds(b), n_bounds(N)
+	{
+		static_assert(N <= STATS_HISTOGRAM_MAX_BOUNDS, "too many histogram buckets");
+	}
+
+	void observe(double value)
+	{
+		size_t i = 0;
+		while (i < n_bounds && value > bounds[i]) {
+			i++;
+		}
+		buckets[i].fetch_add(1, std::memory_order_relaxed);
+		sum_micros.fetch_add((uint64_t)llround((value > 0.0 ? value : 0.0) * 1e6),
+				     std::memory_order_relaxed);
+	}
+};
+
+// Stages of the transcription pipeline, each on its own thread
+enum PipelineStage {
+	// pop, downmix and resample the input, wake word and command endpointing
+	PIPELINE_STAGE_PREPROCESS,
+	// window assembly, VAD and whisper
+	PIPELINE_STAGE_INFERENCE,
+	// result bookkeeping
+	PIPELINE_STAGE_POSTPROCESS,
+	// text sources, files, stream captions
+	PIPELINE_STAGE_SINK,
+	PIPELINE_STAGE_COUNT,
+};
+
+// Pipeline counters of one filter. Written by the stage threads, may be read from any thread.
+struct transcription_stats {
+	// windows taken from the input buffer
+	std::atomic<uint64_t> windows{0};
+	// windows dropped by VAD before inference
+	std::atomic<uint64_t> vad_skipped{0};
+	// windows that went through whisper
+	std::atomic<uint64_t> inferences{0};
+	// inferences stopped after the first decoder step because the window held no speech
+	std::atomic<uint64_t> decoder_skipped{0};
+	// windows that only ended carried words and reused their caption instead of whisper
+	std::atomic<uint64_t> reused_windows{0};
+	std::atomic<uint64_t> inference_time_ms{0};
+	// audio duration of the inferences
+	std::atomic<uint64_t> inference_audio_ms{0};
+	// captions sent to the outputs
+	std::atomic<uint64_t> segments{0};
+	// windows lost to a failed or unavailable inference backend
+	std::atomic<uint64_t> dropped{0};
+	std::atomic<uint64_t> model_loads{0};
+	// windows transcribed in the low-power profile
+	std::atomic<uint64_t> low_power_windows{0};
+	// windows decoded cheaply because the input was clipped, faint or noisy
+	std::atomic<uint64_t> poor_input_windows{0};
+	// audio waiting in the input buffer after the last window was taken
+	std::atomic<uint64_t> backlog_ms{0};
+	// input quality of the last window, see input_quality
+	std::atomic<float> input_clipping_ratio{0.0f};
+	std::atomic<float> input_rms_dbfs{-100.0f};
+	std::atomic<float> input_snr_db{0.0f};
+	// delay from the end of a window to its caption, in seconds
+	stats_histogram latency{STATS_LATENCY_BOUNDS};
+	stats_histogram real_time_factor{STATS_RTF_BOUNDS};
+	// time each stage spent on items, including waits for room in the next queue
+	std::atomic<uint64_t> stage_busy_us[PIPELINE_STAGE_COUNT] = {};
+	// items waiting in front of each stage, audio packets for the pre-processing
+	std::atomic<uint64_t> stage_queue_depth[PIPELINE_STAGE_COUNT] = {};
+	// items a full queue dropped in front of each stage
+	std::atomic<uint64_t> stage_dropped[PIPELINE_STAGE_COUNT] = {};
+};
+
+#endif // TRANSCRIPTION_STATS_H
@@ -0,0 +1,95 @@
+#include "utterance-endpointer.h"
+
+#include <whisper.h>
+
+#include <algorithm>
+
+// energy is measured in 10 ms frames
+#define ENDPOINTER_FRAME_SAMPLES (WHISPER_SAMPLE_RATE / 100)
+// audio kept from before the speech onset, so the first word is not clipped
+#define ENDPOINTER_PREROLL_MS 200
+// the utterance ends after this much silence
+#define ENDPOINTER_END_SILENCE_MS 300
+#define ENDPOINTER_MAX_UTTERANCE_MS 3000
+// shorter bursts are clicks and coughs
+#define ENDPOINTER_MIN_SPEECH_MS 150
+// frames this far above the noise floor (10 dB) are speech
+#define ENDPOINTER_SPEECH_RATIO 10.0f
+// -50 dBFS, quieter frames are never speech
+#define ENDPOINTER_MIN_SPEECH_ENERGY 1e-5f
+
+void utterance_endpointer_reset(struct utterance_endpointer *endpointer)
+{
+	endpointer->preroll.clear();
+	endpointer->utterance.clear();
+	endpointer->ended.clear();
+	endpointer->noise_floor = 0.0f;
+	endpointer->in_speech = false;
+	endpointer->speech_ms = 0;
+	endpointer->silence_ms = 0;
+}
+
+bool utterance_endpointer_push(struct utterance_endpointer *endpointer, const float *pcm16k,
+			       size_t n_samples)
+{
+	const size_t preroll_samples = ENDPOINTER_PREROLL_MS * WHISPER_SAMPLE_RATE / 1000;
+	const size_t max_samples = ENDPOINTER_MAX_UTTERANCE_MS * WHISPER_SAMPLE_RATE / 1000;
+	bool ended = false;
+	for (size_t f = 0; f + ENDPOINTER_FRAME_SAMPLES <= n_samples;
+	     f += ENDPOINTER_FRAME_SAMPLES) {
+		const float *frame = pcm16k + f;
+		float energy = 0.0f;
+		for (size_t i = 0; i < ENDPOINTER_FRAME_SAMPLES; i++) {
+			energy += frame[i] * frame[i];
+		}
+		energy /= ENDPOINTER_FRAME_SAMPLES;
+
+		// the floor drops quickly to quiet frames and creeps up slowly through speech
+		float &floor = endpointer->noise_floor;
+		if (floor == 0.0f || energy < floor) {
+			floor = floor == 0.0f ? energy : floor * 0.9f + energy * 0.1f;
+		} else {
+			floor *= 1.002f;
+		}
+		floor = std::max(floor, 1e-9f);
+		const bool speech = energy > floor * ENDPOINTER_SPEECH_RATIO &&
+				    energy > ENDPOINTER_MIN_SPEECH_ENERGY;
+
+		if (!endpointer->in_speech) {
+			endpointer->preroll.insert(endpointer->preroll.end(), frame,
+						   frame + ENDPOINTER_FRAME_SAMPLES);
+			if (endpointer->preroll.size() > preroll_samples) {
+				endpointer->preroll.erase(endpointer->preroll.begin(),
+							  endpointer->preroll.end() -
+								  preroll_samples);
+			}
+			if (speech) {
+				endpointer->in_speech = true;
+				endpointer->utterance.swap(endpointer->preroll);
+				endpointer->preroll.clear();
+				endpointer->speech_ms = 10;
+				endpointer->silence_ms = 0;
+			}
+			continue;
+		}
+
+		endpointer->utterance.insert(endpointer->utterance.end(), frame,
+					     frame + ENDPOINTER_FRAME_SAMPLES);
+		if (speech) {
+			endpointer->speech_ms += 10;
+			endpointer->silence_ms = 0;
+		} else {
+			endpointer->silence_ms += 10;
+		}
+		if (endpointer->silence_ms >= ENDPOINTER_END_SILENCE_MS ||
+		    endpointer->utterance.size() >= max_samples) {
+			endpointer->in_speech = false;
+			if (endpointer->speech_ms >= ENDPOINTER_MIN_SPEECH_MS) {
+				endpointer->ended.swap(endpointer->utterance);
+				ended = true;
+			}
+			endpointer->utterance.clear();
+		}
+	}
+	return ended;
+}
@@ -0,0 +1,25 @@
+#ifndef UTTERANCE_ENDPOINTER_H
+#define UTTERANCE_ENDPOINTER_H
+
+#include <cstddef>
+#include <vector>
+
+// Cuts single utterances out of a stream of 16 kHz audio chunks by their energy, so short
+// phrases are handled as soon as the speaker stops instead of at the end of a fixed window.
+struct utterance_endpointer {
+	std::vector<float> preroll;
+	std::vector<float> utterance;
+	// the last complete utterance
+	std::vector<float> ended;
+	float noise_floor = 0.0f;
+	bool in_speech = false;
+	int speech_ms = 0;
+	int silence_ms = 0;
+};
+
+// Feed a chunk of audio, returns true if an utterance ended in it, which is then in ended
+bool utterance_endpointer_push(struct utterance_endpointer *endpointer, const float *pcm16k,
+			       size_t n_samples);
+void utterance_endpointer_reset(struct utterance_endpointer *endpointer);
+
+#endif // UTTERANCE_ENDPOINTER_H
@@ -0,0 +1,94 @@
+#include "vad-timeline.h"
+
+#include <whisper.h>
+
+#include <algorithm>
+
+// energy is measured in 10 ms frames
+#define VAD_TIMELINE_FRAME_SAMPLES (WHISPER_SAMPLE_RATE / 100)
+
+bool vad_timeline_compress(const float *pcm16k, size_t n_samples, int min_pause_ms,
+			   int keep_pause_ms, std::vector<float> &out,
+			   struct vad_timeline &timeline)
+{
+	out.clear();
+	timeline.spans.clear();
+	timeline.original_samples = n_samples;
+	timeline.compressed_samples = n_samples;
+
+	const size_t n_frames = n_samples / VAD_TIMELINE_FRAME_SAMPLES;
+	if (n_frames < 10) {
+		return false;
+	}
+	std::vector<float> energies(n_frames);
+	for (size_t f = 0; f < n_frames; f++) {
+		float energy = 0.0f;
+		const float *frame = pcm16k + f * VAD_TIMELINE_FRAME_SAMPLES;
+		for (size_t i = 0; i < VAD_TIMELINE_FRAME_SAMPLES; i++) {
+			energy += frame[i] * frame[i];
+		}
+		energies[f] = energy / VAD_TIMELINE_FRAME_SAMPLES;
+	}
+	std::vector<float> sorted(energies);
+	std::sort(sorted.begin(), sorted.end());
+	const float quiet = sorted[n_frames / 10];
+	const float loud = sorted[n_frames * 9 / 10];
+	// without at least 20 dB between pauses and speech there are no pauses to remove
+	if (quiet > loud * 0.01f) {
+		return false;
+	}
+	const float threshold = std::max(quiet * 2.0f, loud * 0.003f);
+
+	const size_t min_pause_frames = (size_t)std::max(1, min_pause_ms / 10);
+	const size_t keep_frames = (size_t)std::max(0, keep_pause_ms / 10);
+	// copy everything except the middle of long pauses, keeping half of keep_frames on
+	// each side so word onsets and endings stay intact
+	size_t copy_from = 0;
+	size_t f = 0;
+	while (f < n_frames) {
+		if (energies[f] >= threshold) {
+			f++;
+			continue;
+		}
+		size_t pause_end = f;
+		while (pause_end < n_frames && energies[pause_end] < threshold) {
+			pause_end++;
+		}
+		if (pause_end - f >= min_pause_frames && pause_end - f > keep_frames) {
+			const size_t keep_before = keep_frames / 2;
+			const size_t keep_after = keep_frames - keep_before;
+			const size_t cut_start = (f + keep_before) * VAD_TIMELINE_FRAME_SAMPLES;
+			const size_t cut_end =
+				(pause_end - keep_after) * VAD_TIMELINE_FRAME_SAMPLES;
+			timeline.spans.push_back({out.size(), copy_from, cut_start - copy_from});
+			out.insert(out.end(), pcm16k + copy_from, pcm16k + cut_start);
+			copy_from = cut_end;
+		}
+		f = pause_end;
+	}
+	if (timeline.spans.empty()) {
+		return false;
+	}
+	timeline.spans.push_back({out.size(), copy_from, n_samples - copy_from});
+	out.insert(out.end(), pcm16k + copy_from, pcm16k + n_samples);
+	timeline.compressed_samples = out.size();
+	return true;
+}
+
+int64_t vad_timeline_to_original(const struct vad_timeline &timeline, int64_t t)
+{
+	if (timeline.spans.empty()) {
+		return t;
+	}
+	const size_t sample = (size_t)std::max<int64_t>(0, t) * (WHISPER_SAMPLE_RATE / 100);
+	// last span starting at or before the sample
+	auto it = std::upper_bound(timeline.spans.begin(), timeline.spans.end(), sample,
+				   [](size_t s, const vad_timeline_span &span) {
+					   return s < span.compressed_start;
+				   });
+	if (it != timeline.spans.begin()) {
+		--it;
+	}
+	const size_t offset = std::min(sample - std::min(sample, it->compressed_start), it->length);
+	return (int64_t)((it->original_start + offset) / (WHISPER_SAMPLE_RATE / 100));
+}
@@ -0,0 +1,31 @@
+#ifndef VAD_TIMELINE_H
+#define VAD_TIMELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A run of samples copied unchanged from the original window
+struct vad_timeline_span {
+	size_t compressed_start;
+	size_t original_start;
+	size_t length;
+};
+
+// Map from the time of a silence-compressed window back to the original window
+struct vad_timeline {
+	std::vector<vad_timeline_span> spans;
+	size_t original_samples = 0;
+	size_t compressed_samples = 0;
+};
+
+// Shorten every pause of at least min_pause_ms in the 16 kHz window to keep_pause_ms, so the
+// encoder sees denser speech. Returns false (and leaves out empty) if nothing was removed.
+bool vad_timeline_compress(const float *pcm16k, size_t n_samples, int min_pause_ms,
+			   int keep_pause_ms, std::vector<float> &out,
+			   struct vad_timeline &timeline);
+
+// Convert a whisper timestamp (10 ms units) in the compressed window to the original window
+int64_t vad_timeline_to_original(const struct vad_timeline &timeline, int64_t t);
+
+#endif // VAD_TIMELINE_H
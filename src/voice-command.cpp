@@ -0,0 +1,294 @@
+#include "voice-command.h"
+
+#include <obs-module.h>
+#include <obs-frontend-api.h>
+
+#include "plugin-support.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <sstream>
+
+static std::string trim(const std::string &s)
+{
+	const size_t start = s.find_first_not_of(" \t\r\n");
+	if (start == std::string::npos) {
+		return "";
+	}
+	const size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(start, end - start + 1);
+}
+
+// Lowercase words separated by single spaces, without punctuation
+static std::string normalize_phrase(const std::string &phrase)
+{
+	std::string normalized;
+	for (unsigned char ch : phrase) {
+		if (std::isalnum(ch) || ch == '\'' || ch >= 0x80) {
+			normalized += (char)std::tolower(ch);
+		} else if (!normalized.empty() && normalized.back() != ' ') {
+			normalized += ' ';
+		}
+	}
+	return trim(normalized);
+}
+
+static bool parse_action(const std::string &text, voice_command &command)
+{
+	const size_t colon = text.find(':');
+	const std::string name = trim(text.substr(0, colon));
+	command.target = colon == std::string::npos ? "" : trim(text.substr(colon + 1));
+	const bool has_target = !command.target.empty();
+	if (name == "scene" && has_target) {
+		command.action = VOICE_COMMAND_SCENE;
+	} else if (name == "mute" && has_target) {
+		command.action = VOICE_COMMAND_MUTE;
+	} else if (name == "unmute" && has_target) {
+		command.action = VOICE_COMMAND_UNMUTE;
+	} else if (name == "start_recording") {
+		command.action = VOICE_COMMAND_START_RECORDING;
+	} else if (name == "stop_recording") {
+		command.action = VOICE_COMMAND_STOP_RECORDING;
+	} else if (name == "start_streaming") {
+		command.action = VOICE_COMMAND_START_STREAMING;
+	} else if (name == "stop_streaming") {
+		command.action = VOICE_COMMAND_STOP_STREAMING;
+	} else if (name == "save_replay") {
+		command.action = VOICE_COMMAND_SAVE_REPLAY;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static std::vector<whisper_token> tokenize(struct whisper_context *ctx, const std::string &text)
+{
+	std::vector<whisper_token> tokens(text.size() + 8);
+	const int n = whisper_tokenize(ctx, text.c_str(), tokens.data(), (int)tokens.size());
+	tokens.resize(std::max(0, n));
+	return tokens;
+}
+
+static size_t trie_child(struct voice_command_grammar *grammar, size_t node, whisper_token token)
+{
+	auto it = grammar->nodes[node].children.find(token);
+	if (it != grammar->nodes[node].children.end()) {
+		return it->second;
+	}
+	grammar->nodes.emplace_back();
+	grammar->nodes[node].children[token] = grammar->nodes.size() - 1;
+	return grammar->nodes.size() - 1;
+}
+
+bool voice_command_grammar_build(struct voice_command_grammar *grammar, const std::string &spec,
+				 struct whisper_context *ctx)
+{
+	if (spec == grammar->spec && ctx == grammar->ctx) {
+		return !grammar->commands.empty();
+	}
+	grammar->spec = spec;
+	grammar->ctx = ctx;
+	grammar->commands.clear();
+	grammar->nodes.assign(1, voice_command_trie_node());
+	grammar->max_phrase_tokens = 0;
+
+	std::istringstream lines(spec);
+	std::string line;
+	while (std::getline(lines, line)) {
+		line = trim(line);
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		const size_t equals = line.find('=');
+		voice_command command;
+		command.phrase = normalize_phrase(line.substr(0, equals));
+		if (equals == std::string::npos || command.phrase.empty() ||
+		    !parse_action(line.substr(equals + 1), command)) {
+			obs_log(LOG_WARNING, "invalid voice command '%s'", line.c_str());
+			continue;
+		}
+		grammar->commands.push_back(command);
+	}
+	if (ctx == nullptr) {
+		return false;
+	}
+
+	// whisper writes a command either way, and may end it with punctuation
+	std::vector<whisper_token> punctuation;
+	for (const char *mark : {".", "!"}) {
+		const std::vector<whisper_token> tokens = tokenize(ctx, mark);
+		if (tokens.size() == 1) {
+			punctuation.push_back(tokens[0]);
+		}
+	}
+	for (size_t i = 0; i < grammar->commands.size(); i++) {
+		const std::string &phrase = grammar->commands[i].phrase;
+		std::string capitalized = phrase;
+		capitalized[0] = (char)std::toupper((unsigned char)capitalized[0]);
+		for (const std::string &variant : {phrase, capitalized}) {
+			// words are tokenized with their leading space
+			const std::vector<whisper_token> tokens = tokenize(ctx, " " + variant);
+			if (tokens.empty()) {
+				continue;
+			}
+			size_t node = 0;
+			for (whisper_token token : tokens) {
+				node = trie_child(grammar, node, token);
+			}
+			grammar->nodes[node].command = (int)i;
+			for (whisper_token token : punctuation) {
+				grammar->nodes[trie_child(grammar, node, token)].command = (int)i;
+			}
+			grammar->max_phrase_tokens =
+				std::max(grammar->max_phrase_tokens, (int)tokens.size() + 1);
+		}
+	}
+	obs_log(LOG_INFO, "voice commands: %d phrases, %d trie nodes",
+		(int)grammar->commands.size(), (int)grammar->nodes.size());
+	return !grammar->commands.empty();
+}
+
+// Trie node reached by the text tokens, or -1 if they leave the trie
+static int walk_trie(const struct voice_command_grammar *grammar, whisper_token eot,
+		     const whisper_token_data *tokens, int n_tokens)
+{
+	size_t node = 0;
+	for (int i = 0; i < n_tokens; i++) {
+		// timestamps and other special tokens are outside the grammar
+		if (tokens[i].id >= eot) {
+			continue;
+		}
+		auto it = grammar->nodes[node].children.find(tokens[i].id);
+		if (it == grammar->nodes[node].children.end()) {
+			return -1;
+		}
+		node = it->second;
+	}
+	return (int)node;
+}
+
+void logits_filter_chain_add_voice_command(struct logits_filter_chain *chain,
+					   const struct voice_command_grammar *grammar,
+					   struct voice_command_score *score)
+{
+	chain->filters.push_back([grammar, score](struct whisper_context *ctx,
+						  struct whisper_state *,
+						  const whisper_token_data *tokens, int n_tokens,
+						  float *logits) {
+		const whisper_token eot = whisper_token_eot(ctx);
+		const int n_vocab = whisper_n_vocab(ctx);
+
+		// score the token picked at the previous step
+		if (n_tokens > 0 && score->last_step_tokens == n_tokens - 1) {
+			auto it = score->last_step.find(tokens[n_tokens - 1].id);
+			if (it != score->last_step.end()) {
+				score->sum_logprob += it->second;
+				score->n_tokens++;
+			}
+		}
+		score->last_step.clear();
+		score->last_step_tokens = n_tokens;
+
+		const int node = walk_trie(grammar, eot, tokens, n_tokens);
+		if (node < 0) {
+			// cannot happen while the filter is in place, end the decode
+			for (int i = 0; i < n_vocab; i++) {
+				if (i != eot) {
+					logits[i] = -INFINITY;
+				}
+			}
+			return;
+		}
+
+		const float max_logit = *std::max_element(logits, logits + n_vocab);
+		double sum = 0.0;
+		for (int i = 0; i < n_vocab; i++) {
+			sum += exp((double)(logits[i] - max_logit));
+		}
+		const float log_norm = max_logit + (float)log(sum);
+
+		const voice_command_trie_node &current = grammar->nodes[node];
+		std::vector<std::pair<whisper_token, float>> allowed;
+		for (const auto &child : current.children) {
+			allowed.emplace_back(child.first, logits[child.first]);
+			score->last_step[child.first] = logits[child.first] - log_norm;
+		}
+		std::fill(logits, logits + eot, -INFINITY);
+		for (const auto &token : allowed) {
+			logits[token.first] = token.second;
+		}
+		if (current.command < 0) {
+			logits[eot] = -INFINITY;
+		}
+	});
+}
+
+int voice_command_match(const struct voice_command_grammar *grammar, struct whisper_context *ctx,
+			const std::vector<whisper_token> &tokens)
+{
+	std::vector<whisper_token_data> token_data(tokens.size());
+	for (size_t i = 0; i < tokens.size(); i++) {
+		token_data[i].id = tokens[i];
+	}
+	const int node =
+		walk_trie(grammar, whisper_token_eot(ctx), token_data.data(), (int)tokens.size());
+	return node < 0 ? -1 : grammar->nodes[node].command;
+}
+
+double voice_command_confidence(const struct voice_command_score *score)
+{
+	if (score->n_tokens == 0) {
+		return 0.0;
+	}
+	return exp(score->sum_logprob / score->n_tokens);
+}
+
+static void execute_on_ui_thread(void *param)
+{
+	voice_command *command = static_cast<voice_command *>(param);
+	obs_source_t *source = nullptr;
+	if (!command->target.empty()) {
+		source = obs_get_source_by_name(command->target.c_str());
+		if (source == nullptr) {
+			obs_log(LOG_WARNING, "voice command '%s': source '%s' not found",
+				command->phrase.c_str(), command->target.c_str());
+			delete command;
+			return;
+		}
+	}
+	switch (command->action) {
+	case VOICE_COMMAND_SCENE:
+		obs_frontend_set_current_scene(source);
+		break;
+	case VOICE_COMMAND_START_RECORDING:
+		obs_frontend_recording_start();
+		break;
+	case VOICE_COMMAND_STOP_RECORDING:
+		obs_frontend_recording_stop();
+		break;
+	case VOICE_COMMAND_START_STREAMING:
+		obs_frontend_streaming_start();
+		break;
+	case VOICE_COMMAND_STOP_STREAMING:
+		obs_frontend_streaming_stop();
+		break;
+	case VOICE_COMMAND_SAVE_REPLAY:
+		obs_frontend_replay_buffer_save();
+		break;
+	case VOICE_COMMAND_MUTE:
+		obs_source_set_muted(source, true);
+		break;
+	case VOICE_COMMAND_UNMUTE:
+		obs_source_set_muted(source, false);
+		break;
+	}
+	obs_source_release(source);
+	delete command;
+}
+
+void voice_command_execute(const struct voice_command &command)
+{
+	obs_log(LOG_INFO, "voice command: %s", command.phrase.c_str());
+	obs_queue_task(OBS_TASK_UI, execute_on_ui_thread, new voice_command(command), false);
+}
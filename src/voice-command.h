@@ -0,0 +1,73 @@
+#ifndef VOICE_COMMAND_H
+#define VOICE_COMMAND_H
+
+#include <whisper.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "logits-filter.h"
+
+enum VoiceCommandAction {
+	VOICE_COMMAND_SCENE,
+	VOICE_COMMAND_START_RECORDING,
+	VOICE_COMMAND_STOP_RECORDING,
+	VOICE_COMMAND_START_STREAMING,
+	VOICE_COMMAND_STOP_STREAMING,
+	VOICE_COMMAND_SAVE_REPLAY,
+	VOICE_COMMAND_MUTE,
+	VOICE_COMMAND_UNMUTE,
+};
+
+struct voice_command {
+	std::string phrase;
+	VoiceCommandAction action;
+	// scene or source name
+	std::string target;
+};
+
+struct voice_command_trie_node {
+	std::map<whisper_token, size_t> children;
+	// index of the command the path spells, -1 inside a phrase
+	int command = -1;
+};
+
+// Phrase list compiled to a token trie in the vocabulary of one model. Decoding is constrained
+// to the paths of the trie, so the model can only say one of the commands.
+struct voice_command_grammar {
+	// one "phrase = action" per line, e.g. "switch to camera two = scene:Camera 2"
+	std::string spec;
+	struct whisper_context *ctx = nullptr;
+	std::vector<voice_command> commands;
+	// nodes[0] is the root
+	std::vector<voice_command_trie_node> nodes;
+	int max_phrase_tokens = 0;
+};
+
+// Probability the unconstrained model gives to the path the constrained decoder took
+struct voice_command_score {
+	double sum_logprob = 0.0;
+	int n_tokens = 0;
+	// log-probabilities of the allowed text tokens at the last step
+	std::map<whisper_token, float> last_step;
+	int last_step_tokens = -1;
+};
+
+// Parse spec and tokenize the phrases with the vocabulary of ctx, returns false on an empty
+// or invalid list. Does nothing if spec and ctx did not change.
+bool voice_command_grammar_build(struct voice_command_grammar *grammar, const std::string &spec,
+				 struct whisper_context *ctx);
+// Restrict the text tokens to the grammar, scoring the path in score
+void logits_filter_chain_add_voice_command(struct logits_filter_chain *chain,
+					   const struct voice_command_grammar *grammar,
+					   struct voice_command_score *score);
+// Command spelled by the decoded tokens, -1 if they do not end on a complete phrase
+int voice_command_match(const struct voice_command_grammar *grammar, struct whisper_context *ctx,
+			const std::vector<whisper_token> &tokens);
+double voice_command_confidence(const struct voice_command_score *score);
+// Run the action of the command on the OBS UI thread
+void voice_command_execute(const struct voice_command &command);
+
+#endif // VOICE_COMMAND_H
@@ -0,0 +1,378 @@
+#include "wake-word.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include "plugin-support.h"
+
+#include <whisper.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <fstream>
+
+// 25 ms analysis frames every 10 ms
+#define WAKE_WORD_FRAME_SAMPLES 400
+#define WAKE_WORD_HOP_SAMPLES 160
+#define WAKE_WORD_FFT_SIZE 512
+#define WAKE_WORD_N_MELS 26
+// cepstral coefficients 1..12, c0 (loudness) is left out
+#define WAKE_WORD_N_COEFFS 12
+#define WAKE_WORD_ENROLL_SAMPLES 3
+// utterances this much longer or shorter than a sample cannot be the wake word
+#define WAKE_WORD_MAX_LENGTH_RATIO 1.6
+// a match may be this much further from the samples than they are from each other
+#define WAKE_WORD_THRESHOLD_SCALE 1.3f
+#define WAKE_WORD_FILE "wake-word.bin"
+#define WAKE_WORD_FILE_MAGIC 0x57575643 // "CVWW"
+// counts past these in the wake word file mean it is corrupt
+#define WAKE_WORD_MAX_TEMPLATES 16
+#define WAKE_WORD_MAX_FRAMES (10 * WHISPER_SAMPLE_RATE / WAKE_WORD_HOP_SAMPLES)
+
+struct mfcc_tables {
+	float window[WAKE_WORD_FRAME_SAMPLES];
+	// triangular mel filters over the FFT bins
+	std::vector<float> filters[WAKE_WORD_N_MELS];
+	size_t filter_start[WAKE_WORD_N_MELS];
+	float dct[WAKE_WORD_N_COEFFS][WAKE_WORD_N_MELS];
+};
+
+static float hz_to_mel(float hz)
+{
+	return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float mel_to_hz(float mel)
+{
+	return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+static const mfcc_tables &get_mfcc_tables()
+{
+	static const mfcc_tables tables = [] {
+		mfcc_tables t;
+		for (int i = 0; i < WAKE_WORD_FRAME_SAMPLES; i++) {
+			t.window[i] = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * (float)i /
+							   (WAKE_WORD_FRAME_SAMPLES - 1));
+		}
+		// 100 Hz to 7.6 kHz, the range of speech the 16 kHz audio keeps
+		const float mel_low = hz_to_mel(100.0f);
+		const float mel_high = hz_to_mel(7600.0f);
+		float bins[WAKE_WORD_N_MELS + 2];
+		for (int m = 0; m < WAKE_WORD_N_MELS + 2; m++) {
+			const float hz = mel_to_hz(mel_low + (mel_high - mel_low) * (float)m /
+								   (WAKE_WORD_N_MELS + 1));
+			bins[m] = hz * WAKE_WORD_FFT_SIZE / WHISPER_SAMPLE_RATE;
+		}
+		for (int m = 0; m < WAKE_WORD_N_MELS; m++) {
+			const size_t start = (size_t)ceilf(bins[m]);
+			const size_t end = (size_t)floorf(bins[m + 2]);
+			t.filter_start[m] = start;
+			const float left = bins[m];
+			const float center = bins[m + 1];
+			const float right = bins[m + 2];
+			for (size_t k = start; k <= end; k++) {
+				const float f = (float)k;
+				const float weight = f <= center ? (f - left) / (center - left)
+								 : (right - f) / (right - center);
+				t.filters[m].push_back(weight);
+			}
+		}
+		for (int c = 0; c < WAKE_WORD_N_COEFFS; c++) {
+			for (int m = 0; m < WAKE_WORD_N_MELS; m++) {
+				const float phase = (float)M_PI * (float)(c + 1) / WAKE_WORD_N_MELS;
+				t.dct[c][m] = cosf(phase * ((float)m + 0.5f));
+			}
+		}
+		return t;
+	}();
+	return tables;
+}
+
+// In-place radix-2 FFT
+static void fft(std::vector<std::complex<float>> &x)
+{
+	const size_t n = x.size();
+	for (size_t i = 1, j = 0; i < n; i++) {
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			std::swap(x[i], x[j]);
+		}
+	}
+	for (size_t len = 2; len <= n; len <<= 1) {
+		const float angle = -2.0f * (float)M_PI / (float)len;
+		const std::complex<float> step(cosf(angle), sinf(angle));
+		for (size_t i = 0; i < n; i += len) {
+			std::complex<float> w(1.0f, 0.0f);
+			for (size_t k = 0; k < len / 2; k++) {
+				const std::complex<float> u = x[i + k];
+				const std::complex<float> v = x[i + k + len / 2] * w;
+				x[i + k] = u + v;
+				x[i + k + len / 2] = u - v;
+				w *= step;
+			}
+		}
+	}
+}
+
+// MFCCs of an utterance with the mean of each coefficient removed, so the microphone and
+// room color the samples and the live audio alike
+static wake_word_template compute_features(const std::vector<float> &pcm16k)
+{
+	const mfcc_tables &tables = get_mfcc_tables();
+	wake_word_template result;
+	if (pcm16k.size() < WAKE_WORD_FRAME_SAMPLES) {
+		return result;
+	}
+	result.n_frames = (pcm16k.size() - WAKE_WORD_FRAME_SAMPLES) / WAKE_WORD_HOP_SAMPLES + 1;
+	result.features.resize(result.n_frames * WAKE_WORD_N_COEFFS);
+
+	std::vector<std::complex<float>> spectrum(WAKE_WORD_FFT_SIZE);
+	float power[WAKE_WORD_FFT_SIZE / 2 + 1];
+	float log_mel[WAKE_WORD_N_MELS];
+	for (size_t f = 0; f < result.n_frames; f++) {
+		const float *frame = pcm16k.data() + f * WAKE_WORD_HOP_SAMPLES;
+		for (size_t i = 0; i < WAKE_WORD_FFT_SIZE; i++) {
+			spectrum[i] = i < WAKE_WORD_FRAME_SAMPLES ? frame[i] * tables.window[i]
+								  : 0.0f;
+		}
+		fft(spectrum);
+		for (size_t k = 0; k <= WAKE_WORD_FFT_SIZE / 2; k++) {
+			power[k] = std::norm(spectrum[k]);
+		}
+		for (int m = 0; m < WAKE_WORD_N_MELS; m++) {
+			float energy = 0.0f;
+			for (size_t k = 0; k < tables.filters[m].size(); k++) {
+				energy += tables.filters[m][k] * power[tables.filter_start[m] + k];
+			}
+			log_mel[m] = logf(energy + 1e-10f);
+		}
+		float *coeffs = result.features.data() + f * WAKE_WORD_N_COEFFS;
+		for (int c = 0; c < WAKE_WORD_N_COEFFS; c++) {
+			float sum = 0.0f;
+			for (int m = 0; m < WAKE_WORD_N_MELS; m++) {
+				sum += tables.dct[c][m] * log_mel[m];
+			}
+			coeffs[c] = sum;
+		}
+	}
+
+	for (int c = 0; c < WAKE_WORD_N_COEFFS; c++) {
+		float mean = 0.0f;
+		for (size_t f = 0; f < result.n_frames; f++) {
+			mean += result.features[f * WAKE_WORD_N_COEFFS + c];
+		}
+		mean /= (float)result.n_frames;
+		for (size_t f = 0; f < result.n_frames; f++) {
+			result.features[f * WAKE_WORD_N_COEFFS + c] -= mean;
+		}
+	}
+	return result;
+}
+
+// Dynamic time warping distance per step of the alignment, infinite for too different lengths
+static float dtw_distance(const wake_word_template &a, const wake_word_template &b)
+{
+	const size_t n = a.n_frames;
+	const size_t m = b.n_frames;
+	if (n == 0 || m == 0 ||
+	    (double)std::max(n, m) > (double)std::min(n, m) * WAKE_WORD_MAX_LENGTH_RATIO) {
+		return INFINITY;
+	}
+	std::vector<float> previous(m + 1, INFINITY);
+	std::vector<float> current(m + 1, INFINITY);
+	previous[0] = 0.0f;
+	for (size_t i = 1; i <= n; i++) {
+		current[0] = INFINITY;
+		const float *x = a.features.data() + (i - 1) * WAKE_WORD_N_COEFFS;
+		for (size_t j = 1; j <= m; j++) {
+			const float *y = b.features.data() + (j - 1) * WAKE_WORD_N_COEFFS;
+			float d = 0.0f;
+			for (int c = 0; c < WAKE_WORD_N_COEFFS; c++) {
+				d += (x[c] - y[c]) * (x[c] - y[c]);
+			}
+			current[j] = sqrtf(d) +
+				     std::min({previous[j], current[j - 1], previous[j - 1]});
+		}
+		std::swap(previous, current);
+	}
+	return previous[m] / (float)(n + m);
+}
+
+// Matching threshold from how far the samples are from each other
+static float learn_threshold(const std::vector<wake_word_template> &templates)
+{
+	float sum = 0.0f;
+	int count = 0;
+	for (size_t i = 0; i < templates.size(); i++) {
+		for (size_t j = i + 1; j < templates.size(); j++) {
+			const float d = dtw_distance(templates[i], templates[j]);
+			if (std::isfinite(d)) {
+				sum += d;
+				count++;
+			}
+		}
+	}
+	return count > 0 ? sum / (float)count * WAKE_WORD_THRESHOLD_SCALE : 0.0f;
+}
+
+static std::string templates_path()
+{
+	char *path = obs_module_config_path(WAKE_WORD_FILE);
+	const std::string result = path ? path : "";
+	bfree(path);
+	return result;
+}
+
+static bool save_templates(const struct wake_word_spotter *spotter)
+{
+	char *config_dir = obs_module_config_path("");
+	if (config_dir != nullptr) {
+		os_mkdirs(config_dir);
+		bfree(config_dir);
+	}
+	const std::string path = templates_path();
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		obs_log(LOG_ERROR, "cannot write the wake word to %s", path.c_str());
+		return false;
+	}
+	const uint32_t header[2] = {WAKE_WORD_FILE_MAGIC, (uint32_t)spotter->templates.size()};
+	file.write(reinterpret_cast<const char *>(header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(&spotter->threshold), sizeof(float));
+	for (const wake_word_template &t : spotter->templates) {
+		const uint32_t n_frames = (uint32_t)t.n_frames;
+		file.write(reinterpret_cast<const char *>(&n_frames), sizeof(n_frames));
+		file.write(reinterpret_cast<const char *>(t.features.data()),
+			   t.features.size() * sizeof(float));
+	}
+	return (bool)file;
+}
+
+bool wake_word_load(struct wake_word_spotter *spotter)
+{
+	spotter->templates.clear();
+	std::ifstream file(templates_path(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	uint32_t header[2] = {0, 0};
+	file.read(reinterpret_cast<char *>(header), sizeof(header));
+	file.read(reinterpret_cast<char *>(&spotter->threshold), sizeof(float));
+	if (!file || header[0] != WAKE_WORD_FILE_MAGIC || header[1] > WAKE_WORD_MAX_TEMPLATES) {
+		obs_log(LOG_WARNING, "invalid wake word file");
+		return false;
+	}
+	for (uint32_t i = 0; i < header[1]; i++) {
+		wake_word_template t;
+		uint32_t n_frames = 0;
+		file.read(reinterpret_cast<char *>(&n_frames), sizeof(n_frames));
+		if (!file || n_frames == 0 || n_frames > WAKE_WORD_MAX_FRAMES) {
+			spotter->templates.clear();
+			obs_log(LOG_WARNING, "invalid wake word file");
+			return false;
+		}
+		t.n_frames = n_frames;
+		t.features.resize((size_t)n_frames * WAKE_WORD_N_COEFFS);
+		file.read(reinterpret_cast<char *>(t.features.data()),
+			  t.features.size() * sizeof(float));
+		if (!file) {
+			spotter->templates.clear();
+			obs_log(LOG_WARNING, "truncated wake word file");
+			return false;
+		}
+		spotter->templates.push_back(std::move(t));
+	}
+	obs_log(LOG_INFO, "wake word loaded: %d samples, threshold %.2f",
+		(int)spotter->templates.size(), spotter->threshold);
+	return !spotter->templates.empty();
+}
+
+void wake_word_start_enrollment(struct wake_word_spotter *spotter)
+{
+	obs_log(LOG_INFO, "say the wake word %d times", WAKE_WORD_ENROLL_SAMPLES);
+	// samples of an enrollment that was started again are not kept
+	spotter->enroll_requested++;
+}
+
+void wake_word_advance(struct wake_word_spotter *spotter, uint64_t end_ns)
+{
+	spotter->audio_end_ns = std::max(spotter->audio_end_ns, end_ns);
+}
+
+bool wake_word_listening(const struct wake_word_spotter *spotter)
+{
+	return spotter->audio_end_ns < spotter->listen_until_ns;
+}
+
+// Keep an utterance as a sample of the wake word, the last one replaces the stored samples
+static void enroll(struct wake_word_spotter *spotter, const std::vector<float> &utterance)
+{
+	// a start from the UI thread at any point before this begins a new enrollment, one after
+	// it is picked up with the next utterance
+	const uint32_t generation = spotter->enroll_requested.load();
+	if (generation != spotter->enroll_generation) {
+		spotter->enrolling.clear();
+		spotter->enroll_generation = generation;
+	}
+	wake_word_template t = compute_features(utterance);
+	if (t.n_frames == 0) {
+		return;
+	}
+	spotter->enrolling.push_back(std::move(t));
+	const int remaining = WAKE_WORD_ENROLL_SAMPLES - (int)spotter->enrolling.size();
+	obs_log(LOG_INFO, "wake word sample recorded, %d to go", std::max(0, remaining));
+	if (remaining > 0) {
+		return;
+	}
+	const float threshold = learn_threshold(spotter->enrolling);
+	if (threshold <= 0.0f) {
+		obs_log(LOG_WARNING, "the wake word samples differ too much, record them again");
+	} else {
+		spotter->templates.swap(spotter->enrolling);
+		spotter->threshold = threshold;
+		spotter->warned_no_templates = false;
+		save_templates(spotter);
+		obs_log(LOG_INFO, "wake word recorded, threshold %.2f", threshold);
+	}
+	spotter->enrolling.clear();
+	spotter->enroll_finished = generation;
+}
+
+bool wake_word_push(struct wake_word_spotter *spotter, const float *pcm16k, size_t n_samples,
+		    uint64_t listen_ns)
+{
+	if (!utterance_endpointer_push(&spotter->endpointer, pcm16k, n_samples)) {
+		return false;
+	}
+	const std::vector<float> &utterance = spotter->endpointer.ended;
+	if (spotter->enroll_requested.load() != spotter->enroll_finished) {
+		enroll(spotter, utterance);
+		return false;
+	}
+	if (spotter->templates.empty()) {
+		if (!spotter->warned_no_templates) {
+			obs_log(LOG_WARNING, "no wake word recorded yet");
+			spotter->warned_no_templates = true;
+		}
+		return false;
+	}
+
+	const wake_word_template features = compute_features(utterance);
+	float best = INFINITY;
+	for (const wake_word_template &t : spotter->templates) {
+		best = std::min(best, dtw_distance(features, t));
+	}
+	if (!(best < spotter->threshold)) {
+		return false;
+	}
+	obs_log(LOG_INFO, "wake word detected (distance %.2f, threshold %.2f)", best,
+		spotter->threshold);
+	spotter->listen_until_ns = spotter->audio_end_ns + listen_ns;
+	return true;
+}
@@ -0,0 +1,52 @@
+#ifndef WAKE_WORD_H
+#define WAKE_WORD_H
+
+#include "utterance-endpointer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// MFCC frames (WAKE_WORD_N_COEFFS each) of one recorded sample of the wake word
+struct wake_word_template {
+	std::vector<float> features;
+	size_t n_frames = 0;
+};
+
+// Cheap keyword spotter in front of whisper. Utterances are cut out of the audio by energy and
+// compared to recorded samples of the wake word by dynamic time warping of their MFCCs, which
+// costs a fraction of a millisecond per utterance. Only a hit opens transcription for a while.
+struct wake_word_spotter {
+	std::vector<wake_word_template> templates;
+	// DTW distance below which an utterance matches, learned from the spread of the samples
+	float threshold = 0.0f;
+	// samples still to record, set from the UI thread
+	// enrollments started, only ever incremented by the UI thread
+	std::atomic<uint32_t> enroll_requested{0};
+	// owned by the audio thread: the enrollment the samples in enrolling belong to and the
+	// last one finished, enrollment runs while it is behind enroll_requested
+	uint32_t enroll_generation = 0;
+	uint32_t enroll_finished = 0;
+	std::vector<wake_word_template> enrolling;
+	struct utterance_endpointer endpointer;
+	// clock-domain end of the audio seen so far, and of the transcription opened by a hit
+	uint64_t audio_end_ns = 0;
+	uint64_t listen_until_ns = 0;
+	bool warned_no_templates = false;
+};
+
+// Samples of the wake word are shared by all filters and kept in the plugin config directory
+bool wake_word_load(struct wake_word_spotter *spotter);
+// Record the next utterances as the new wake word
+void wake_word_start_enrollment(struct wake_word_spotter *spotter);
+// Note the end of the audio the filter took in, whether it went through the spotter or not
+void wake_word_advance(struct wake_word_spotter *spotter, uint64_t end_ns);
+// Whether transcription is open after a hit
+bool wake_word_listening(const struct wake_word_spotter *spotter);
+// Feed a chunk of 16 kHz audio. Returns true on a hit, which opens transcription for listen_ns.
+bool wake_word_push(struct wake_word_spotter *spotter, const float *pcm16k, size_t n_samples,
+		    uint64_t listen_ns);
+
+#endif // WAKE_WORD_H
@@ -1,16 +1,50 @@
 #include <whisper.h>
 
 #include <obs-module.h>
+#include <util/platform.h>
 
 #include "plugin-support.h"
 #include "transcription-filter-data.h"
 #include "whisper-processing.h"
+#include "language-router.h"
+#include "vad-timeline.h"
+#include "logits-filter.h"
+#include "ngram-lm.h"
+#include "token-budget.h"
+#include "voice-command.h"
+#include "wake-word.h"
+#include "word-carry.h"
+#include "pipeline-queue.h"
+#include "power-profile.h"
+#include "input-quality.h"
+#include "model-utils/model-registry.h"
 
 #include <algorithm>
 #include <cctype>
+#include <cstdlib>
+#include <thread>
 
 #define VAD_THOLD 0.0001f
+// the low-power profile needs this much more energy before it runs whisper on a window
+#define LOW_POWER_VAD_THOLD_FACTOR 4.0f
 #define FREQ_THOLD 100.0f
+// windows whose packets all peak below this (-50 dBFS) are silent without further analysis
+#define INGEST_SILENCE_PEAK_THOLD 0.00316f
+// pause length left in place of a removed pause
+#define SILENCE_COMPRESSION_KEEP_MSEC 100
+// commands the unconstrained model finds less likely than this were not said
+#define VOICE_COMMAND_MIN_CONFIDENCE 0.3
+// the worker may take this many times its usual decode time before it counts as hung
+#define WORKER_TIMEOUT_RTF_MARGIN 4.0f
+#define WORKER_MIN_TIMEOUT_MS 5000
+// until a window has been timed, a large model on CPU with beam search needs a while
+#define WORKER_FIRST_TIMEOUT_MS 60000
+// weight of the newest window in worker_rtf
+#define WORKER_RTF_SMOOTHING 0.2f
+// the window start follows the ingest timestamps once they disagree by more than this
+#define WINDOW_RESYNC_THRESHOLD_NS 20000000ULL
+// encoder positions are 20 ms, shorter windows are still encoded over 5 s
+#define MIN_AUDIO_CTX 256
 
 // Taken from https://github.com/ggerganov/whisper.cpp/blob/master/examples/stream/stream.cpp
 std::string to_timestamp(int64_t t)
@@ -70,10 +104,42 @@ bool vad_simple(float *pcmf32, size_t pcm32f_size, uint32_t sample_rate, float v
 	return true;
 }
 
+// Encoder context covering n_samples of audio instead of the 30 s whisper pads every window to
+static int window_audio_ctx(struct whisper_context *ctx, size_t n_samples)
+{
+	return std::min(whisper_n_audio_ctx(ctx),
+			std::max(MIN_AUDIO_CTX, (int)(n_samples / (WHISPER_SAMPLE_RATE / 50)) + 1));
+}
+
+// The prompt whisper builds in the state with no_context off: the initial prompt followed by
+// the text of the previous windows, within the text context whisper allows for it
+static std::vector<whisper_token> context_prompt(struct whisper_context *ctx,
+						 const whisper_full_params &params,
+						 const std::vector<whisper_token> &past)
+{
+	const int max_tokens = std::min(params.n_max_text_ctx, whisper_n_text_ctx(ctx) / 2);
+	std::vector<whisper_token> prompt((size_t)std::max(0, max_tokens));
+	int n_prompt = 0;
+	if (params.initial_prompt != nullptr && params.initial_prompt[0] != '\0') {
+		n_prompt = std::max(0, whisper_tokenize(ctx, params.initial_prompt, prompt.data(),
+							(int)prompt.size()));
+	}
+	const size_t n_past = std::min(past.size(), prompt.size() - (size_t)n_prompt);
+	std::copy(past.end() - n_past, past.end(), prompt.begin() + n_prompt);
+	prompt.resize((size_t)n_prompt + n_past);
+	return prompt;
+}
+
 struct whisper_context *init_whisper_context(const std::string &model_path)
 {
-	obs_log(LOG_INFO, "Loading whisper model from %s", model_path.c_str());
-	struct whisper_context *ctx = whisper_init_from_file(obs_module_file(model_path.c_str()));
+	char *model_file_path = obs_module_file(model_path.c_str());
+	if (model_file_path == nullptr) {
+		obs_log(LOG_ERROR, "Whisper model %s not found", model_path.c_str());
+		return nullptr;
+	}
+	// filters using the same model share it
+	struct whisper_context *ctx = model_registry_acquire(model_file_path);
+	bfree(model_file_path);
 	if (ctx == nullptr) {
 		obs_log(LOG_ERROR, "Failed to load whisper model");
 		return nullptr;
@@ -82,205 +148,805 @@ struct whisper_context *init_whisper_context(const std::string &model_path)
 	return ctx;
 }
 
-enum DetectionResult {
-	DETECTION_RESULT_UNKNOWN = 0,
-	DETECTION_RESULT_SILENCE = 1,
-	DETECTION_RESULT_SPEECH = 2,
-};
+static void low_power_model_load(struct transcription_filter_data *gf)
+{
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
+		path = gf->low_power_requested_path;
+	}
+	bool done = false;
+	while (!done) {
+		// a failed load is not retried until the setting changes
+		struct whisper_context *ctx = path.empty() ? nullptr : init_whisper_context(path);
+		{
+			std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
+			if (gf->low_power_requested_path != path) {
+				// changed again while loading, load the newer path
+				path = gf->low_power_requested_path;
+			} else {
+				std::swap(ctx, gf->low_power_context);
+				if (gf->low_power_context != nullptr) {
+					gf->stats->model_loads++;
+				}
+				gf->low_power_loading = false;
+				done = true;
+			}
+		}
+		// the replaced or outdated model, released without holding the lock
+		model_registry_release(ctx);
+	}
+}
 
-struct DetectionResultWithText {
-	DetectionResult result;
-	std::string text;
-};
+void low_power_model_configure(struct transcription_filter_data *gf, const std::string &path)
+{
+	// the profile only switches models if it has a model of its own
+	const std::string requested = path != gf->whisper_model_path ? path : "";
+	std::thread finished_thread;
+	{
+		std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
+		if (requested == gf->low_power_requested_path) {
+			return;
+		}
+		gf->low_power_requested_path = requested;
+		if (gf->low_power_loading) {
+			// the running load picks up the new path
+			return;
+		}
+		gf->low_power_loading = true;
+		finished_thread.swap(gf->low_power_load_thread);
+		gf->low_power_load_thread = std::thread(low_power_model_load, gf);
+	}
+	// the previous load has already swapped its model in
+	if (finished_thread.joinable()) {
+		finished_thread.join();
+	}
+}
+
+void low_power_model_wait(struct transcription_filter_data *gf)
+{
+	if (gf->low_power_load_thread.joinable()) {
+		gf->low_power_load_thread.join();
+	}
+}
+
+// Half the threads and greedy decoding, the bulk of the cost of beam search
+static void apply_low_power_params(whisper_full_params &params)
+{
+	params.n_threads = std::max(1, params.n_threads / 2);
+	params.strategy = WHISPER_SAMPLING_GREEDY;
+	params.greedy.best_of = 1;
+}
+
+bool start_inference_backend(struct transcription_filter_data *gf)
+{
+	if (gf->inference_backend == INFERENCE_BACKEND_WORKER_PROCESS) {
+		char *model_file_path = obs_module_file(gf->whisper_model_path.c_str());
+		if (model_file_path == nullptr) {
+			obs_log(LOG_ERROR, "Whisper model %s not found",
+				gf->whisper_model_path.c_str());
+			return false;
+		}
+		gf->inference_worker = inference_worker_create(model_file_path);
+		gf->worker_rtf = 0.0f;
+		bfree(model_file_path);
+		if (gf->inference_worker == nullptr) {
+			return false;
+		}
+		gf->stats->model_loads++;
+		gf->backend_ready = true;
+		return true;
+	}
+	if (gf->inference_backend == INFERENCE_BACKEND_REMOTE) {
+		// without a valid address every window simply runs locally
+		gf->remote_worker = remote_worker_create(gf->remote_worker_address);
+	}
+	gf->whisper_context = init_whisper_context(gf->whisper_model_path);
+	if (gf->whisper_context == nullptr) {
+		return false;
+	}
+	gf->stats->model_loads++;
+	gf->backend_ready = true;
+	return true;
+}
+
+void stop_inference_backend(struct transcription_filter_data *gf)
+{
+	gf->backend_ready = false;
+	// the context of the previous windows is in the vocabulary of the model
+	gf->prompt_past->clear();
+	if (gf->whisper_context != nullptr) {
+		model_registry_release(gf->whisper_context);
+		gf->whisper_context = nullptr;
+	}
+	if (gf->inference_worker != nullptr) {
+		inference_worker_destroy(gf->inference_worker);
+		gf->inference_worker = nullptr;
+	}
+	if (gf->remote_worker != nullptr) {
+		remote_worker_destroy(gf->remote_worker);
+		gf->remote_worker = nullptr;
+	}
+}
+
+bool inference_backend_ready(struct transcription_filter_data *gf)
+{
+	return gf->backend_ready;
+}
+
+// Lowercase text without trailing whitespace
+static std::string caption_text(const std::string &text)
+{
+	std::string text_lower(text);
+	std::transform(text_lower.begin(), text_lower.end(), text_lower.begin(), ::tolower);
+	text_lower.erase(std::find_if(text_lower.rbegin(), text_lower.rend(),
+				      [](unsigned char ch) { return !std::isspace(ch); })
+				 .base(),
+			 text_lower.end());
+	return text_lower;
+}
+
+// Clock-domain time of a whisper timestamp (10 ms units) relative to the window start
+static uint64_t window_time_ns(struct transcription_filter_data *gf, uint64_t start_timestamp_ns,
+			       int64_t t)
+{
+	const uint64_t samples_per_t = WHISPER_SAMPLE_RATE / 100;
+	return start_timestamp_ns + clock_domain_duration_ns(gf->clock_domain,
+							     (uint64_t)t * samples_per_t,
+							     WHISPER_SAMPLE_RATE);
+}
 
 struct DetectionResultWithText run_whisper_inference(struct transcription_filter_data *gf,
-						     const float *pcm32f_data, size_t pcm32f_size)
+						     const float *pcm32f_data, size_t pcm32f_size,
+						     uint64_t start_timestamp_ns,
+						     const struct vad_timeline *timeline)
 {
 	obs_log(gf->log_level, "%s: processing %d samples, %.3f sec, %d threads", __func__,
 		int(pcm32f_size), float(pcm32f_size) / WHISPER_SAMPLE_RATE,
 		gf->whisper_params.n_threads);
 
 	std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
-	if (gf->whisper_context == nullptr) {
-		obs_log(LOG_WARNING, "whisper context is null");
-		return {DETECTION_RESULT_UNKNOWN, ""};
-	}
 
-	// run the inference
-	int whisper_full_result = -1;
-	try {
-		whisper_full_result = whisper_full(gf->whisper_context, gf->whisper_params,
-						   pcm32f_data, (int)pcm32f_size);
-	} catch (const std::exception &e) {
-		obs_log(LOG_ERROR, "Whisper exception: %s. Filter restart is required", e.what());
-		whisper_free(gf->whisper_context);
-		gf->whisper_context = nullptr;
-		return {DETECTION_RESULT_UNKNOWN, ""};
+	const int speech_ms = (int)(pcm32f_size * 1000 / WHISPER_SAMPLE_RATE);
+	whisper_full_params params = gf->whisper_params;
+	if (gf->adaptive_max_tokens) {
+		params.max_tokens = token_budget_for_window(gf->token_budget, speech_ms,
+							    gf->whisper_params.max_tokens);
+		obs_log(gf->log_level, "token budget %d for %d ms (%.1f words/s)",
+			params.max_tokens, speech_ms, gf->token_budget->words_per_sec);
 	}
 
-	if (whisper_full_result != 0) {
-		obs_log(LOG_WARNING, "failed to process audio, error %d", whisper_full_result);
-		return {DETECTION_RESULT_UNKNOWN, ""};
+	std::string text;
+	// text tokens of the result, -1 when the backend does not report them
+	int n_text_tokens = -1;
+	int64_t t0 = 0;
+	int64_t t1 = 0;
+	float sentence_p = 0.0f;
+	bool no_speech = false;
+	// words of the local decode, to end the caption on a word boundary
+	std::vector<decoded_word> words;
+	bool word_timing = false;
+	// without word timing the next window overlaps this one by a fixed amount
+	gf->word_carry_ms = -1;
+	gf->carried_hypothesis->text.clear();
+	struct worker_response_header response;
+	// fall back to local inference once the remote worker is slower than real time
+	const uint32_t remote_timeout_ms =
+		std::max<uint32_t>(1000, (uint32_t)(pcm32f_size * 1000 / WHISPER_SAMPLE_RATE));
+
+	if (gf->remote_worker != nullptr &&
+	    remote_worker_run(gf->remote_worker, params, pcm32f_data, pcm32f_size,
+			      remote_timeout_ms, response, text) &&
+	    response.status == 0) {
+		t0 = response.t0;
+		t1 = response.t1;
+		sentence_p = response.sentence_p;
+		no_speech = response.no_speech != 0;
+	} else if (gf->inference_worker != nullptr) {
+		if (gf->low_power) {
+			apply_low_power_params(params);
+		}
+		// a hung worker should not stall the pipeline forever, a slow one should not be
+		// killed for being as slow as usual
+		const float audio_ms = (float)pcm32f_size * 1000.0f / WHISPER_SAMPLE_RATE;
+		const uint32_t timeout_ms =
+			gf->worker_rtf > 0.0f
+				? std::max<uint32_t>(WORKER_MIN_TIMEOUT_MS,
+						     (uint32_t)(audio_ms * gf->worker_rtf *
+								WORKER_TIMEOUT_RTF_MARGIN))
+				: WORKER_FIRST_TIMEOUT_MS;
+		const auto worker_start = std::chrono::steady_clock::now();
+		if (!inference_worker_run(gf->inference_worker, params, pcm32f_data,
+					  pcm32f_size, timeout_ms, response, text)) {
+			const auto elapsed = std::chrono::steady_clock::now() - worker_start;
+			if (elapsed >= std::chrono::milliseconds(timeout_ms)) {
+				// allow the next windows twice as long, the window may have been
+				// slow rather than the worker hung
+				gf->worker_rtf *= 2.0f;
+			}
+			return {DETECTION_RESULT_UNKNOWN, "", 0, 0};
+		}
+		if (response.status != 0) {
+			obs_log(LOG_WARNING, "failed to process audio, error %d", response.status);
+			return {DETECTION_RESULT_UNKNOWN, "", 0, 0};
+		}
+		if (audio_ms > 0.0f && response.inference_us > 0) {
+			const float rtf = (float)response.inference_us / 1000.0f / audio_ms;
+			const float weight = gf->worker_rtf > 0.0f ? WORKER_RTF_SMOOTHING : 1.0f;
+			gf->worker_rtf += weight * (rtf - gf->worker_rtf);
+		}
+		t0 = response.t0;
+		t1 = response.t1;
+		sentence_p = response.sentence_p;
+		no_speech = response.no_speech != 0;
 	} else {
+		text.clear();
+		if (gf->whisper_context == nullptr) {
+			obs_log(LOG_WARNING, "whisper context is null");
+			return {DETECTION_RESULT_UNKNOWN, "", 0, 0};
+		}
+
+		struct whisper_context *ctx = gf->whisper_context;
+		if (gf->low_power) {
+			apply_low_power_params(params);
+			// the smaller model if it is loaded, the whisper model until then
+			if (gf->low_power_context != nullptr) {
+				ctx = gf->low_power_context;
+			}
+		}
+		model_state_lease lease(ctx);
+		if (lease.state == nullptr) {
+			return {DETECTION_RESULT_UNKNOWN, "", 0, 0};
+		}
+		struct whisper_state *state = lease.state;
+		std::string routed_language;
+		if (language_router_enabled(gf->language_router) && whisper_is_multilingual(ctx)) {
+			const struct language_route *route = language_router_select(
+				gf->language_router, ctx, state, pcm32f_data, pcm32f_size,
+				start_timestamp_ns, params.n_threads, routed_language);
+			if (!routed_language.empty()) {
+				// also spares whisper_full another language detection
+				params.language = routed_language.c_str();
+			}
+			if (route != nullptr) {
+				// the route model has a pool of its own
+				ctx = route->ctx;
+				lease.reset(ctx);
+				if (lease.state == nullptr) {
+					return {DETECTION_RESULT_UNKNOWN, "", 0, 0};
+				}
+				state = lease.state;
+			}
+		}
+
+		// a pooled state holds the context of whichever stream used it last, so the
+		// filter keeps its own and passes it as the prompt
+		std::vector<whisper_token> prompt;
+		const bool keep_context = !params.no_context && ctx == gf->whisper_context;
+		if (!params.no_context) {
+			if (keep_context) {
+				prompt = context_prompt(ctx, params, *gf->prompt_past);
+				params.prompt_tokens = prompt.data();
+				params.prompt_n_tokens = (int)prompt.size();
+			}
+			params.no_context = true;
+		}
+		if (gf->window_audio_ctx) {
+			params.audio_ctx = window_audio_ctx(ctx, pcm32f_size);
+		}
+
+		if (gf->word_boundary_carry) {
+			params.token_timestamps = true;
+		}
+
+		// stop the decoder early on windows without speech
+		struct logits_filter_chain chain;
+		struct no_speech_check no_speech_check;
+		if (no_speech_check_init(&no_speech_check, params)) {
+			logits_filter_chain_add_no_speech_check(&chain, &no_speech_check);
+		}
+		if (lm_fusion_prepare(gf->lm_fusion, ctx)) {
+			logits_filter_chain_add_lm_fusion(&chain, gf->lm_fusion, ctx);
+		} else if (!gf->lm_fusion->load_error.empty()) {
+			obs_log(LOG_ERROR, "language model: %s", gf->lm_fusion->load_error.c_str());
+			gf->lm_fusion->load_error.clear();
+		}
+		logits_filter_chain_install(&chain, params);
+
+		// run the inference
+		int whisper_full_result = -1;
+		try {
+			whisper_full_result = whisper_full_with_state(
+				ctx, state, params, pcm32f_data, (int)pcm32f_size);
+		} catch (const std::exception &e) {
+			obs_log(LOG_ERROR, "Whisper exception: %s. Filter restart is required",
+				e.what());
+			stop_inference_backend(gf);
+			return {DETECTION_RESULT_UNKNOWN, "", 0, 0};
+		}
+
+		if (whisper_full_result != 0) {
+			obs_log(LOG_WARNING, "failed to process audio, error %d",
+				whisper_full_result);
+			return {DETECTION_RESULT_UNKNOWN, "", 0, 0};
+		}
+
+		no_speech = no_speech_check.no_speech;
+		if (no_speech_check.checked) {
+			obs_log(gf->log_level, "no speech probability %.2f",
+				no_speech_check.no_speech_prob);
+		}
+
 		const int n_segment = 0;
-		const char *text = whisper_full_get_segment_text(gf->whisper_context, n_segment);
-		const int64_t t0 = whisper_full_get_segment_t0(gf->whisper_context, n_segment);
-		const int64_t t1 = whisper_full_get_segment_t1(gf->whisper_context, n_segment);
-
-		float sentence_p = 0.0f;
-		const int n_tokens = whisper_full_n_tokens(gf->whisper_context, n_segment);
-		for (int j = 0; j < n_tokens; ++j) {
-			sentence_p += whisper_full_get_token_p(gf->whisper_context, n_segment, j);
-		}
-		sentence_p /= (float)n_tokens;
-
-		// convert text to lowercase
-		std::string text_lower(text);
-		std::transform(text_lower.begin(), text_lower.end(), text_lower.begin(), ::tolower);
-		// trim whitespace (use lambda)
-		text_lower.erase(std::find_if(text_lower.rbegin(), text_lower.rend(),
-					      [](unsigned char ch) { return !std::isspace(ch); })
-					 .base(),
-				 text_lower.end());
+		if (whisper_full_n_segments_from_state(state) > n_segment) {
+			text = whisper_full_get_segment_text_from_state(state, n_segment);
+			t0 = whisper_full_get_segment_t0_from_state(state, n_segment);
+			t1 = whisper_full_get_segment_t1_from_state(state, n_segment);
+
+			const int n_tokens = whisper_full_n_tokens_from_state(state, n_segment);
+			const whisper_token eot = whisper_token_eot(ctx);
+			n_text_tokens = 0;
+			for (int j = 0; j < n_tokens; ++j) {
+				sentence_p +=
+					whisper_full_get_token_p_from_state(state, n_segment, j);
+				if (whisper_full_get_token_id_from_state(state, n_segment, j) <
+				    eot) {
+					n_text_tokens++;
+				}
+			}
+			sentence_p /= (float)std::max(1, n_tokens);
+		}
+		if (gf->word_boundary_carry) {
+			words = word_carry_collect(ctx, state, n_segment);
+			word_timing = true;
+		}
+		if (keep_context) {
+			const whisper_token eot = whisper_token_eot(ctx);
+			const int n_segments = whisper_full_n_segments_from_state(state);
+			for (int i = 0; i < n_segments; i++) {
+				const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+				for (int j = 0; j < n_tokens; j++) {
+					const whisper_token id =
+						whisper_full_get_token_id_from_state(state, i, j);
+					if (id < eot) {
+						gf->prompt_past->push_back(id);
+					}
+				}
+			}
+			const size_t max_past = (size_t)whisper_n_text_ctx(ctx) / 2;
+			if (gf->prompt_past->size() > max_past) {
+				gf->prompt_past->erase(gf->prompt_past->begin(),
+						       gf->prompt_past->end() - max_past);
+			}
+		}
+	}
+
+	if (gf->adaptive_max_tokens) {
+		token_budget_update(gf->token_budget, text, n_text_tokens, speech_ms);
+	}
+
+	if (no_speech) {
+		gf->word_carry_ms = word_timing ? 0 : -1;
+		gf->stats->decoder_skipped++;
+		obs_log(gf->log_level, "no speech in the window, decoder skipped");
+		return {DETECTION_RESULT_SILENCE, "", start_timestamp_ns, start_timestamp_ns};
+	}
+
+	if (timeline != nullptr) {
+		// pauses were cut from the window, report times on the original audio
+		t0 = vad_timeline_to_original(*timeline, t0);
+		t1 = vad_timeline_to_original(*timeline, t1);
+	}
+
+	if (word_timing) {
+		const size_t window_samples = timeline ? timeline->original_samples : pcm32f_size;
+		const int64_t window_t = (int64_t)(window_samples / (WHISPER_SAMPLE_RATE / 100));
+		if (timeline != nullptr) {
+			for (decoded_word &word : words) {
+				word.t0 = vad_timeline_to_original(*timeline, word.t0);
+				word.t1 = vad_timeline_to_original(*timeline, word.t1);
+			}
+		}
+		size_t first_carried = 0;
+		const int64_t carry_t = word_carry_split(words, window_t, first_carried);
+		gf->word_carry_ms = carry_t < 0 ? -1 : (int)(carry_t * 10);
+		if (carry_t > 0) {
+			obs_log(gf->log_level, "carrying %d of %d words (%d ms) to the next window",
+				(int)(words.size() - first_carried), (int)words.size(),
+				gf->word_carry_ms);
+			// the caption of the carried words if the next window adds no speech
+			std::string carried_text;
+			for (size_t i = first_carried; i < words.size(); i++) {
+				carried_text += words[i].text;
+			}
+			*gf->carried_hypothesis = {
+				DETECTION_RESULT_SPEECH, caption_text(carried_text),
+				window_time_ns(gf, start_timestamp_ns, words[first_carried].t0),
+				window_time_ns(gf, start_timestamp_ns, words.back().t1)};
+			if (first_carried == 0) {
+				return {DETECTION_RESULT_PENDING, "", 0, 0};
+			}
+			// the caption ends with the last kept word
+			text.clear();
+			for (size_t i = 0; i < first_carried; i++) {
+				text += words[i].text;
+			}
+			t1 = words[first_carried - 1].t1;
+		}
+	}
+
+	{
+		const std::string text_lower = caption_text(text);
 
 		if (gf->log_words) {
 			obs_log(LOG_INFO, "[%s --> %s] (%.3f) %s", to_timestamp(t0).c_str(),
 				to_timestamp(t1).c_str(), sentence_p, text_lower.c_str());
 		}
 
+		const uint64_t t0_ns = window_time_ns(gf, start_timestamp_ns, t0);
+		const uint64_t t1_ns = window_time_ns(gf, start_timestamp_ns, t1);
+
 		if (text_lower.empty()) {
-			return {DETECTION_RESULT_SILENCE, ""};
+			return {DETECTION_RESULT_SILENCE, "", t0_ns, t1_ns};
 		}
 
-		return {DETECTION_RESULT_SPEECH, text_lower};
+		return {DETECTION_RESULT_SPEECH, text_lower, t0_ns, t1_ns};
 	}
 }
 
-void process_audio_from_buffer(struct transcription_filter_data *gf)
+// Recognize one utterance against the voice command grammar and run the matched action
+static void run_voice_command(struct transcription_filter_data *gf, const float *pcm16k,
+			      size_t n_samples)
 {
-	uint32_t num_new_frames_from_infos = 0;
+	std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
+	// the grammar needs the logits of the model, only a local context has them
+	if (gf->whisper_context == nullptr) {
+		obs_log(LOG_WARNING, "voice commands need the model loaded in OBS");
+		return;
+	}
+	struct whisper_context *ctx = gf->whisper_context;
+	if (!voice_command_grammar_build(gf->voice_command_grammar, gf->voice_commands, ctx)) {
+		return;
+	}
+	model_state_lease lease(ctx);
+	if (lease.state == nullptr) {
+		return;
+	}
+	struct whisper_state *state = lease.state;
+
+	whisper_full_params params = gf->whisper_params;
+	params.strategy = WHISPER_SAMPLING_GREEDY;
+	params.greedy.best_of = 1;
+	params.temperature = 0.0f;
+	params.temperature_inc = 0.0f;
+	params.no_context = true;
+	params.single_segment = true;
+	params.initial_prompt = nullptr;
+	params.prompt_tokens = nullptr;
+	params.prompt_n_tokens = 0;
+	params.suppress_blank = false;
+	// the phrase, punctuation and a timestamp pair
+	params.max_tokens = gf->voice_command_grammar->max_phrase_tokens + 3;
+	// commands are short so most of the 30 s context is skipped
+	params.audio_ctx = window_audio_ctx(ctx, n_samples);
+
+	struct logits_filter_chain chain;
+	struct voice_command_score score;
+	logits_filter_chain_add_voice_command(&chain, gf->voice_command_grammar, &score);
+	struct no_speech_check no_speech_check;
+	if (no_speech_check_init(&no_speech_check, params)) {
+		logits_filter_chain_add_no_speech_check(&chain, &no_speech_check);
+	}
+	logits_filter_chain_install(&chain, params);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	int whisper_full_result = -1;
+	try {
+		whisper_full_result =
+			whisper_full_with_state(ctx, state, params, pcm16k, (int)n_samples);
+	} catch (const std::exception &e) {
+		obs_log(LOG_ERROR, "Whisper exception: %s. Filter restart is required", e.what());
+		stop_inference_backend(gf);
+		return;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	const int duration_ms =
+		(int)std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	const uint64_t audio_ms = n_samples * 1000 / WHISPER_SAMPLE_RATE;
+	gf->stats->inferences++;
+	gf->stats->inference_time_ms += (uint64_t)duration_ms;
+	gf->stats->inference_audio_ms += audio_ms;
+	if (audio_ms > 0) {
+		gf->stats->real_time_factor.observe((double)duration_ms / (double)audio_ms);
+	}
+	if (whisper_full_result != 0 || no_speech_check.no_speech ||
+	    whisper_full_n_segments_from_state(state) == 0) {
+		return;
+	}
+
+	std::vector<whisper_token> tokens;
+	for (int j = 0; j < whisper_full_n_tokens_from_state(state, 0); j++) {
+		tokens.push_back(whisper_full_get_token_id_from_state(state, 0, j));
+	}
+	const int command = voice_command_match(gf->voice_command_grammar, ctx, tokens);
+	const double confidence = voice_command_confidence(&score);
+	obs_log(gf->log_level, "voice command %d, confidence %.2f, %d ms of audio in %d ms",
+		command, confidence, (int)audio_ms, duration_ms);
+	if (command >= 0 && confidence >= VOICE_COMMAND_MIN_CONFIDENCE) {
+		voice_command_execute(gf->voice_command_grammar->commands[command]);
+	}
+}
+
+// Until the wake word is heard only the spotter runs
+static bool wake_word_gated(struct transcription_filter_data *gf)
+{
+	return gf->wake_word_enabled && !wake_word_listening(gf->wake_word);
+}
+
+enum PipelineItemKind {
+	// new audio for the transcription windows
+	PIPELINE_ITEM_AUDIO,
+	// an utterance ended by the voice command endpointer
+	PIPELINE_ITEM_COMMAND,
+	// transcription pauses for a chunked mode, finish the window in progress
+	PIPELINE_ITEM_FLUSH,
+};
+
+// 16 kHz mono audio from the pre-processing stage
+struct pipeline_audio {
+	PipelineItemKind kind = PIPELINE_ITEM_AUDIO;
+	std::vector<float> pcm;
+	// silence is not resampled, pcm is empty and stands for this many samples
+	size_t silent_samples = 0;
 	uint64_t start_timestamp = 0;
+};
 
-	{
-		// scoped lock the buffer mutex
-		std::lock_guard<std::mutex> lock(*gf->whisper_buf_mutex);
+// A result on its way to the sinks
+struct pipeline_result {
+	struct DetectionResultWithText result;
+	// clock-domain end of the window, 0 for results without a window
+	uint64_t window_end = 0;
+};
 
-		// We need (gf->frames - gf->overlap_frames) new frames to run inference,
-		// except for the first segment, where we need the whole gf->frames frames
-		size_t how_many_frames_needed = gf->frames - gf->overlap_frames;
-		if (gf->last_num_frames == 0) {
-			how_many_frames_needed = gf->frames;
-		}
+struct transcription_pipeline {
+	pipeline_queue<pipeline_audio> to_inference;
+	pipeline_queue<pipeline_result> to_postprocess;
+	pipeline_queue<DetectionResultWithText> to_sink;
+	std::atomic<bool> stopping{false};
+};
 
-		// pop infos from the info buffer and mark the beginning timestamp from the first
-		// info as the beginning timestamp of the segment
-		struct transcription_filter_audio_info info_from_buf = {0};
-		while (gf->info_buffer.size >= sizeof(struct transcription_filter_audio_info)) {
-			circlebuf_pop_front(&gf->info_buffer, &info_from_buf,
-					    sizeof(struct transcription_filter_audio_info));
-			num_new_frames_from_infos += info_from_buf.frames;
-			if (start_timestamp == 0) {
-				start_timestamp = info_from_buf.timestamp;
-			}
-			obs_log(gf->log_level, "popped %d frames from info buffer, %lu needed",
-				num_new_frames_from_infos, how_many_frames_needed);
-			// Check if we're within the needed segment length
-			if (num_new_frames_from_infos > how_many_frames_needed) {
-				// too big, push the last info into the buffer's front where it was
-				num_new_frames_from_infos -= info_from_buf.frames;
-				circlebuf_push_front(
-					&gf->info_buffer, &info_from_buf,
-					sizeof(struct transcription_filter_audio_info));
-				break;
-			}
+// New audio of the inference stage, the window is taken from the front once it is full
+struct inference_window {
+	std::vector<float> audio;
+	// clock-domain time of audio[0]
+	uint64_t start_timestamp = 0;
+	// samples at the front carried over from the last window
+	size_t carried = 0;
+	// end offset in audio of each chunk that was not silent
+	std::vector<size_t> loud_chunk_ends;
+	std::vector<size_t> loud_chunk_starts;
+};
+
+static uint64_t elapsed_us(std::chrono::steady_clock::time_point start)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		       std::chrono::steady_clock::now() - start)
+		.count();
+}
+
+static void push_result(struct transcription_pipeline *pipeline,
+			const struct DetectionResultWithText &result, uint64_t window_end)
+{
+	pipeline_result item;
+	item.result = result;
+	item.window_end = window_end;
+	pipeline_queue_push(&pipeline->to_postprocess, item, pipeline->stopping);
+}
+
+// Whether a chunk that was not silent reaches into the new audio of the first n samples
+static bool window_has_sound(const struct inference_window *window, size_t n)
+{
+	for (size_t i = 0; i < window->loud_chunk_ends.size(); i++) {
+		if (window->loud_chunk_ends[i] > window->carried &&
+		    window->loud_chunk_starts[i] < n) {
+			return true;
 		}
+	}
+	return false;
+}
 
-		/* Pop from input circlebuf */
-		for (size_t c = 0; c < gf->channels; c++) {
-			if (gf->last_num_frames > 0) {
-				// move overlap frames from the end of the last copy_buffers to the beginning
-				memcpy(gf->copy_buffers[c],
-				       gf->copy_buffers[c] + gf->last_num_frames -
-					       gf->overlap_frames,
-				       gf->overlap_frames * sizeof(float));
-				// copy new data to the end of copy_buffers[c]
-				circlebuf_pop_front(&gf->input_buffers[c],
-						    gf->copy_buffers[c] + gf->overlap_frames,
-						    num_new_frames_from_infos * sizeof(float));
-			} else {
-				// Very first time, just copy data to copy_buffers[c]
-				circlebuf_pop_front(&gf->input_buffers[c], gf->copy_buffers[c],
-						    num_new_frames_from_infos * sizeof(float));
-			}
+// Mean absolute amplitude a window needs to reach whisper
+static float window_vad_thold(struct transcription_filter_data *gf)
+{
+	float vad_thold = VAD_THOLD;
+	if (gf->low_power) {
+		vad_thold *= LOW_POWER_VAD_THOLD_FACTOR;
+	}
+	if (gf->input_quality_policy) {
+		// noise alone should not pass for speech in a loud room
+		vad_thold = input_quality_vad_thold(gf->input_quality_monitor, vad_thold);
+	}
+	return vad_thold;
+}
+
+// Whether the new audio of the first n samples holds speech. Chunks below the ingest peak
+// threshold are silence, the rest goes through the VAD of the whole window without the
+// carried words, which would pass it on their own.
+static bool window_has_new_speech(struct transcription_filter_data *gf,
+				  const struct inference_window *window, size_t n)
+{
+	if (n <= window->carried || !window_has_sound(window, n)) {
+		return false;
+	}
+	// vad_simple filters in place
+	std::vector<float> new_audio(window->audio.begin() + window->carried,
+				     window->audio.begin() + n);
+	return vad_simple(new_audio.data(), new_audio.size(), WHISPER_SAMPLE_RATE,
+			  window_vad_thold(gf), FREQ_THOLD, false);
+}
+
+// Drop the first n samples but the last carry of them, which begin the next window
+static void consume_window(struct transcription_filter_data *gf, struct inference_window *window,
+			   size_t n, size_t carry)
+{
+	const size_t consumed = n - carry;
+	window->audio.erase(window->audio.begin(), window->audio.begin() + consumed);
+	window->start_timestamp +=
+		clock_domain_duration_ns(gf->clock_domain, consumed, WHISPER_SAMPLE_RATE);
+	window->carried = carry;
+	std::vector<size_t> starts, ends;
+	for (size_t i = 0; i < window->loud_chunk_ends.size(); i++) {
+		if (window->loud_chunk_ends[i] > consumed) {
+			starts.push_back(window->loud_chunk_starts[i] -
+					 std::min(window->loud_chunk_starts[i], consumed));
+			ends.push_back(window->loud_chunk_ends[i] - consumed);
 		}
-		obs_log(gf->log_level,
-			"popped %u frames from input buffer. input_buffer[0] size is %lu",
-			num_new_frames_from_infos, gf->input_buffers[0].size);
+	}
+	window->loud_chunk_starts.swap(starts);
+	window->loud_chunk_ends.swap(ends);
+}
 
-		if (gf->last_num_frames > 0) {
-			gf->last_num_frames = num_new_frames_from_infos + gf->overlap_frames;
-		} else {
-			gf->last_num_frames = num_new_frames_from_infos;
+// Transcribe the first n samples of the window and keep what the next window needs
+static void transcribe_window(struct transcription_filter_data *gf,
+			      struct transcription_pipeline *pipeline,
+			      struct inference_window *window, size_t n)
+{
+	const uint64_t start_timestamp = window->start_timestamp;
+	const uint64_t window_end = start_timestamp + clock_domain_duration_ns(gf->clock_domain, n,
+									      WHISPER_SAMPLE_RATE);
+	const size_t new_samples = n - window->carried;
+	gf->low_power = gf->low_power_profile &&
+			power_profile_update(gf->power_profile, os_gettime_ns());
+	if (gf->low_power) {
+		gf->stats->low_power_windows++;
+	}
+
+	struct input_quality quality;
+	input_quality_measure(window->audio.data(), n, WHISPER_SAMPLE_RATE, &quality);
+	if (gf->input_quality_policy) {
+		// the VAD holds the high-passed signal against the threshold, the noise floor that
+		// raises it has to be measured on the same signal
+		std::vector<float> filtered(window->audio.begin(), window->audio.begin() + n);
+		high_pass_filter(filtered.data(), n, FREQ_THOLD, WHISPER_SAMPLE_RATE);
+		struct input_quality filtered_quality;
+		input_quality_measure(filtered.data(), n, WHISPER_SAMPLE_RATE, &filtered_quality);
+		input_quality_monitor_add_window(gf->input_quality_monitor, filtered_quality);
+	}
+	gf->stats->input_clipping_ratio = quality.clipping_ratio;
+	gf->stats->input_rms_dbfs = quality.rms_dbfs;
+	gf->stats->input_snr_db = quality.snr_db;
+
+	// words carried from the last window still have to be decoded
+	if (gf->vad_enabled && !window_has_sound(window, n) && gf->word_carry_ms <= 0) {
+		obs_log(gf->log_level, "silent window, skipping");
+		gf->stats->windows++;
+		gf->stats->vad_skipped++;
+		push_result(pipeline, {DETECTION_RESULT_SILENCE, "", 0, 0}, 0);
+		consume_window(gf, window, n, 0);
+		return;
+	}
+	// the new audio holds no speech of its own, only the end of the words carried from the
+	// last window, which were decoded there already, so their hypothesis is final
+	if (gf->vad_enabled && gf->word_carry_ms > 0 && !gf->carried_hypothesis->text.empty() &&
+	    !window_has_new_speech(gf, window, n)) {
+		obs_log(gf->log_level, "no new speech, reusing the carried words");
+		gf->stats->windows++;
+		gf->stats->reused_windows++;
+		if (gf->log_words) {
+			obs_log(LOG_INFO, "(reused) %s", gf->carried_hypothesis->text.c_str());
 		}
+		push_result(pipeline, *gf->carried_hypothesis, window_end);
+		gf->carried_hypothesis->text.clear();
+		gf->word_carry_ms = 0;
+		consume_window(gf, window, n, 0);
+		return;
 	}
 
-	obs_log(gf->log_level, "processing %d frames (%d ms), start timestamp %llu ",
-		(int)gf->last_num_frames, (int)(gf->last_num_frames * 1000 / gf->sample_rate),
-		start_timestamp);
+	obs_log(gf->log_level, "processing %d samples (%d ms), start timestamp %llu ", (int)n,
+		(int)(n * 1000 / WHISPER_SAMPLE_RATE), start_timestamp);
 
 	// time the audio processing
 	auto start = std::chrono::high_resolution_clock::now();
 
-	// resample to 16kHz
-	float *output[MAX_PREPROC_CHANNELS];
-	uint32_t out_frames;
-	uint64_t ts_offset;
-	audio_resampler_resample(gf->resampler, (uint8_t **)output, &out_frames, &ts_offset,
-				 (const uint8_t **)gf->copy_buffers, (uint32_t)gf->last_num_frames);
-
-	obs_log(gf->log_level, "%d channels, %d frames, %f ms", (int)gf->channels, (int)out_frames,
-		(float)out_frames / WHISPER_SAMPLE_RATE * 1000.0f);
-
+	// VAD filters in place, the carried audio stays unfiltered for the next window
+	std::vector<float> samples(window->audio.begin(), window->audio.begin() + n);
+	const float *pcm = samples.data();
 	bool skipped_inference = false;
+	gf->stats->windows++;
 
-	if (gf->vad_enabled) {
-		skipped_inference = !::vad_simple(output[0], out_frames, WHISPER_SAMPLE_RATE,
-						  VAD_THOLD, FREQ_THOLD,
+	if (gf->vad_enabled || gf->low_power) {
+		skipped_inference = !::vad_simple(samples.data(), n, WHISPER_SAMPLE_RATE,
+						  window_vad_thold(gf), FREQ_THOLD,
 						  gf->log_level != LOG_DEBUG);
 	}
 
 	if (!skipped_inference) {
+		// clipped, faint or noisy speech gets a cheaper decode, a full one would mostly
+		// buy hallucinations
+		input_quality_monitor_add_speech(gf->input_quality_monitor, quality);
+		if (gf->input_quality_policy &&
+		    gf->input_quality_monitor->issue != INPUT_QUALITY_OK) {
+			gf->low_power = true;
+			gf->stats->poor_input_windows++;
+		}
+
+		// retain the speech for re-transcription after the session
+		session_archive_add_speech(gf->session_archive, pcm, n, start_timestamp);
+
+		// optionally cut long pauses so the encoder sees denser speech
+		std::vector<float> compressed;
+		struct vad_timeline timeline;
+		const bool compressed_window =
+			gf->silence_compression &&
+			vad_timeline_compress(pcm, n, gf->silence_compression_min_ms,
+					      SILENCE_COMPRESSION_KEEP_MSEC, compressed, timeline);
+		if (compressed_window) {
+			obs_log(gf->log_level, "silence compression: %d -> %d ms",
+				(int)(n * 1000 / WHISPER_SAMPLE_RATE),
+				(int)(compressed.size() * 1000 / WHISPER_SAMPLE_RATE));
+		}
+
 		// run inference
-		const struct DetectionResultWithText inference_result =
-			run_whisper_inference(gf, output[0], out_frames);
+		struct DetectionResultWithText inference_result =
+			compressed_window
+				? run_whisper_inference(gf, compressed.data(), compressed.size(),
+							start_timestamp, &timeline)
+				: run_whisper_inference(gf, pcm, n, start_timestamp, nullptr);
 
-		if (inference_result.result == DETECTION_RESULT_SPEECH) {
-			// output inference result to a text source
-			set_text_callback(gf, inference_result.text);
-		} else if (inference_result.result == DETECTION_RESULT_SILENCE) {
-			// output inference result to a text source
-			set_text_callback(gf, "[silence]");
+		if (inference_result.result == DETECTION_RESULT_SILENCE) {
+			inference_result.text = "[silence]";
 		}
+		push_result(pipeline, inference_result, window_end);
 	} else {
+		// no word timing, keep the fixed overlap in case speech starts at the edge
+		gf->word_carry_ms = -1;
 		if (gf->log_words) {
 			obs_log(LOG_INFO, "skipping inference");
 		}
-		set_text_callback(gf, "");
+		push_result(pipeline, {DETECTION_RESULT_SILENCE, "", 0, 0}, 0);
 	}
 
 	// end of timer
 	auto end = std::chrono::high_resolution_clock::now();
 	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-	const uint32_t new_frames_from_infos_ms =
-		num_new_frames_from_infos * 1000 /
-		gf->sample_rate; // number of frames in this packet
-	obs_log(gf->log_level, "audio processing of %u ms new data took %d ms",
-		new_frames_from_infos_ms, (int)duration);
+	if (skipped_inference) {
+		gf->stats->vad_skipped++;
+	} else {
+		const uint64_t audio_ms = n * 1000 / WHISPER_SAMPLE_RATE;
+		gf->stats->inferences++;
+		gf->stats->inference_time_ms += (uint64_t)duration;
+		gf->stats->inference_audio_ms += audio_ms;
+		if (audio_ms > 0) {
+			gf->stats->real_time_factor.observe((double)duration / (double)audio_ms);
+		}
+	}
+	const uint32_t new_samples_ms = (uint32_t)(new_samples * 1000 / WHISPER_SAMPLE_RATE);
+	obs_log(gf->log_level, "audio processing of %u ms new data took %d ms", new_samples_ms,
+		(int)duration);
 
-	if (duration > new_frames_from_infos_ms) {
+	if (duration > new_samples_ms) {
 		// try to decrease overlap down to minimum of 100 ms
 		gf->overlap_ms = std::max((uint64_t)gf->overlap_ms - 10, (uint64_t)100);
-		gf->overlap_frames = gf->overlap_ms * gf->sample_rate / 1000;
 		obs_log(gf->log_level,
 			"audio processing took too long (%d ms), reducing overlap to %lu ms",
 			(int)duration, gf->overlap_ms);
@@ -289,12 +955,281 @@ void process_audio_from_buffer(struct transcription_filter_data *gf)
 			// try to increase overlap up to OVERLAP_SIZE_MSEC
 			gf->overlap_ms = std::min((uint64_t)gf->overlap_ms + 10,
 						  (uint64_t)OVERLAP_SIZE_MSEC);
-			gf->overlap_frames = gf->overlap_ms * gf->sample_rate / 1000;
 			obs_log(gf->log_level,
 				"audio processing took %d ms, increasing overlap to %lu ms",
 				(int)duration, gf->overlap_ms);
 		}
 	}
+
+	// the next window begins with the unfinished words of this one, or a fixed overlap
+	const size_t carry_ms = gf->word_carry_ms < 0 ? gf->overlap_ms : (size_t)gf->word_carry_ms;
+	consume_window(gf, window, n, std::min(n, carry_ms * WHISPER_SAMPLE_RATE / 1000));
+}
+
+static void inference_stage(struct transcription_filter_data *gf,
+			    struct transcription_pipeline *pipeline)
+{
+	struct inference_window window;
+	pipeline_audio item;
+	while (!pipeline->stopping) {
+		if (!pipeline_queue_try_pop(&pipeline->to_inference, item)) {
+			pipeline_queue_wait(&pipeline->to_inference, false);
+			continue;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		gf->stats->stage_queue_depth[PIPELINE_STAGE_INFERENCE] =
+			pipeline_queue_size(&pipeline->to_inference);
+
+		if (item.kind == PIPELINE_ITEM_COMMAND) {
+			run_voice_command(gf, item.pcm.data(), item.pcm.size());
+		} else if (item.kind == PIPELINE_ITEM_FLUSH) {
+			// pad with silence so the last words are not left at the window edge
+			if (window.audio.size() > window.carried || gf->word_carry_ms > 0) {
+				window.audio.resize(std::max(window.audio.size(),
+							     (size_t)WHISPER_FRAME_SIZE),
+						    0.0f);
+				transcribe_window(gf, pipeline, &window, window.audio.size());
+			}
+			window = inference_window();
+			gf->word_carry_ms = -1;
+		} else {
+			const size_t chunk_start = window.audio.size();
+			if (window.audio.empty()) {
+				window.start_timestamp = item.start_timestamp;
+			} else {
+				// the window is rarely empty with word carry, so counting samples
+				// alone would let any loss add up over a session
+				const uint64_t offset = clock_domain_duration_ns(
+					gf->clock_domain, chunk_start, WHISPER_SAMPLE_RATE);
+				const int64_t drift = (int64_t)(item.start_timestamp -
+								(window.start_timestamp + offset));
+				if ((uint64_t)std::llabs(drift) > WINDOW_RESYNC_THRESHOLD_NS &&
+				    item.start_timestamp > offset) {
+					obs_log(gf->log_level, "window start resynced by %lld ms",
+						(long long)(drift / 1000000));
+					window.start_timestamp = item.start_timestamp - offset;
+				}
+			}
+			if (item.pcm.empty()) {
+				window.audio.resize(chunk_start + item.silent_samples, 0.0f);
+			} else {
+				window.audio.insert(window.audio.end(), item.pcm.begin(),
+						    item.pcm.end());
+				window.loud_chunk_starts.push_back(chunk_start);
+				window.loud_chunk_ends.push_back(window.audio.size());
+			}
+			while (window.audio.size() >= WHISPER_FRAME_SIZE && !pipeline->stopping) {
+				transcribe_window(gf, pipeline, &window, WHISPER_FRAME_SIZE);
+			}
+		}
+		gf->stats->stage_busy_us[PIPELINE_STAGE_INFERENCE] += elapsed_us(start);
+	}
+}
+
+// Take a resource sample when one is due
+static void sample_resources(struct transcription_filter_data *gf)
+{
+	const uint64_t now = os_gettime_ns();
+	if (!resource_monitor_due(gf->resource_monitor, now)) {
+		return;
+	}
+	struct resource_sample sample = {0};
+	sample.timestamp_ns = now;
+	sample.rss_bytes = os_get_proc_resident_size();
+	{
+		std::lock_guard<std::mutex> lock(*gf->whisper_buf_mutex);
+		sample.buffer_bytes = gf->info_buffer.capacity;
+		for (size_t c = 0; c < gf->channels; c++) {
+			sample.buffer_bytes += gf->input_buffers[c].capacity;
+		}
+		sample.backlog_ms =
+			gf->input_buffers[0].size / sizeof(float) * 1000 / gf->sample_rate;
+	}
+	resource_monitor_sample(gf->resource_monitor, sample, gf->log_level);
+}
+
+// Bookkeeping of the results, owns the resource monitor
+static void postprocess_stage(struct transcription_filter_data *gf,
+			      struct transcription_pipeline *pipeline)
+{
+	pipeline_result item;
+	while (!pipeline->stopping) {
+		sample_resources(gf);
+		if (!pipeline_queue_try_pop(&pipeline->to_postprocess, item)) {
+			pipeline_queue_wait(&pipeline->to_postprocess, false);
+			continue;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		gf->stats->stage_queue_depth[PIPELINE_STAGE_POSTPROCESS] =
+			pipeline_queue_size(&pipeline->to_postprocess);
+
+		const DetectionResult result = item.result.result;
+		if (result == DETECTION_RESULT_UNKNOWN) {
+			gf->stats->dropped++;
+		} else if (result == DETECTION_RESULT_SPEECH) {
+			gf->stats->segments++;
+			// delay from the end of the window to its caption
+			const int64_t now = (int64_t)clock_domain_now(gf->clock_domain);
+			const int64_t latency_ns = now - (int64_t)item.window_end;
+			resource_monitor_add_latency(gf->resource_monitor, latency_ns / 1000000);
+			gf->stats->latency.observe((double)latency_ns / 1e9);
+		}
+		// a sink that cannot keep up loses captions instead of stalling inference
+		if ((result == DETECTION_RESULT_SPEECH || result == DETECTION_RESULT_SILENCE) &&
+		    !pipeline_queue_push(&pipeline->to_sink, item.result, pipeline->stopping)) {
+			gf->stats->stage_dropped[PIPELINE_STAGE_SINK]++;
+		}
+		gf->stats->stage_busy_us[PIPELINE_STAGE_POSTPROCESS] += elapsed_us(start);
+	}
+}
+
+// Text sources, files and stream captions, which may block on I/O
+static void sink_stage(struct transcription_filter_data *gf,
+		       struct transcription_pipeline *pipeline)
+{
+	DetectionResultWithText item;
+	while (!pipeline->stopping) {
+		if (!pipeline_queue_try_pop(&pipeline->to_sink, item)) {
+			pipeline_queue_wait(&pipeline->to_sink, false);
+			continue;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		gf->stats->stage_queue_depth[PIPELINE_STAGE_SINK] =
+			pipeline_queue_size(&pipeline->to_sink);
+		set_text_callback(gf, item);
+		gf->stats->stage_busy_us[PIPELINE_STAGE_SINK] += elapsed_us(start);
+	}
+}
+
+// Take one chunk of new audio from the input buffer and turn it into a pipeline item.
+// Returns false if there is nothing for the inference stage.
+static bool preprocess_audio(struct transcription_filter_data *gf, bool chunked,
+			     pipeline_audio &item)
+{
+	uint32_t num_new_frames_from_infos = 0;
+	uint64_t start_timestamp = 0;
+	float window_peak = 0.0f;
+	bool silent_chunk = false;
+	const bool command_mode = gf->command_mode;
+	const bool gated = chunked && !command_mode;
+
+	{
+		// scoped lock the buffer mutex
+		std::lock_guard<std::mutex> lock(*gf->whisper_buf_mutex);
+
+		const size_t how_many_frames_needed =
+			gf->sample_rate *
+			(chunked ? COMMAND_CHUNK_SIZE_MSEC : PIPELINE_CHUNK_SIZE_MSEC) / 1000;
+
+		// pop infos from the info buffer and mark the beginning timestamp from the first
+		// info as the beginning timestamp of the chunk
+		struct transcription_filter_audio_info info_from_buf = {0};
+		while (gf->info_buffer.size >= sizeof(struct transcription_filter_audio_info)) {
+			circlebuf_pop_front(&gf->info_buffer, &info_from_buf,
+					    sizeof(struct transcription_filter_audio_info));
+			num_new_frames_from_infos += info_from_buf.frames;
+			if (start_timestamp == 0) {
+				start_timestamp = info_from_buf.timestamp;
+			}
+			// Check if we're within the needed chunk length
+			if (num_new_frames_from_infos > how_many_frames_needed) {
+				// too big, push the last info into the buffer's front where it was
+				num_new_frames_from_infos -= info_from_buf.frames;
+				circlebuf_push_front(
+					&gf->info_buffer, &info_from_buf,
+					sizeof(struct transcription_filter_audio_info));
+				break;
+			}
+			window_peak = std::max(window_peak, info_from_buf.peak);
+		}
+
+		// the endpointers need the silence to find the end of an utterance
+		silent_chunk = gf->vad_enabled && !chunked && num_new_frames_from_infos > 0 &&
+			       window_peak < INGEST_SILENCE_PEAK_THOLD;
+		if (silent_chunk) {
+			// nothing but silence arrived, drop it without copying or resampling
+			gf->ingest_kernels.drop(gf->input_buffers, gf->channels,
+						num_new_frames_from_infos);
+		} else {
+			gf->ingest_kernels.pop(gf->input_buffers, gf->channels, gf->copy_buffers,
+					       num_new_frames_from_infos);
+		}
+		gf->stats->backlog_ms =
+			gf->input_buffers[0].size / sizeof(float) * 1000 / gf->sample_rate;
+		gf->stats->stage_queue_depth[PIPELINE_STAGE_PREPROCESS] =
+			gf->info_buffer.size / sizeof(struct transcription_filter_audio_info);
+	}
+	if (num_new_frames_from_infos == 0) {
+		return false;
+	}
+
+	if (gf->wake_word_enabled) {
+		// the transcription opened by the wake word closes after a while of audio
+		const uint64_t chunk_ns = clock_domain_duration_ns(
+			gf->clock_domain, num_new_frames_from_infos, gf->sample_rate);
+		wake_word_advance(gf->wake_word, start_timestamp + chunk_ns);
+	}
+
+	item.kind = PIPELINE_ITEM_AUDIO;
+	item.start_timestamp = start_timestamp;
+	item.pcm.clear();
+	item.silent_samples = 0;
+	if (silent_chunk && gf->ingest_kernels.skip) {
+		item.silent_samples =
+			gf->ingest_kernels.skip(&gf->decimator, num_new_frames_from_infos);
+		return true;
+	}
+	if (silent_chunk) {
+		// the fraction of a sample is carried over, or the timeline loses it every chunk
+		const uint64_t total = (uint64_t)num_new_frames_from_infos * WHISPER_SAMPLE_RATE +
+				       gf->silent_remainder;
+		item.silent_samples = (size_t)(total / gf->sample_rate);
+		gf->silent_remainder = total % gf->sample_rate;
+		return true;
+	}
+
+	// mix the channels down to the mono analysis signal, favoring the cleanest channel
+	channel_mixer_update(&gf->channel_mixer, gf->copy_buffers, num_new_frames_from_infos,
+			     gf->sample_rate);
+	gf->ingest_kernels.downmix(&gf->channel_mixer, gf->copy_buffers,
+				   num_new_frames_from_infos, gf->mono_buffer);
+	for (size_t c = 0; c < gf->channel_mixer.channels && gf->channels > 1; c++) {
+		obs_log(gf->log_level, "channel %d: snr %.1f dB, weight %.2f", (int)c,
+			gf->channel_mixer.snr_db[c], gf->channel_mixer.weights[c]);
+	}
+
+	// resample to 16kHz
+	float *output[MAX_PREPROC_CHANNELS];
+	uint32_t out_frames;
+	if (gf->ingest_kernels.resample) {
+		output[0] = gf->resample_buffer;
+		out_frames = (uint32_t)gf->ingest_kernels.resample(
+			&gf->decimator, gf->mono_buffer, num_new_frames_from_infos,
+			gf->resample_buffer);
+	} else {
+		uint64_t ts_offset;
+		const float *mono_input[1] = {gf->mono_buffer};
+		audio_resampler_resample(gf->resampler, (uint8_t **)output, &out_frames,
+					 &ts_offset, (const uint8_t **)mono_input,
+					 num_new_frames_from_infos);
+	}
+
+	if (gated) {
+		wake_word_push(gf->wake_word, output[0], out_frames,
+			       (uint64_t)gf->wake_word_listen_sec * 1000000000);
+		return false;
+	}
+	if (command_mode) {
+		if (!utterance_endpointer_push(gf->voice_command_endpointer, output[0],
+					       out_frames)) {
+			return false;
+		}
+		item.kind = PIPELINE_ITEM_COMMAND;
+		item.pcm = gf->voice_command_endpointer->ended;
+		return true;
+	}
+	item.pcm.assign(output[0], output[0] + out_frames);
+	return true;
 }
 
 void whisper_loop(void *data)
@@ -306,47 +1241,77 @@ void whisper_loop(void *data)
 
 	struct transcription_filter_data *gf =
 		static_cast<struct transcription_filter_data *>(data);
-	const size_t segment_size = gf->frames * sizeof(float);
 
 	obs_log(LOG_INFO, "starting whisper thread");
 
+	// this thread pre-processes the input, the other stages get their own threads
+	struct transcription_pipeline pipeline;
+	pipeline_queue_init(&pipeline.to_inference, PIPELINE_INFERENCE_QUEUE_SIZE,
+			    PIPELINE_BACKPRESSURE_BLOCK);
+	pipeline_queue_init(&pipeline.to_postprocess, PIPELINE_POSTPROCESS_QUEUE_SIZE,
+			    PIPELINE_BACKPRESSURE_BLOCK);
+	pipeline_queue_init(&pipeline.to_sink, PIPELINE_SINK_QUEUE_SIZE,
+			    PIPELINE_BACKPRESSURE_DROP);
+	std::thread inference_thread(inference_stage, gf, &pipeline);
+	std::thread postprocess_thread(postprocess_stage, gf, &pipeline);
+	std::thread sink_thread(sink_stage, gf, &pipeline);
+
+	bool was_chunked = false;
+	pipeline_audio item;
+
 	// Thread main loop
 	while (true) {
-		{
-			std::lock_guard<std::mutex> lock(*gf->whisper_ctx_mutex);
-			if (gf->whisper_context == nullptr) {
-				obs_log(LOG_WARNING, "Whisper context is null, exiting thread");
-				break;
-			}
+		// the preprocess stage never takes whisper_ctx_mutex, inference holds it for
+		// the whole decode
+		if (!inference_backend_ready(gf)) {
+			obs_log(LOG_WARNING, "Whisper context is null, exiting thread");
+			break;
 		}
 
 		// Check if we have enough data to process
 		while (true) {
+			const bool chunked = gf->command_mode || wake_word_gated(gf);
+			if (chunked && !was_chunked) {
+				item.kind = PIPELINE_ITEM_FLUSH;
+				pipeline_queue_push(&pipeline.to_inference, item,
+						    pipeline.stopping);
+			}
+			was_chunked = chunked;
+
+			const size_t chunk_size =
+				gf->sample_rate *
+				(chunked ? COMMAND_CHUNK_SIZE_MSEC : PIPELINE_CHUNK_SIZE_MSEC) /
+				1000 * sizeof(float);
 			size_t input_buf_size = 0;
 			{
 				std::lock_guard<std::mutex> lock(*gf->whisper_buf_mutex);
 				input_buf_size = gf->input_buffers[0].size;
 			}
-
-			if (input_buf_size >= segment_size) {
-				obs_log(gf->log_level,
-					"found %lu bytes, %lu frames in input buffer, need >= %lu, processing",
-					input_buf_size, (size_t)(input_buf_size / sizeof(float)),
-					segment_size);
-
-				// Process the audio. This will also remove the processed data from the input buffer.
-				// Mutex is locked inside process_audio_from_buffer.
-				process_audio_from_buffer(gf);
-			} else {
+			if (input_buf_size < chunk_size) {
 				break;
 			}
+
+			const auto start = std::chrono::steady_clock::now();
+			const bool has_item = preprocess_audio(gf, chunked, item);
+			gf->stats->stage_busy_us[PIPELINE_STAGE_PREPROCESS] += elapsed_us(start);
+			// blocks while inference is behind, the input buffer takes up the audio
+			if (has_item) {
+				pipeline_queue_push(&pipeline.to_inference, item,
+						    pipeline.stopping);
+			}
 		}
+
 		// Sleep for 10 ms using the condition variable wshiper_thread_cv
-		// This will wake up the thread if there is new data in the input buffer
-		// or if the whisper context is null
-		std::unique_lock<std::mutex> lock(*gf->whisper_ctx_mutex);
-		gf->wshiper_thread_cv->wait_for(lock, std::chrono::milliseconds(10));
+		// This will wake up the thread if the backend is stopped
+		std::unique_lock<std::mutex> lock(*gf->whisper_buf_mutex);
+		gf->wshiper_thread_cv->wait_for(lock, std::chrono::milliseconds(10),
+						[gf] { return !inference_backend_ready(gf); });
 	}
 
+	pipeline.stopping = true;
+	inference_thread.join();
+	postprocess_thread.join();
+	sink_thread.join();
+
 	obs_log(LOG_INFO, "exiting whisper thread");
 }
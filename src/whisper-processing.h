@@ -1,14 +1,64 @@
 #ifndef WHISPER_PROCESSING_H
 #define WHISPER_PROCESSING_H
 
+#include <string>
+
 // buffer size in msec
 #define BUFFER_SIZE_MSEC 3000
 // at 16Khz, 3000 msec is 48000 samples
 #define WHISPER_FRAME_SIZE 48000
 // overlap in msec
 #define OVERLAP_SIZE_MSEC 200
+// new audio the pre-processing stage hands to the inference stage at a time
+#define PIPELINE_CHUNK_SIZE_MSEC 250
+// capacity of the queues in front of the inference, post-processing and sink stages
+#define PIPELINE_INFERENCE_QUEUE_SIZE 32
+#define PIPELINE_POSTPROCESS_QUEUE_SIZE 8
+#define PIPELINE_SINK_QUEUE_SIZE 16
+// chunk size in msec in voice command mode and while waiting for the wake word, where an
+// endpointer decides on the window
+#define COMMAND_CHUNK_SIZE_MSEC 100
+
+enum DetectionResult {
+	DETECTION_RESULT_UNKNOWN = 0,
+	DETECTION_RESULT_SILENCE = 1,
+	DETECTION_RESULT_SPEECH = 2,
+	// every word of the window is unfinished and carried into the next one
+	DETECTION_RESULT_PENDING = 3,
+};
+
+struct DetectionResultWithText {
+	DetectionResult result;
+	std::string text;
+	// OBS audio timestamps (ns) of the detected text, 0 if unknown
+	uint64_t start_timestamp_ns;
+	uint64_t end_timestamp_ns;
+};
+
+enum InferenceBackend {
+	INFERENCE_BACKEND_IN_PROCESS = 0,
+	// localvocal-worker helper process, see worker/inference-worker.h
+	INFERENCE_BACKEND_WORKER_PROCESS = 1,
+	// localvocal-worker daemon on another machine, see worker/remote-worker.h.
+	// The model is loaded locally as well to run the windows the worker cannot.
+	INFERENCE_BACKEND_REMOTE = 2,
+};
+
+struct transcription_filter_data;
 
+// Pre-processing stage, starts and stops the inference, post-processing and sink stages
 void whisper_loop(void *data);
 struct whisper_context *init_whisper_context(const std::string &model_path);
+// Load gf->whisper_model_path in the configured backend
+bool start_inference_backend(struct transcription_filter_data *gf);
+// Release the model, the whisper thread exits afterwards. Call with whisper_ctx_mutex held.
+void stop_inference_backend(struct transcription_filter_data *gf);
+// Safe to call without whisper_ctx_mutex
+bool inference_backend_ready(struct transcription_filter_data *gf);
+// Load the smaller model of the low-power profile on a background thread, the whisper model
+// is used until it is ready. Empty path releases it. Call without whisper_ctx_mutex.
+void low_power_model_configure(struct transcription_filter_data *gf, const std::string &path);
+// Wait for a running load, call without whisper_ctx_mutex
+void low_power_model_wait(struct transcription_filter_data *gf);
 
 #endif // WHISPER_PROCESSING_H
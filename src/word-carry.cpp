@@ -0,0 +1,75 @@
+#include "word-carry.h"
+#include "whisper-processing.h"
+
+#include <algorithm>
+
+// a word ending this close to the window edge may be cut by it
+#define WORD_CARRY_GUARD_MSEC 200
+// words decoded with less confidence are decoded again with more context
+#define WORD_CARRY_MIN_P 0.4f
+// token timestamps are approximate, keep some audio before the first carried word
+#define WORD_CARRY_PAD_MSEC 60
+// the next window needs room for new audio
+#define WORD_CARRY_MAX_MSEC (BUFFER_SIZE_MSEC / 2)
+
+std::vector<decoded_word> word_carry_collect(struct whisper_context *ctx,
+					     struct whisper_state *state, int i_segment)
+{
+	std::vector<decoded_word> words;
+	const whisper_token eot = whisper_token_eot(ctx);
+	const int n_tokens = whisper_full_n_tokens_from_state(state, i_segment);
+	for (int j = 0; j < n_tokens; j++) {
+		const whisper_token_data token =
+			whisper_full_get_token_data_from_state(state, i_segment, j);
+		// timestamps and other special tokens
+		if (token.id >= eot) {
+			continue;
+		}
+		const char *text = whisper_full_get_token_text_from_state(ctx, state, i_segment, j);
+		if (words.empty() || text[0] == ' ') {
+			words.push_back({text, token.t0, token.t1, token.p});
+			continue;
+		}
+		// the token continues the word, or is punctuation after it
+		decoded_word &word = words.back();
+		word.text += text;
+		word.t1 = std::max(word.t1, token.t1);
+		word.p = std::min(word.p, token.p);
+	}
+	return words;
+}
+
+int64_t word_carry_split(const std::vector<decoded_word> &words, int64_t window_t,
+			 size_t &first_carried)
+{
+	const int64_t guard_t = WORD_CARRY_GUARD_MSEC / 10;
+	const int64_t pad_t = WORD_CARRY_PAD_MSEC / 10;
+	const int64_t max_t = WORD_CARRY_MAX_MSEC / 10;
+
+	first_carried = words.size();
+	while (first_carried > 0) {
+		const decoded_word &word = words[first_carried - 1];
+		const bool at_edge = word.t1 >= window_t - guard_t;
+		if (!at_edge && word.p >= WORD_CARRY_MIN_P) {
+			break;
+		}
+		if (window_t - (word.t0 - pad_t) > max_t) {
+			// a cut word that cannot be carried is left to the overlap
+			if (at_edge && first_carried == words.size()) {
+				return -1;
+			}
+			break;
+		}
+		first_carried--;
+	}
+	if (first_carried == words.size()) {
+		return 0;
+	}
+
+	int64_t carry_from = std::max<int64_t>(0, words[first_carried].t0 - pad_t);
+	if (first_carried > 0) {
+		// never before the end of the last kept word
+		carry_from = std::max(carry_from, words[first_carried - 1].t1);
+	}
+	return std::max<int64_t>(0, window_t - carry_from);
+}
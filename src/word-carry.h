@@ -0,0 +1,32 @@
+#ifndef WORD_CARRY_H
+#define WORD_CARRY_H
+
+#include <whisper.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A word of a decoded segment, times in whisper units (10 ms) from the window start
+struct decoded_word {
+	// with its leading space and trailing punctuation
+	std::string text;
+	int64_t t0;
+	int64_t t1;
+	// lowest probability of its tokens
+	float p;
+};
+
+// Words of a segment decoded with token timestamps
+std::vector<decoded_word> word_carry_collect(struct whisper_context *ctx,
+					     struct whisper_state *state, int i_segment);
+
+// Instead of overlapping windows by a fixed amount, the next window starts at the last word
+// the decoder was sure of and ended before the window edge. Only the words after it are
+// decoded again, with the rest of their audio. Sets first_carried to the first of those words
+// (words.size() if none) and returns the audio to carry, in whisper units from the window
+// end, or -1 if no boundary fits in the carry limit and the fixed overlap applies.
+int64_t word_carry_split(const std::vector<decoded_word> &words, int64_t window_t,
+			 size_t &first_carried);
+
+#endif // WORD_CARRY_H
@@ -0,0 +1,327 @@
+#include "inference-worker.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include "plugin-support.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char **environ;
+#endif
+
+#ifdef _WIN32
+#define WORKER_EXECUTABLE "localvocal-worker.exe"
+#else
+#define WORKER_EXECUTABLE "localvocal-worker"
+#endif
+
+// loading a model from a slow disk can take a while
+#define WORKER_STARTUP_TIMEOUT_MS 60000
+// log the measured transport overhead every this many windows
+#define WORKER_OVERHEAD_LOG_INTERVAL 100
+
+static uint64_t current_pid()
+{
+#ifdef _WIN32
+	return (uint64_t)GetCurrentProcessId();
+#else
+	return (uint64_t)getpid();
+#endif
+}
+
+static bool worker_process_alive(struct inference_worker *worker)
+{
+#ifdef _WIN32
+	return worker->process_handle != nullptr &&
+	       WaitForSingleObject((HANDLE)worker->process_handle, 0) == WAIT_TIMEOUT;
+#else
+	if (worker->pid <= 0) {
+		return false;
+	}
+	int status = 0;
+	const pid_t result = waitpid(worker->pid, &status, WNOHANG);
+	if (result == 0) {
+		return true;
+	}
+	// reaped, the pid may be reused by another process from now on
+	if (result == worker->pid || (result < 0 && errno == ECHILD)) {
+		worker->pid = 0;
+	}
+	return false;
+#endif
+}
+
+static void worker_process_kill(struct inference_worker *worker)
+{
+#ifdef _WIN32
+	if (worker->process_handle != nullptr) {
+		TerminateProcess((HANDLE)worker->process_handle, 1);
+		WaitForSingleObject((HANDLE)worker->process_handle, 5000);
+		CloseHandle((HANDLE)worker->process_handle);
+		worker->process_handle = nullptr;
+	}
+#else
+	if (worker->pid > 0) {
+		kill(worker->pid, SIGKILL);
+		waitpid(worker->pid, nullptr, 0);
+		worker->pid = 0;
+	}
+#endif
+}
+
+static bool worker_process_spawn(struct inference_worker *worker, const std::string &shm_name)
+{
+	const std::string parent_pid = std::to_string(current_pid());
+#ifdef _WIN32
+	std::string command_line = "\"" + worker->worker_path + "\" --shm \"" + shm_name +
+				   "\" --model \"" + worker->model_file_path + "\" --parent " +
+				   parent_pid;
+	STARTUPINFOA startup_info;
+	PROCESS_INFORMATION process_info;
+	ZeroMemory(&startup_info, sizeof(startup_info));
+	startup_info.cb = sizeof(startup_info);
+	ZeroMemory(&process_info, sizeof(process_info));
+	if (!CreateProcessA(worker->worker_path.c_str(), &command_line[0], NULL, NULL, FALSE,
+			    CREATE_NO_WINDOW | BELOW_NORMAL_PRIORITY_CLASS, NULL, NULL,
+			    &startup_info, &process_info)) {
+		return false;
+	}
+	CloseHandle(process_info.hThread);
+	worker->process_handle = process_info.hProcess;
+	return true;
+#else
+	std::vector<char *> argv = {(char *)worker->worker_path.c_str(),
+				    (char *)"--shm",
+				    (char *)shm_name.c_str(),
+				    (char *)"--model",
+				    (char *)worker->model_file_path.c_str(),
+				    (char *)"--parent",
+				    (char *)parent_pid.c_str(),
+				    nullptr};
+	pid_t pid = 0;
+	if (posix_spawn(&pid, worker->worker_path.c_str(), nullptr, nullptr, argv.data(),
+			environ) != 0) {
+		return false;
+	}
+	worker->pid = (int)pid;
+	return true;
+#endif
+}
+
+static void worker_stop(struct inference_worker *worker, bool graceful = true)
+{
+	if (worker->region.base != nullptr) {
+		shm_region_control(&worker->region)->shutdown.store(1);
+	}
+	// give the worker a moment to exit cleanly
+	for (int i = 0; graceful && i < 50 && worker_process_alive(worker); i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	worker_process_kill(worker);
+	shm_region_unlink(&worker->region);
+	shm_region_close(&worker->region);
+	worker->running = false;
+}
+
+static bool worker_start(struct inference_worker *worker)
+{
+#ifdef _WIN32
+	const std::string shm_name = "Local\\localvocal-" + std::to_string(current_pid()) + "-" +
+				     std::to_string(++worker->session_counter);
+#else
+	const std::string shm_name = "/localvocal-" + std::to_string(current_pid()) + "-" +
+				     std::to_string(++worker->session_counter);
+#endif
+	if (!shm_region_create(&worker->region, shm_name)) {
+		obs_log(LOG_ERROR, "failed to create shared memory %s", shm_name.c_str());
+		return false;
+	}
+	if (!worker_process_spawn(worker, shm_name)) {
+		obs_log(LOG_ERROR, "failed to start %s", worker->worker_path.c_str());
+		shm_region_unlink(&worker->region);
+		shm_region_close(&worker->region);
+		return false;
+	}
+
+	struct shm_control *control = shm_region_control(&worker->region);
+	const auto deadline = std::chrono::steady_clock::now() +
+			      std::chrono::milliseconds(WORKER_STARTUP_TIMEOUT_MS);
+	while (control->worker_ready.load() == 0) {
+		if (!worker_process_alive(worker) || std::chrono::steady_clock::now() > deadline) {
+			obs_log(LOG_ERROR, "inference worker failed to load %s",
+				worker->model_file_path.c_str());
+			worker_stop(worker);
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	// both sides have the mapping now, the name is no longer needed
+	shm_region_unlink(&worker->region);
+	worker->running = true;
+	obs_log(LOG_INFO, "inference worker started for %s", worker->model_file_path.c_str());
+	return true;
+}
+
+static void worker_schedule_restart(struct inference_worker *worker)
+{
+	worker->consecutive_failures++;
+	// back off up to ~30 s if the worker keeps crashing
+	const uint64_t backoff_ms =
+		std::min<uint64_t>(30000, 500ull << std::min(worker->consecutive_failures, 6));
+	worker->next_restart_ns = os_gettime_ns() + backoff_ms * 1000000;
+	obs_log(LOG_WARNING, "inference worker failed, restarting in %d ms", (int)backoff_ms);
+}
+
+static void worker_restart_after_failure(struct inference_worker *worker)
+{
+	// a crashed or hung worker gets no grace period
+	worker_stop(worker, false);
+	worker_schedule_restart(worker);
+}
+
+// Load the model in a new worker on restart_thread, windows fail until it is done
+static void worker_begin_restart(struct inference_worker *worker)
+{
+	worker->restarting = true;
+	worker->restart_thread = std::thread([worker]() {
+		worker_start(worker);
+		worker->restarting = false;
+	});
+}
+
+struct inference_worker *inference_worker_create(const std::string &model_file_path)
+{
+	struct inference_worker *worker = new inference_worker();
+	worker->model_file_path = model_file_path;
+	worker->worker_path = (std::filesystem::path(obs_get_module_binary_path(
+				       obs_current_module()))
+				       .parent_path() /
+			       WORKER_EXECUTABLE)
+				      .string();
+	worker->response_buffer.resize(sizeof(worker_response_header) + WORKER_MAX_TEXT_SIZE);
+	if (!worker_start(worker)) {
+		delete worker;
+		return nullptr;
+	}
+	return worker;
+}
+
+void inference_worker_destroy(struct inference_worker *worker)
+{
+	if (worker == nullptr) {
+		return;
+	}
+	if (worker->restart_thread.joinable()) {
+		worker->restart_thread.join();
+	}
+	worker_stop(worker);
+	if (worker->n_requests > 0) {
+		obs_log(LOG_INFO,
+			"inference worker transport overhead: %.2f ms avg over %d windows",
+			(double)worker->total_overhead_us / (double)worker->n_requests / 1000.0,
+			(int)worker->n_requests);
+	}
+	delete worker;
+}
+
+bool inference_worker_run(struct inference_worker *worker, const whisper_full_params &params,
+			  const float *pcm16k, size_t n_samples, uint32_t timeout_ms,
+			  struct worker_response_header &response, std::string &text)
+{
+	if (worker->restart_thread.joinable()) {
+		if (worker->restarting) {
+			obs_log(LOG_INFO, "inference worker is loading the model, window dropped");
+			return false;
+		}
+		worker->restart_thread.join();
+		if (!worker->running) {
+			worker_schedule_restart(worker);
+			return false;
+		}
+	}
+	if (!worker->running || !worker_process_alive(worker)) {
+		if (worker->running) {
+			obs_log(LOG_WARNING, "inference worker exited unexpectedly");
+			worker_restart_after_failure(worker);
+		}
+		if (os_gettime_ns() >= worker->next_restart_ns) {
+			worker_begin_restart(worker);
+		}
+		obs_log(LOG_INFO, "inference worker is not running, window dropped");
+		return false;
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	worker_request_header request;
+	memset(&request, 0, sizeof(request));
+	request.id = worker->next_id++;
+	request.params = worker_params_from_whisper(params);
+	request.n_samples = (uint32_t)std::min<size_t>(n_samples, WORKER_MAX_SAMPLES);
+	request.sample_format = WORKER_SAMPLE_FORMAT_F32;
+	if (!shm_ring_write(shm_region_request_ring(&worker->region), &request, sizeof(request),
+			    pcm16k, request.n_samples * sizeof(float))) {
+		obs_log(LOG_WARNING, "inference worker request ring is full");
+		return false;
+	}
+
+	struct shm_ring *responses = shm_region_response_ring(&worker->region);
+	const auto deadline = start + std::chrono::milliseconds(timeout_ms);
+	while (true) {
+		const size_t size = shm_ring_read(responses, worker->response_buffer.data(),
+						  worker->response_buffer.size());
+		if (size >= sizeof(worker_response_header)) {
+			memcpy(&response, worker->response_buffer.data(), sizeof(response));
+			if (response.id != request.id) {
+				// stale result of a window that timed out earlier
+				continue;
+			}
+			text.assign((const char *)worker->response_buffer.data() +
+					    sizeof(response),
+				    std::min<size_t>(response.text_size,
+						     size - sizeof(worker_response_header)));
+			break;
+		}
+		if (!worker_process_alive(worker)) {
+			obs_log(LOG_WARNING, "inference worker exited during a window, dropped");
+			worker_restart_after_failure(worker);
+			return false;
+		}
+		if (std::chrono::high_resolution_clock::now() > deadline) {
+			// hung, or much slower than the windows before
+			obs_log(LOG_WARNING,
+				"inference worker did not answer within %u ms, window dropped",
+				timeout_ms);
+			worker_restart_after_failure(worker);
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+	}
+	worker->consecutive_failures = 0;
+
+	const uint64_t round_trip_us =
+		(uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::high_resolution_clock::now() - start)
+			.count();
+	worker->total_overhead_us += round_trip_us - std::min<uint64_t>(round_trip_us,
+									response.inference_us);
+	if (++worker->n_requests % WORKER_OVERHEAD_LOG_INTERVAL == 0) {
+		obs_log(LOG_INFO,
+			"inference worker transport overhead: %.2f ms avg per window "
+			"(0 in-process)",
+			(double)worker->total_overhead_us / (double)worker->n_requests / 1000.0);
+	}
+	return true;
+}
@@ -0,0 +1,47 @@
+#ifndef INFERENCE_WORKER_H
+#define INFERENCE_WORKER_H
+
+#include "worker/shm-ring.h"
+#include "worker/worker-protocol.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Client side of the out-of-process inference helper (localvocal-worker).
+struct inference_worker {
+	std::string worker_path;
+	std::string model_file_path;
+	struct shm_region region;
+#ifdef _WIN32
+	void *process_handle = nullptr;
+#else
+	int pid = 0;
+#endif
+	bool running = false;
+	uint64_t next_id = 1;
+	uint64_t session_counter = 0;
+	// earliest time for the next restart attempt, restarts back off after repeated crashes
+	uint64_t next_restart_ns = 0;
+	int consecutive_failures = 0;
+	// starts the worker off the inference path, which holds the context mutex
+	std::thread restart_thread;
+	std::atomic<bool> restarting{false};
+	// transport overhead: round trip time minus the time spent inside whisper in the worker
+	uint64_t n_requests = 0;
+	uint64_t total_overhead_us = 0;
+	std::vector<uint8_t> response_buffer;
+};
+
+// Spawn the worker hosting the model at model_file_path, returns nullptr on failure
+struct inference_worker *inference_worker_create(const std::string &model_file_path);
+void inference_worker_destroy(struct inference_worker *worker);
+// Run one 16 kHz window in the worker. A crashed or hung worker is restarted on a thread of
+// its own and windows are reported as failed until it is back.
+bool inference_worker_run(struct inference_worker *worker, const whisper_full_params &params,
+			  const float *pcm16k, size_t n_samples, uint32_t timeout_ms,
+			  struct worker_response_header &response, std::string &text);
+
+#endif // INFERENCE_WORKER_H
@@ -0,0 +1,260 @@
+#include "net-socket.h"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+const net_socket NET_INVALID_SOCKET = (net_socket)INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+const net_socket NET_INVALID_SOCKET = -1;
+#endif
+
+static void net_startup()
+{
+#ifdef _WIN32
+	static std::once_flag once;
+	std::call_once(once, []() {
+		WSADATA wsa_data;
+		WSAStartup(MAKEWORD(2, 2), &wsa_data);
+	});
+#endif
+}
+
+static void net_set_nonblocking(net_socket s, bool nonblocking)
+{
+#ifdef _WIN32
+	u_long mode = nonblocking ? 1 : 0;
+	ioctlsocket((SOCKET)s, FIONBIO, &mode);
+#else
+	const int flags = fcntl(s, F_GETFL, 0);
+	fcntl(s, F_SETFL, nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+}
+
+// Wait until the socket is readable (or writable), false on timeout
+static bool net_wait(net_socket s, bool for_write, int timeout_ms)
+{
+#ifdef _WIN32
+	WSAPOLLFD pfd;
+	pfd.fd = (SOCKET)s;
+	pfd.events = for_write ? POLLWRNORM : POLLRDNORM;
+	pfd.revents = 0;
+	return WSAPoll(&pfd, 1, timeout_ms) > 0;
+#else
+	struct pollfd pfd;
+	pfd.fd = s;
+	pfd.events = for_write ? POLLOUT : POLLIN;
+	pfd.revents = 0;
+	return poll(&pfd, 1, timeout_ms) > 0;
+#endif
+}
+
+bool net_parse_address(const std::string &address, std::string &host, int &port)
+{
+	const size_t colon = address.rfind(':');
+	if (colon == std::string::npos) {
+		host = address;
+		port = NET_DEFAULT_WORKER_PORT;
+		return !host.empty();
+	}
+	host = address.substr(0, colon);
+	try {
+		port = std::stoi(address.substr(colon + 1));
+	} catch (...) {
+		return false;
+	}
+	return !host.empty() && port > 0 && port < 65536;
+}
+
+static struct addrinfo *net_resolve(const std::string &host, int port, bool passive)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+	struct addrinfo *result = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+		return nullptr;
+	}
+	return result;
+}
+
+net_socket net_connect(const std::string &host, int port, int timeout_ms)
+{
+	net_startup();
+	struct addrinfo *addresses = net_resolve(host, port, false);
+	net_socket s = NET_INVALID_SOCKET;
+	for (struct addrinfo *a = addresses; a != nullptr; a = a->ai_next) {
+		s = (net_socket)socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s == NET_INVALID_SOCKET) {
+			continue;
+		}
+		// connect without blocking so an unreachable host cannot stall the caller
+		net_set_nonblocking(s, true);
+		connect(s, a->ai_addr, (int)a->ai_addrlen);
+		int error = -1;
+		socklen_t error_size = sizeof(error);
+		if (net_wait(s, true, timeout_ms) &&
+		    getsockopt(s, SOL_SOCKET, SO_ERROR, (char *)&error, &error_size) == 0 &&
+		    error == 0) {
+			net_set_nonblocking(s, false);
+			// windows are sent as single messages, do not wait for more data
+			int no_delay = 1;
+			setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&no_delay,
+				   sizeof(no_delay));
+			break;
+		}
+		net_close(s);
+		s = NET_INVALID_SOCKET;
+	}
+	if (addresses != nullptr) {
+		freeaddrinfo(addresses);
+	}
+	return s;
+}
+
+net_socket net_listen(const std::string &host, int port)
+{
+	net_startup();
+	struct addrinfo *addresses = net_resolve(host, port, true);
+	net_socket s = NET_INVALID_SOCKET;
+	for (struct addrinfo *a = addresses; a != nullptr; a = a->ai_next) {
+		s = (net_socket)socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s == NET_INVALID_SOCKET) {
+			continue;
+		}
+		int reuse = 1;
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+		if (bind(s, a->ai_addr, (int)a->ai_addrlen) == 0 && listen(s, 4) == 0) {
+			break;
+		}
+		net_close(s);
+		s = NET_INVALID_SOCKET;
+	}
+	if (addresses != nullptr) {
+		freeaddrinfo(addresses);
+	}
+	return s;
+}
+
+net_socket net_accept(net_socket listener)
+{
+	net_socket s = (net_socket)accept(listener, nullptr, nullptr);
+	if (s != NET_INVALID_SOCKET) {
+		int no_delay = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&no_delay, sizeof(no_delay));
+	}
+	return s;
+}
+
+void net_close(net_socket s)
+{
+	if (s == NET_INVALID_SOCKET) {
+		return;
+	}
+#ifdef _WIN32
+	closesocket((SOCKET)s);
+#else
+	close(s);
+#endif
+}
+
+bool net_send_all(net_socket s, const void *data, size_t size)
+{
+	const char *p = (const char *)data;
+	while (size > 0) {
+#ifdef _WIN32
+		const int sent = send((SOCKET)s, p, (int)size, 0);
+#else
+		const ssize_t sent = send(s, p, size, MSG_NOSIGNAL);
+#endif
+		if (sent <= 0) {
+			return false;
+		}
+		p += sent;
+		size -= (size_t)sent;
+	}
+	return true;
+}
+
+static bool net_recv_all(net_socket s, void *data, size_t size,
+			 std::chrono::steady_clock::time_point deadline, bool forever)
+{
+	char *p = (char *)data;
+	while (size > 0) {
+		int wait_ms = -1;
+		if (!forever) {
+			wait_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+					  deadline - std::chrono::steady_clock::now())
+					  .count();
+			if (wait_ms <= 0 || !net_wait(s, false, wait_ms)) {
+				return false;
+			}
+		}
+#ifdef _WIN32
+		const int received = recv((SOCKET)s, p, (int)size, 0);
+#else
+		const ssize_t received = recv(s, p, size, 0);
+#endif
+		if (received <= 0) {
+			return false;
+		}
+		p += received;
+		size -= (size_t)received;
+	}
+	return true;
+}
+
+bool net_wait_readable(net_socket s, int timeout_ms)
+{
+	return net_wait(s, false, timeout_ms);
+}
+
+size_t net_recv_some(net_socket s, void *data, size_t size, int timeout_ms)
+{
+	if (!net_wait(s, false, timeout_ms)) {
+		return 0;
+	}
+#ifdef _WIN32
+	const int received = recv((SOCKET)s, (char *)data, (int)size, 0);
+#else
+	const ssize_t received = recv(s, data, size, 0);
+#endif
+	return received > 0 ? (size_t)received : 0;
+}
+
+bool net_send_message(net_socket s, const void *header, size_t header_size, const void *payload,
+		      size_t payload_size)
+{
+	const uint32_t size = (uint32_t)(header_size + payload_size);
+	return net_send_all(s, &size, sizeof(size)) && net_send_all(s, header, header_size) &&
+	       (payload_size == 0 || net_send_all(s, payload, payload_size));
+}
+
+size_t net_recv_message(net_socket s, std::vector<uint8_t> &buffer, size_t max_size,
+			int timeout_ms)
+{
+	const auto deadline =
+		std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	uint32_t size = 0;
+	if (!net_recv_all(s, &size, sizeof(size), deadline, timeout_ms < 0) || size > max_size) {
+		return 0;
+	}
+	buffer.resize(size);
+	if (!net_recv_all(s, buffer.data(), size, deadline, timeout_ms < 0)) {
+		return 0;
+	}
+	return size;
+}
@@ -0,0 +1,43 @@
+#ifndef NET_SOCKET_H
+#define NET_SOCKET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal blocking TCP helpers shared by the remote inference client and the worker daemon.
+// Messages use the same [uint32 size][payload] framing as the shared memory rings.
+
+#ifdef _WIN32
+typedef uintptr_t net_socket;
+#else
+typedef int net_socket;
+#endif
+extern const net_socket NET_INVALID_SOCKET;
+
+#define NET_DEFAULT_WORKER_PORT 9520
+
+// Parse "host:port" or "host", returns false on a malformed port
+bool net_parse_address(const std::string &address, std::string &host, int &port);
+
+// Returns NET_INVALID_SOCKET if the host does not accept a connection within timeout_ms
+net_socket net_connect(const std::string &host, int port, int timeout_ms);
+net_socket net_listen(const std::string &host, int port);
+net_socket net_accept(net_socket listener);
+void net_close(net_socket s);
+// False on timeout, e.g. to poll a listener without blocking in net_accept
+bool net_wait_readable(net_socket s, int timeout_ms);
+
+bool net_send_all(net_socket s, const void *data, size_t size);
+// Receive what is available, up to size bytes. Returns 0 on timeout, error or a closed peer.
+size_t net_recv_some(net_socket s, void *data, size_t size, int timeout_ms);
+
+bool net_send_message(net_socket s, const void *header, size_t header_size, const void *payload,
+		      size_t payload_size);
+// Receive one message into buffer. Returns the message size, 0 on timeout, error or a message
+// larger than max_size. timeout_ms < 0 waits forever.
+size_t net_recv_message(net_socket s, std::vector<uint8_t> &buffer, size_t max_size,
+			int timeout_ms);
+
+#endif // NET_SOCKET_H
@@ -0,0 +1,154 @@
+#include "remote-worker.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include "plugin-support.h"
+
+#include <algorithm>
+#include <cstring>
+
+// a worker on the local network answers a connect immediately
+#define REMOTE_WORKER_CONNECT_TIMEOUT_MS 500
+// log the fallback rate every this many windows
+#define REMOTE_WORKER_LOG_INTERVAL 100
+
+static void remote_worker_disconnect(struct remote_worker *worker)
+{
+	net_close(worker->socket);
+	worker->socket = NET_INVALID_SOCKET;
+}
+
+static void remote_worker_schedule_reconnect(struct remote_worker *worker)
+{
+	remote_worker_disconnect(worker);
+	worker->consecutive_failures++;
+	// back off up to ~30 s while the worker is down, windows run locally meanwhile
+	const uint64_t backoff_ms =
+		std::min<uint64_t>(30000, 500ull << std::min(worker->consecutive_failures, 6));
+	worker->next_connect_ns = os_gettime_ns() + backoff_ms * 1000000;
+	obs_log(LOG_WARNING, "remote worker %s:%d failed, retrying in %d ms",
+		worker->host.c_str(), worker->port, (int)backoff_ms);
+}
+
+static void remote_worker_begin_connect(struct remote_worker *worker)
+{
+	worker->connecting = true;
+	worker->connect_thread = std::thread([worker]() {
+		worker->connected_socket = net_connect(worker->host, worker->port,
+						       REMOTE_WORKER_CONNECT_TIMEOUT_MS);
+		worker->connecting = false;
+	});
+}
+
+// Adopt the socket of a finished background connect, start one when due. Returns whether
+// the worker is connected.
+static bool remote_worker_poll_connection(struct remote_worker *worker)
+{
+	if (worker->socket != NET_INVALID_SOCKET) {
+		return true;
+	}
+	if (worker->connect_thread.joinable()) {
+		if (worker->connecting) {
+			return false;
+		}
+		worker->connect_thread.join();
+		worker->socket = worker->connected_socket;
+		worker->connected_socket = NET_INVALID_SOCKET;
+		if (worker->socket == NET_INVALID_SOCKET) {
+			remote_worker_schedule_reconnect(worker);
+			return false;
+		}
+		obs_log(LOG_INFO, "connected to remote worker %s:%d", worker->host.c_str(),
+			worker->port);
+		return true;
+	}
+	if (os_gettime_ns() >= worker->next_connect_ns) {
+		remote_worker_begin_connect(worker);
+	}
+	return false;
+}
+
+struct remote_worker *remote_worker_create(const std::string &address)
+{
+	struct remote_worker *worker = new remote_worker();
+	if (!net_parse_address(address, worker->host, worker->port)) {
+		obs_log(LOG_ERROR, "invalid remote worker address '%s'", address.c_str());
+		delete worker;
+		return nullptr;
+	}
+	remote_worker_begin_connect(worker);
+	return worker;
+}
+
+void remote_worker_destroy(struct remote_worker *worker)
+{
+	if (worker == nullptr) {
+		return;
+	}
+	if (worker->connect_thread.joinable()) {
+		worker->connect_thread.join();
+	}
+	net_close(worker->connected_socket);
+	remote_worker_disconnect(worker);
+	delete worker;
+}
+
+static bool remote_worker_exchange(struct remote_worker *worker,
+				   const whisper_full_params &params, const float *pcm16k,
+				   size_t n_samples, uint32_t timeout_ms,
+				   struct worker_response_header &response, std::string &text)
+{
+	// windows run locally while the worker is unreachable, without waiting for it
+	if (!remote_worker_poll_connection(worker)) {
+		return false;
+	}
+
+	worker_request_header request;
+	memset(&request, 0, sizeof(request));
+	request.id = worker->next_id++;
+	request.params = worker_params_from_whisper(params);
+	request.n_samples = (uint32_t)std::min<size_t>(n_samples, WORKER_MAX_SAMPLES);
+	request.sample_format = WORKER_SAMPLE_FORMAT_S16;
+	worker_encode_s16(pcm16k, request.n_samples, worker->pcm16);
+	if (!net_send_message(worker->socket, &request, sizeof(request), worker->pcm16.data(),
+			      worker->pcm16.size() * sizeof(int16_t))) {
+		remote_worker_schedule_reconnect(worker);
+		return false;
+	}
+
+	const size_t size = net_recv_message(worker->socket, worker->response_buffer,
+					     sizeof(worker_response_header) + WORKER_MAX_TEXT_SIZE,
+					     (int)timeout_ms);
+	if (size < sizeof(worker_response_header)) {
+		// too slow or gone, a late answer would arrive out of order so start over
+		remote_worker_schedule_reconnect(worker);
+		return false;
+	}
+	memcpy(&response, worker->response_buffer.data(), sizeof(response));
+	if (response.id != request.id) {
+		remote_worker_schedule_reconnect(worker);
+		return false;
+	}
+	text.assign((const char *)worker->response_buffer.data() + sizeof(response),
+		    std::min<size_t>(response.text_size, size - sizeof(response)));
+	worker->consecutive_failures = 0;
+	return true;
+}
+
+bool remote_worker_run(struct remote_worker *worker, const whisper_full_params &params,
+		       const float *pcm16k, size_t n_samples, uint32_t timeout_ms,
+		       struct worker_response_header &response, std::string &text)
+{
+	const bool success = remote_worker_exchange(worker, params, pcm16k, n_samples,
+						    timeout_ms, response, text);
+	if (!success) {
+		worker->n_fallbacks++;
+	}
+	if (++worker->n_requests % REMOTE_WORKER_LOG_INTERVAL == 0) {
+		obs_log(LOG_INFO, "remote worker: %d of the last %d windows ran locally",
+			(int)worker->n_fallbacks, REMOTE_WORKER_LOG_INTERVAL);
+		worker->n_fallbacks = 0;
+	}
+	return success;
+}
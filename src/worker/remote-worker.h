@@ -0,0 +1,45 @@
+#ifndef REMOTE_WORKER_H
+#define REMOTE_WORKER_H
+
+#include "worker/net-socket.h"
+#include "worker/worker-protocol.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Client of a localvocal-worker daemon (localvocal-worker --listen) on another machine.
+// Windows are sent as 16 bit samples over TCP, the caller runs the model locally whenever
+// remote_worker_run fails. After a failure every window runs locally at once until a
+// connection made in the background succeeds.
+struct remote_worker {
+	std::string host;
+	int port = NET_DEFAULT_WORKER_PORT;
+	net_socket socket = NET_INVALID_SOCKET;
+	// connects off the inference path, hands the socket over in connected_socket
+	std::thread connect_thread;
+	std::atomic<bool> connecting{false};
+	net_socket connected_socket = NET_INVALID_SOCKET;
+	uint64_t next_id = 1;
+	// earliest time for the next connection attempt while the worker is unreachable
+	uint64_t next_connect_ns = 0;
+	int consecutive_failures = 0;
+	uint64_t n_requests = 0;
+	// windows that ran locally since the last log line
+	uint64_t n_fallbacks = 0;
+	std::vector<int16_t> pcm16;
+	std::vector<uint8_t> response_buffer;
+};
+
+// address is "host:port", returns nullptr if it cannot be parsed. Connects in the background.
+struct remote_worker *remote_worker_create(const std::string &address);
+void remote_worker_destroy(struct remote_worker *worker);
+// Run one 16 kHz window on the remote worker. Returns false if the worker is unreachable or
+// does not answer within timeout_ms.
+bool remote_worker_run(struct remote_worker *worker, const whisper_full_params &params,
+		       const float *pcm16k, size_t n_samples, uint32_t timeout_ms,
+		       struct worker_response_header &response, std::string &text);
+
+#endif // REMOTE_WORKER_H
@@ -0,0 +1,204 @@
+#include "shm-ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static size_t align_up(size_t size)
+{
+	return (size + 63) & ~(size_t)63;
+}
+
+size_t shm_region_required_size()
+{
+	return align_up(sizeof(shm_control)) + align_up(sizeof(shm_ring) + SHM_REQUEST_RING_SIZE) +
+	       align_up(sizeof(shm_ring) + SHM_RESPONSE_RING_SIZE);
+}
+
+static bool shm_region_map(struct shm_region *region, const std::string &name, bool create)
+{
+	region->name = name;
+	region->size = shm_region_required_size();
+#ifdef _WIN32
+	HANDLE mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+						     (DWORD)region->size, name.c_str())
+				: OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+	if (mapping == NULL) {
+		return false;
+	}
+	region->base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, region->size);
+	if (region->base == NULL) {
+		CloseHandle(mapping);
+		return false;
+	}
+	region->mapping_handle = mapping;
+#else
+	const int fd = create ? shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600)
+			      : shm_open(name.c_str(), O_RDWR, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	if (create && ftruncate(fd, (off_t)region->size) != 0) {
+		close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void *base = mmap(nullptr, region->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		if (create) {
+			shm_unlink(name.c_str());
+		}
+		return false;
+	}
+	region->base = base;
+#endif
+	return true;
+}
+
+static void shm_ring_init(struct shm_ring *ring, uint64_t capacity)
+{
+	ring->head.store(0);
+	ring->tail.store(0);
+	ring->capacity = capacity;
+}
+
+bool shm_region_create(struct shm_region *region, const std::string &name)
+{
+	if (!shm_region_map(region, name, true)) {
+		return false;
+	}
+	memset(region->base, 0, region->size);
+	struct shm_control *control = shm_region_control(region);
+	control->worker_ready.store(0);
+	control->shutdown.store(0);
+	control->worker_heartbeat_ns.store(0);
+	shm_ring_init(shm_region_request_ring(region), SHM_REQUEST_RING_SIZE);
+	shm_ring_init(shm_region_response_ring(region), SHM_RESPONSE_RING_SIZE);
+	// publish the magic last, the worker checks it on open
+	std::atomic_thread_fence(std::memory_order_release);
+	control->magic = SHM_REGION_MAGIC;
+	return true;
+}
+
+bool shm_region_open(struct shm_region *region, const std::string &name)
+{
+	if (!shm_region_map(region, name, false)) {
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (shm_region_control(region)->magic != SHM_REGION_MAGIC) {
+		shm_region_close(region);
+		return false;
+	}
+	return true;
+}
+
+void shm_region_unlink(struct shm_region *region)
+{
+#ifndef _WIN32
+	if (!region->name.empty()) {
+		shm_unlink(region->name.c_str());
+	}
+#endif
+	region->name.clear();
+}
+
+void shm_region_close(struct shm_region *region)
+{
+	if (region->base == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(region->base);
+	CloseHandle((HANDLE)region->mapping_handle);
+	region->mapping_handle = nullptr;
+#else
+	munmap(region->base, region->size);
+#endif
+	region->base = nullptr;
+	region->size = 0;
+}
+
+struct shm_control *shm_region_control(struct shm_region *region)
+{
+	return static_cast<struct shm_control *>(region->base);
+}
+
+struct shm_ring *shm_region_request_ring(struct shm_region *region)
+{
+	return reinterpret_cast<struct shm_ring *>(static_cast<uint8_t *>(region->base) +
+						   align_up(sizeof(shm_control)));
+}
+
+struct shm_ring *shm_region_response_ring(struct shm_region *region)
+{
+	return reinterpret_cast<struct shm_ring *>(
+		static_cast<uint8_t *>(region->base) + align_up(sizeof(shm_control)) +
+		align_up(sizeof(shm_ring) + SHM_REQUEST_RING_SIZE));
+}
+
+static uint8_t *shm_ring_data(struct shm_ring *ring)
+{
+	return reinterpret_cast<uint8_t *>(ring) + sizeof(shm_ring);
+}
+
+static void shm_ring_copy_in(struct shm_ring *ring, uint64_t pos, const void *src, size_t size)
+{
+	const size_t offset = (size_t)(pos % ring->capacity);
+	const size_t first = std::min(size, (size_t)ring->capacity - offset);
+	memcpy(shm_ring_data(ring) + offset, src, first);
+	memcpy(shm_ring_data(ring), static_cast<const uint8_t *>(src) + first, size - first);
+}
+
+static void shm_ring_copy_out(struct shm_ring *ring, uint64_t pos, void *dst, size_t size)
+{
+	const size_t offset = (size_t)(pos % ring->capacity);
+	const size_t first = std::min(size, (size_t)ring->capacity - offset);
+	memcpy(dst, shm_ring_data(ring) + offset, first);
+	memcpy(static_cast<uint8_t *>(dst) + first, shm_ring_data(ring), size - first);
+}
+
+bool shm_ring_write(struct shm_ring *ring, const void *header, size_t header_size,
+		    const void *payload, size_t payload_size)
+{
+	const uint32_t size = (uint32_t)(header_size + payload_size);
+	const uint64_t head = ring->head.load(std::memory_order_relaxed);
+	const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+	if (ring->capacity - (head - tail) < sizeof(size) + size) {
+		return false;
+	}
+	shm_ring_copy_in(ring, head, &size, sizeof(size));
+	shm_ring_copy_in(ring, head + sizeof(size), header, header_size);
+	if (payload_size > 0) {
+		shm_ring_copy_in(ring, head + sizeof(size) + header_size, payload, payload_size);
+	}
+	ring->head.store(head + sizeof(size) + size, std::memory_order_release);
+	return true;
+}
+
+size_t shm_ring_read(struct shm_ring *ring, void *buffer, size_t buffer_size)
+{
+	const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+	const uint64_t head = ring->head.load(std::memory_order_acquire);
+	if (head - tail < sizeof(uint32_t)) {
+		return 0;
+	}
+	uint32_t size = 0;
+	shm_ring_copy_out(ring, tail, &size, sizeof(size));
+	if (size > buffer_size) {
+		// cannot take the message, drop it so the ring does not stall
+		ring->tail.store(tail + sizeof(size) + size, std::memory_order_release);
+		return 0;
+	}
+	shm_ring_copy_out(ring, tail + sizeof(size), buffer, size);
+	ring->tail.store(tail + sizeof(size) + size, std::memory_order_release);
+	return size;
+}
@@ -0,0 +1,61 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define SHM_REGION_MAGIC 0x4C564F43 // "LVOC"
+// requests carry up to a 30 s window of float samples
+#define SHM_REQUEST_RING_SIZE (4 * 1024 * 1024)
+#define SHM_RESPONSE_RING_SIZE (64 * 1024)
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+	      "shared memory rings need lock-free 64 bit atomics");
+
+// Single producer / single consumer byte ring living in shared memory.
+// Messages are framed as [uint32 size][payload] and may wrap around the end.
+struct shm_ring {
+	std::atomic<uint64_t> head; // total bytes written by the producer
+	std::atomic<uint64_t> tail; // total bytes consumed by the consumer
+	uint64_t capacity;
+	// followed by `capacity` bytes of data
+};
+
+// Layout of the shared region between the plugin and the worker process
+struct shm_control {
+	uint32_t magic;
+	std::atomic<uint32_t> worker_ready;
+	std::atomic<uint32_t> shutdown;
+	// os_gettime_ns style heartbeat of the worker loop
+	std::atomic<uint64_t> worker_heartbeat_ns;
+};
+
+struct shm_region {
+	void *base = nullptr;
+	size_t size = 0;
+	std::string name;
+#ifdef _WIN32
+	void *mapping_handle = nullptr;
+#endif
+};
+
+size_t shm_region_required_size();
+bool shm_region_create(struct shm_region *region, const std::string &name);
+bool shm_region_open(struct shm_region *region, const std::string &name);
+// Remove the name, existing mappings stay valid (no-op on Windows)
+void shm_region_unlink(struct shm_region *region);
+void shm_region_close(struct shm_region *region);
+
+struct shm_control *shm_region_control(struct shm_region *region);
+struct shm_ring *shm_region_request_ring(struct shm_region *region);
+struct shm_ring *shm_region_response_ring(struct shm_region *region);
+
+// Returns false when the ring does not have room for the whole message
+bool shm_ring_write(struct shm_ring *ring, const void *header, size_t header_size,
+		    const void *payload, size_t payload_size);
+// Returns the message size, 0 if the ring is empty. Fails (returns 0) if buffer is too small.
+size_t shm_ring_read(struct shm_ring *ring, void *buffer, size_t buffer_size);
+
+#endif // SHM_RING_H
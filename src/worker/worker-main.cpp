@@ -0,0 +1,242 @@
+// Helper process hosting the whisper model for the LocalVocal filter.
+//
+// usage: localvocal-worker --shm <name> --model <model.bin> --parent <pid>
+//        localvocal-worker --listen [host:]port --model <model.bin>
+//
+// With --shm, audio windows arrive on the request ring of the shared memory region and
+// results are written to the response ring. A crash here leaves OBS running, the filter
+// restarts the worker.
+//
+// With --listen the worker runs as a daemon serving filters on other machines over TCP
+// (127.0.0.1 unless a host is given), one thread and whisper state per connection.
+
+#include "worker/net-socket.h"
+#include "worker/shm-ring.h"
+#include "worker/worker-protocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// each connection holds a whisper state and decodes on its own threads, connections past this
+// are closed at once and the filter transcribes locally
+#define WORKER_DEFAULT_MAX_CONNECTIONS 2
+
+static std::atomic<int> active_connections{0};
+
+static uint64_t now_ns()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+static bool parent_alive(long parent_pid)
+{
+	if (parent_pid <= 0) {
+		return true;
+	}
+#ifdef _WIN32
+	HANDLE parent = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)parent_pid);
+	if (parent == NULL) {
+		return false;
+	}
+	const bool alive = WaitForSingleObject(parent, 0) == WAIT_TIMEOUT;
+	CloseHandle(parent);
+	return alive;
+#else
+	// orphaned processes are re-parented
+	return getppid() == (pid_t)parent_pid;
+#endif
+}
+
+static int run_shm_worker(struct whisper_context *ctx, const std::string &shm_name,
+			  long parent_pid)
+{
+	struct shm_region region;
+	if (!shm_region_open(&region, shm_name)) {
+		fprintf(stderr, "localvocal-worker: cannot open shared memory %s\n",
+			shm_name.c_str());
+		return 1;
+	}
+	struct shm_control *control = shm_region_control(&region);
+	struct shm_ring *requests = shm_region_request_ring(&region);
+	struct shm_ring *responses = shm_region_response_ring(&region);
+
+	struct whisper_state *state = whisper_init_state(ctx);
+	if (state == nullptr) {
+		fprintf(stderr, "localvocal-worker: failed to allocate whisper state\n");
+		shm_region_close(&region);
+		return 1;
+	}
+	control->worker_heartbeat_ns.store(now_ns());
+	control->worker_ready.store(1);
+
+	std::vector<uint8_t> message(sizeof(worker_request_header) +
+				     WORKER_MAX_SAMPLES * sizeof(float));
+	std::vector<float> samples(WORKER_MAX_SAMPLES);
+	std::string text;
+	int idle_loops = 0;
+	while (control->shutdown.load() == 0) {
+		control->worker_heartbeat_ns.store(now_ns());
+		const size_t size = shm_ring_read(requests, message.data(), message.size());
+		if (size < sizeof(worker_request_header)) {
+			// poll every ms, check the parent every second
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			if (++idle_loops % 1000 == 0 && !parent_alive(parent_pid)) {
+				break;
+			}
+			continue;
+		}
+		idle_loops = 0;
+
+		worker_request_header request;
+		memcpy(&request, message.data(), sizeof(request));
+		worker_sanitize_request(request);
+		request.n_samples = (uint32_t)worker_decode_samples(
+			request, message.data() + sizeof(request), size - sizeof(request),
+			samples.data());
+
+		worker_response_header response;
+		worker_run_inference(ctx, state, request, samples.data(), response, text);
+		while (!shm_ring_write(responses, &response, sizeof(response), text.data(),
+				       text.size())) {
+			// the plugin is not draining results, wait for room
+			if (control->shutdown.load() != 0) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	whisper_free_state(state);
+	shm_region_close(&region);
+	return 0;
+}
+
+static void serve_connection(struct whisper_context *ctx, net_socket connection)
+{
+	struct whisper_state *state = whisper_init_state(ctx);
+	if (state == nullptr) {
+		net_close(connection);
+		active_connections--;
+		return;
+	}
+	std::vector<uint8_t> message;
+	std::vector<float> samples(WORKER_MAX_SAMPLES);
+	std::string text;
+	while (true) {
+		const size_t size = net_recv_message(connection, message,
+						     sizeof(worker_request_header) +
+							     WORKER_MAX_SAMPLES * sizeof(float),
+						     -1);
+		if (size < sizeof(worker_request_header)) {
+			break;
+		}
+		worker_request_header request;
+		memcpy(&request, message.data(), sizeof(request));
+		worker_sanitize_request(request);
+		request.n_samples = (uint32_t)worker_decode_samples(
+			request, message.data() + sizeof(request), size - sizeof(request),
+			samples.data());
+
+		worker_response_header response;
+		worker_run_inference(ctx, state, request, samples.data(), response, text);
+		if (!net_send_message(connection, &response, sizeof(response), text.data(),
+				      text.size())) {
+			break;
+		}
+	}
+	whisper_free_state(state);
+	net_close(connection);
+	active_connections--;
+}
+
+static int run_tcp_daemon(struct whisper_context *ctx, const std::string &address,
+			  int max_connections)
+{
+	std::string host = "127.0.0.1";
+	int port = NET_DEFAULT_WORKER_PORT;
+	const std::string full_address =
+		address.find(':') == std::string::npos ? host + ":" + address : address;
+	if (!net_parse_address(full_address, host, port)) {
+		fprintf(stderr, "localvocal-worker: invalid listen address %s\n", address.c_str());
+		return 1;
+	}
+	net_socket listener = net_listen(host, port);
+	if (listener == NET_INVALID_SOCKET) {
+		fprintf(stderr, "localvocal-worker: cannot listen on %s:%d\n", host.c_str(), port);
+		return 1;
+	}
+	fprintf(stderr, "localvocal-worker: listening on %s:%d\n", host.c_str(), port);
+	while (true) {
+		net_socket connection = net_accept(listener);
+		if (connection == NET_INVALID_SOCKET) {
+			continue;
+		}
+		if (active_connections.load() >= max_connections) {
+			fprintf(stderr,
+				"localvocal-worker: %d connections open, refusing another\n",
+				max_connections);
+			net_close(connection);
+			continue;
+		}
+		// the model weights are shared, each connection gets its own state
+		active_connections++;
+		std::thread(serve_connection, ctx, connection).detach();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	std::string shm_name;
+	std::string listen_address;
+	std::string model_path;
+	long parent_pid = 0;
+	int max_connections = WORKER_DEFAULT_MAX_CONNECTIONS;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const std::string arg = argv[i];
+		if (arg == "--shm") {
+			shm_name = argv[i + 1];
+		} else if (arg == "--listen") {
+			listen_address = argv[i + 1];
+		} else if (arg == "--model") {
+			model_path = argv[i + 1];
+		} else if (arg == "--parent") {
+			parent_pid = atol(argv[i + 1]);
+		} else if (arg == "--max-connections") {
+			max_connections = std::max(1, atoi(argv[i + 1]));
+		}
+	}
+	if ((shm_name.empty() && listen_address.empty()) || model_path.empty()) {
+		fprintf(stderr,
+			"usage: %s --shm <name> --model <model.bin> [--parent <pid>]\n"
+			"       %s --listen [host:]port --model <model.bin> "
+			"[--max-connections <n>]\n",
+			argv[0], argv[0]);
+		return 1;
+	}
+
+	struct whisper_context *ctx = whisper_init_from_file_no_state(model_path.c_str());
+	if (ctx == nullptr) {
+		fprintf(stderr, "localvocal-worker: failed to load model %s\n", model_path.c_str());
+		return 1;
+	}
+	const int result = listen_address.empty() ? run_shm_worker(ctx, shm_name, parent_pid)
+						  : run_tcp_daemon(ctx, listen_address,
+								   max_connections);
+	whisper_free(ctx);
+	return result;
+}
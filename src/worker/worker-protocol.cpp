@@ -0,0 +1,153 @@
+#include "worker-protocol.h"
+#include "logits-filter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+struct worker_params worker_params_from_whisper(const whisper_full_params &params)
+{
+	struct worker_params out;
+	memset(&out, 0, sizeof(out));
+	out.strategy = (int32_t)params.strategy;
+	out.n_threads = params.n_threads;
+	out.n_max_text_ctx = params.n_max_text_ctx;
+	out.duration_ms = params.duration_ms;
+	out.max_len = params.max_len;
+	out.max_tokens = params.max_tokens;
+	out.thold_pt = params.thold_pt;
+	out.thold_ptsum = params.thold_ptsum;
+	out.temperature = params.temperature;
+	out.max_initial_ts = params.max_initial_ts;
+	out.length_penalty = params.length_penalty;
+	out.no_speech_thold = params.no_speech_thold;
+	out.translate = params.translate;
+	out.no_context = params.no_context;
+	out.single_segment = params.single_segment;
+	out.token_timestamps = params.token_timestamps;
+	out.split_on_word = params.split_on_word;
+	out.speed_up = params.speed_up;
+	out.suppress_blank = params.suppress_blank;
+	out.suppress_non_speech_tokens = params.suppress_non_speech_tokens;
+	if (params.language != nullptr) {
+		strncpy(out.language, params.language, sizeof(out.language) - 1);
+	}
+	return out;
+}
+
+whisper_full_params worker_params_to_whisper(const struct worker_params &params)
+{
+	whisper_full_params out =
+		whisper_full_default_params((whisper_sampling_strategy)params.strategy);
+	out.n_threads = params.n_threads;
+	out.n_max_text_ctx = params.n_max_text_ctx;
+	out.duration_ms = params.duration_ms;
+	out.max_len = params.max_len;
+	out.max_tokens = params.max_tokens;
+	out.thold_pt = params.thold_pt;
+	out.thold_ptsum = params.thold_ptsum;
+	out.temperature = params.temperature;
+	out.max_initial_ts = params.max_initial_ts;
+	out.length_penalty = params.length_penalty;
+	out.no_speech_thold = params.no_speech_thold;
+	out.translate = params.translate != 0;
+	out.no_context = params.no_context != 0;
+	out.single_segment = params.single_segment != 0;
+	out.token_timestamps = params.token_timestamps != 0;
+	out.split_on_word = params.split_on_word != 0;
+	out.speed_up = params.speed_up != 0;
+	out.suppress_blank = params.suppress_blank != 0;
+	out.suppress_non_speech_tokens = params.suppress_non_speech_tokens != 0;
+	out.print_progress = false;
+	out.print_realtime = false;
+	out.print_special = false;
+	out.print_timestamps = false;
+	// language points into the request, which outlives the whisper_full call
+	out.language = params.language;
+	return out;
+}
+
+void worker_encode_s16(const float *pcm32f, size_t n_samples, std::vector<int16_t> &pcm16)
+{
+	pcm16.resize(n_samples);
+	for (size_t i = 0; i < n_samples; i++) {
+		const float v = std::min(1.0f, std::max(-1.0f, pcm32f[i]));
+		pcm16[i] = (int16_t)(v * 32767.0f);
+	}
+}
+
+void worker_sanitize_request(struct worker_request_header &request)
+{
+	struct worker_params &params = request.params;
+	params.language[sizeof(params.language) - 1] = '\0';
+	const int32_t max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+	params.n_threads = std::min(std::max(params.n_threads, (int32_t)1), max_threads);
+	if (params.strategy != WHISPER_SAMPLING_GREEDY &&
+	    params.strategy != WHISPER_SAMPLING_BEAM_SEARCH) {
+		params.strategy = WHISPER_SAMPLING_GREEDY;
+	}
+}
+
+size_t worker_decode_samples(const struct worker_request_header &request, const uint8_t *payload,
+			     size_t payload_size, float *samples)
+{
+	const size_t sample_size = request.sample_format == WORKER_SAMPLE_FORMAT_S16
+					   ? sizeof(int16_t)
+					   : sizeof(float);
+	const size_t n_samples = std::min<size_t>(
+		{request.n_samples, payload_size / sample_size, (size_t)WORKER_MAX_SAMPLES});
+	if (request.sample_format == WORKER_SAMPLE_FORMAT_S16) {
+		// the packed header leaves the payload unaligned
+		for (size_t i = 0; i < n_samples; i++) {
+			int16_t s16;
+			memcpy(&s16, payload + i * sizeof(int16_t), sizeof(s16));
+			samples[i] = (float)s16 / 32768.0f;
+		}
+	} else {
+		memcpy(samples, payload, n_samples * sizeof(float));
+	}
+	return n_samples;
+}
+
+void worker_run_inference(struct whisper_context *ctx, struct whisper_state *state,
+			  const struct worker_request_header &request, const float *samples,
+			  struct worker_response_header &response, std::string &text)
+{
+	memset(&response, 0, sizeof(response));
+	response.id = request.id;
+	text.clear();
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	whisper_full_params params = worker_params_to_whisper(request.params);
+	struct logits_filter_chain chain;
+	struct no_speech_check no_speech;
+	if (no_speech_check_init(&no_speech, params)) {
+		logits_filter_chain_add_no_speech_check(&chain, &no_speech);
+	}
+	logits_filter_chain_install(&chain, params);
+	response.status =
+		whisper_full_with_state(ctx, state, params, samples, (int)request.n_samples);
+	response.no_speech = no_speech.no_speech ? 1 : 0;
+	response.inference_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::high_resolution_clock::now() - start)
+					.count();
+	if (response.status != 0 || whisper_full_n_segments_from_state(state) == 0) {
+		return;
+	}
+
+	const int n_segment = 0;
+	text = whisper_full_get_segment_text_from_state(state, n_segment);
+	if (text.size() > WORKER_MAX_TEXT_SIZE) {
+		text.resize(WORKER_MAX_TEXT_SIZE);
+	}
+	response.t0 = whisper_full_get_segment_t0_from_state(state, n_segment);
+	response.t1 = whisper_full_get_segment_t1_from_state(state, n_segment);
+	const int n_tokens = whisper_full_n_tokens_from_state(state, n_segment);
+	float sentence_p = 0.0f;
+	for (int j = 0; j < n_tokens; ++j) {
+		sentence_p += whisper_full_get_token_p_from_state(state, n_segment, j);
+	}
+	response.sentence_p = n_tokens > 0 ? sentence_p / (float)n_tokens : 0.0f;
+	response.text_size = (uint32_t)text.size();
+}
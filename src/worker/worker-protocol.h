@@ -0,0 +1,84 @@
+#ifndef WORKER_PROTOCOL_H
+#define WORKER_PROTOCOL_H
+
+#include <whisper.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define WORKER_MAX_TEXT_SIZE 2048
+#define WORKER_MAX_SAMPLES (WHISPER_SAMPLE_RATE * WHISPER_CHUNK_SIZE)
+
+enum worker_sample_format {
+	WORKER_SAMPLE_FORMAT_F32 = 0,
+	WORKER_SAMPLE_FORMAT_S16 = 1,
+};
+
+// The subset of whisper_full_params the filter configures, in a fixed layout
+#pragma pack(push, 1)
+struct worker_params {
+	int32_t strategy;
+	int32_t n_threads;
+	int32_t n_max_text_ctx;
+	int32_t duration_ms;
+	int32_t max_len;
+	int32_t max_tokens;
+	float thold_pt;
+	float thold_ptsum;
+	float temperature;
+	float max_initial_ts;
+	float length_penalty;
+	float no_speech_thold;
+	uint8_t translate;
+	uint8_t no_context;
+	uint8_t single_segment;
+	uint8_t token_timestamps;
+	uint8_t split_on_word;
+	uint8_t speed_up;
+	uint8_t suppress_blank;
+	uint8_t suppress_non_speech_tokens;
+	char language[8];
+};
+
+struct worker_request_header {
+	uint64_t id;
+	struct worker_params params;
+	uint32_t n_samples;
+	uint8_t sample_format;
+	// followed by n_samples samples in sample_format
+};
+
+struct worker_response_header {
+	uint64_t id;
+	// 0 on success, otherwise the whisper_full error code
+	int32_t status;
+	// segment timestamps in 10 ms units
+	int64_t t0;
+	int64_t t1;
+	float sentence_p;
+	// the no-speech check stopped the decoder
+	uint8_t no_speech;
+	uint32_t inference_us;
+	uint32_t text_size;
+	// followed by text_size bytes of UTF-8 text
+};
+#pragma pack(pop)
+
+struct worker_params worker_params_from_whisper(const whisper_full_params &params);
+whisper_full_params worker_params_to_whisper(const struct worker_params &params);
+
+// 16 bit samples halve the size of a request, used for network transport
+void worker_encode_s16(const float *pcm32f, size_t n_samples, std::vector<int16_t> &pcm16);
+// Bound the parameters of a request that came from another process or the network
+void worker_sanitize_request(struct worker_request_header &request);
+// Convert the request payload to float samples, returns the number of samples decoded
+size_t worker_decode_samples(const struct worker_request_header &request, const uint8_t *payload,
+			     size_t payload_size, float *samples);
+
+// Run whisper on the request samples (already converted to float) and fill the response
+void worker_run_inference(struct whisper_context *ctx, struct whisper_state *state,
+			  const struct worker_request_header &request, const float *samples,
+			  struct worker_response_header &response, std::string &text);
+
+#endif // WORKER_PROTOCOL_H